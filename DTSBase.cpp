@@ -24,6 +24,8 @@
 
 #include "DTSBase.h"
 #include "DTSShape.h"
+#include "DTSStats.h"
+#include "DTSTrace.h"
 #include <assert.h>
 #include <string.h>
 
@@ -255,12 +257,19 @@ void DTSBase::Read(DTSCluster& value)
     Read(value.backCluster);
 }
 
+template <typename DataType> static bool sameElements(const std::vector<DataType>& a, const std::vector<DataType>& b)
+{
+    return (a.size() == b.size()) && (a.empty() || (memcmp(&a[0], &b[0], a.size() * sizeof(DataType)) == 0));
+}
+
 void DTSBase::Read(DTSMesh& value)
 {
     Read(value.type);
     
     if (value.type == DTSMesh::T_Null) return ;
     
+    DTSTraceScope trace("decode mesh");
+    
     ReadCheck() ;
     
     // Header & Bounds
@@ -319,11 +328,30 @@ void DTSBase::Read(DTSMesh& value)
 
     if (value.type == DTSMesh::T_Skin)
     {
+        value.baseVerts   .swap(value.verts);
+        value.baseNormals .swap(value.normals);
+        value.baseEnormals.swap(value.enormals);
+
         Read(numVertexes);
+        value.verts   .resize(numVertexes);
+        value.normals .resize(numVertexes);
+        value.enormals.resize(numVertexes);
         Read(value.verts);
         Read(value.normals);
         Read(value.enormals);
 
+        // Exporters usually write the same vertices twice.
+        value.baseVertsDiffer = !sameElements(value.baseVerts,    value.verts)   ||
+                                !sameElements(value.baseNormals,  value.normals) ||
+                                !sameElements(value.baseEnormals, value.enormals);
+
+        if (!value.baseVertsDiffer)
+        {
+            std::vector<Point>        ().swap(value.baseVerts);
+            std::vector<Point>        ().swap(value.baseNormals);
+            std::vector<unsigned char>().swap(value.baseEnormals);
+        }
+
         int numNodeIndex;
 
         Read(numNodeIndex);
@@ -374,9 +402,7 @@ void DTSBase::Read(DTSMesh& value)
         value.firstTVerts.resize(numFirstTVerts);
         Read(value.firstTVerts);
 
-        int alwaysWriteDepth;
-
-        Read(alwaysWriteDepth);
+        Read(value.alwaysWriteDepth);
         ReadCheck();
     }
 };
@@ -452,6 +478,10 @@ void DTSBase::load(FILE* file)
     assert(readed == allocated16);
     readed = fread(&buffer8[0],  sizeof(char),  allocated8,  file);
     assert(readed == allocated8);
+
+    DTSStats::add(DTSStats::C_Bytes32, (long long)allocated32 * sizeof(int));
+    DTSStats::add(DTSStats::C_Bytes16, (long long)allocated16 * sizeof(short));
+    DTSStats::add(DTSStats::C_Bytes8,  (long long)allocated8);
     
     checkCount = 0;
     used32     = 0;
@@ -46,6 +46,11 @@ class DTSCluster;
 
 class DTSBase
 {
+    friend class DTSShapeImage;
+    friend class DTSShapeImageWriter;
+    friend class DTSWriter;
+    friend class DTSSynthetic;
+
 protected:
     int dtsVersion;
     int totalSize;
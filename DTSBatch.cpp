@@ -0,0 +1,499 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <vector>
+
+#ifndef WIN32
+#include <glob.h>
+#include <pthread.h>
+#endif
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSOptions.h"
+#include "DTSThreads.h"
+#include "DTSMemory.h"
+#include "DTSExport.h"
+#include "DTSCache.h"
+#include "DTSBatch.h"
+#include "DTSTrace.h"
+
+// DTS2FBX.cpp
+std::string fbxWriterName(const DTSOptions& options);
+
+#ifdef WIN32
+#define PATHSEP "\\"
+#else
+#define PATHSEP "/"
+#endif
+
+void DTSGlob(const char* pattern, std::vector<std::string>& paths)
+{
+#ifdef WIN32
+    paths.push_back(pattern);
+#else
+    glob_t g;
+
+    glob(pattern, 0, NULL, &g);
+
+    for (size_t index = 0; index < g.gl_pathc; index++)
+    {
+        paths.push_back(g.gl_pathv[index]);
+    }
+
+    globfree(&g);
+#endif
+}
+
+static unsigned long long fileSize(const std::string& path)
+{
+    struct stat s;
+
+    return (stat(path.c_str(), &s) == 0) ? (unsigned long long)s.st_size : 0;
+}
+
+static bool largerJob(const DTSBatchJob& a, const DTSBatchJob& b)
+{
+    return (a.predicted != b.predicted) ? (a.predicted > b.predicted) : (a.line < b.line);
+}
+
+// Peak model, compare with the measured peaks of batch to tune it. Shape
+// streams stay in the DTSShape next to the decoded arrays and the baked
+// meshes, sequence files are copied while loaded and baked to every frame.
+static const double    ShapeFactor    = 6.0;
+static const double    SequenceFactor = 6.0;
+static const long long MeshBytes      = 4096;
+static const long long SequenceBytes  = 65536;
+static const long long JobBytes       = 1 << 20;
+
+// Counts of a .dts header, same layout as DTSShape::loadShapeFile.
+static bool peekShape(const std::string& path, long long& streamBytes, int& numMeshes, int& numSequences)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    int   header[4], counts[16];
+
+    if (!file)
+    {
+        return false;
+    }
+
+    if ((fread(header, sizeof(int), 4, file) != 4) || (fread(counts, sizeof(int), 16, file) != 16))
+    {
+        fclose(file);
+        return false;
+    }
+
+    // numNodes to numIFLmaterials, the node transform counts, then numObjectStates
+    // to numDetailLevels before numMeshes.
+    int version = header[0];
+    int index   = 5 + ((version < 22) ? 1 : ((version > 23) ? 6 : 5)) + 4;
+
+    streamBytes  = (long long)header[1] * 4;
+    numMeshes    = counts[index];
+    numSequences = 0;
+
+    // Sequences follow the streams.
+    if ((fseek(file, (long)(16 + streamBytes), SEEK_SET) != 0) || (fread(&numSequences, sizeof(int), 1, file) != 1))
+    {
+        numSequences = 0;
+    }
+
+    fclose(file);
+    return (streamBytes >= 0) && (16 + streamBytes <= (long long)fileSize(path)) &&
+           (numMeshes >= 0) && (numMeshes <= streamBytes) && (numSequences >= 0);
+}
+
+long long DTSBatch::estimate(const DTSBatchJob& job)
+{
+    long long streamBytes   = 0;
+    long long sequenceBytes = (long long)(job.size - fileSize(job.shapeFile));
+    int       numMeshes     = 0, numSequences = 0;
+
+    if (!peekShape(job.shapeFile, streamBytes, numMeshes, numSequences))
+    {
+        return JobBytes;
+    }
+
+    return JobBytes + (long long)(ShapeFactor * streamBytes) + MeshBytes * numMeshes +
+           SequenceBytes * numSequences + (long long)(SequenceFactor * sequenceBytes);
+}
+
+void DTSBatch::expand(DTSBatchJob& job)
+{
+    job.sequenceFiles.clear();
+
+    for (size_t index = 0; index < job.patterns.size(); index++)
+    {
+        DTSGlob(job.patterns[index].c_str(), job.sequenceFiles);
+    }
+
+    job.size = fileSize(job.shapeFile);
+
+    for (size_t index = 0; index < job.sequenceFiles.size(); index++)
+    {
+        job.size += fileSize(job.sequenceFiles[index]);
+    }
+
+    job.predicted = estimate(job);
+}
+
+static void jobResolver(const DTSBatchJob& job, DTSResolver& resolver)
+{
+    resolver.addPathContaining(job.output);
+    resolver.addPathContaining(job.shapeFile);
+
+    for (size_t index = 0; index < job.sequenceFiles.size(); index++)
+    {
+        resolver.addPathContaining(job.sequenceFiles[index]);
+    }
+}
+
+// Every path the resolver tries for the materials, a texture appearing in a
+// directory searched first changes the output too.
+static void textureFiles(const DTSResolver& resolver, const DTSShape& shape, std::vector<std::string>& textures)
+{
+    textures.clear();
+
+    std::vector<DTSMaterial>::const_iterator it, end(shape.materials.end());
+
+    for (it = shape.materials.begin(); it != end; ++it)
+    {
+        std::vector<std::string>::const_iterator pathIt, pathEnd(resolver.paths.end());
+
+        for (pathIt = resolver.paths.begin(); pathIt != pathEnd; ++pathIt)
+        {
+            textures.push_back(*pathIt + PATHSEP + (*it).name);
+        }
+
+        textures.push_back((*it).name);
+    }
+}
+
+void DTSBatch::scan(DTSBatchJob& job, const DTSOptions& options)
+{
+    DTSResolver resolver;
+    DTSShape    shape;
+
+    jobResolver(job, resolver);
+
+    if (DTSLoadShape(job.shapeFile.c_str(), false, NULL, options.shapeCache, shape))
+    {
+        textureFiles(resolver, shape, job.textures);
+    }
+}
+
+bool DTSBatch::load(const char* manifest)
+{
+    FILE* fileIn = fopen(manifest, "r");
+
+    if (!fileIn)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", manifest, strerror(errno));
+        return false;
+    }
+
+    std::string line;
+    int         number = 0, c = 0;
+
+    while (c != EOF)
+    {
+        line.clear();
+
+        while (((c = fgetc(fileIn)) != EOF) && (c != '\n'))
+        {
+            line += (char)c;
+        }
+
+        number++;
+
+        std::vector<std::string> words;
+        size_t                   start, end = 0;
+
+        while ((start = line.find_first_not_of(" \t\r", end)) != std::string::npos)
+        {
+            end = line.find_first_of(" \t\r", start);
+            words.push_back(line.substr(start, (end == std::string::npos) ? end : end - start));
+        }
+
+        if (words.empty() || (words[0][0] == '#'))
+        {
+            continue;
+        }
+
+        if (words.size() < 2)
+        {
+            fprintf(DTSErrorFile(), "%s:%i: expected output.fbx shape.dts [file.dsq ...]\n", manifest, number);
+            fclose(fileIn);
+            return false;
+        }
+
+        DTSBatchJob job;
+
+        job.line      = number;
+        job.output    = words[0];
+        job.shapeFile = words[1];
+        job.patterns.assign(words.begin() + 2, words.end());
+        job.status    = DTSBatchJob::S_Pending;
+        job.seconds   = 0.0;
+        job.peak      = 0;
+
+        expand(job);
+        jobs.push_back(job);
+    }
+
+    fclose(fileIn);
+    return true;
+}
+
+void DTSBatch::convert(DTSBatchJob& job, const DTSOptions& options)
+{
+    DTSTraceScope            trace("job", job.output.c_str());
+    DTSResolver              resolver;
+    DTSConversionCache       cache(options.cache);
+    std::vector<std::string> outputs(1, job.output);
+
+    jobResolver(job, resolver);
+
+    if (!cache.directory.empty())
+    {
+        cache.hashSources(job.shapeFile.c_str(), job.sequenceFiles, options);
+    }
+
+    if (cache.fetch(resolver, job.output))
+    {
+        cache.record();
+        job.status = DTSBatchJob::S_Cached;
+        return;
+    }
+
+    DTSShape shape;
+
+    if (!DTSLoadShape(job.shapeFile.c_str(), false, NULL, options.shapeCache, shape))
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", job.shapeFile.c_str(), strerror(errno));
+        cache.record();
+        job.status = DTSBatchJob::S_Failed;
+        return;
+    }
+
+    textureFiles(resolver, shape, job.textures);
+
+    std::vector<DTSShape> sequenceFiles;
+
+    for (size_t index = 0; index < job.sequenceFiles.size(); index++)
+    {
+        DTSShape sequence;
+
+        if (DTSLoadShape(job.sequenceFiles[index].c_str(), true, &shape, options.shapeCache, sequence))
+        {
+            sequenceFiles.push_back(sequence);
+        }
+        else
+        {
+            fprintf(DTSErrorFile(), "Error: Can't open %s\n", job.sequenceFiles[index].c_str());
+        }
+    }
+
+    if (exportOutputs(resolver, shape, sequenceFiles, outputs, options) == 0)
+    {
+        cache.store(shape, resolver, job.output);
+        job.status = DTSBatchJob::S_Converted;
+    }
+    else
+    {
+        job.status = DTSBatchJob::S_Failed;
+    }
+
+    cache.record();
+}
+
+class DTSBatchTask : public DTSTask
+{
+public:
+    std::vector<DTSBatchJob>& jobs;
+    const DTSOptions&         options;
+    FILE*                     fileOut;
+    long long                 budget;
+
+    std::vector<bool> started;
+    long long         reserved;
+    int               running;
+
+#ifndef WIN32
+    pthread_mutex_t mutex;
+    pthread_cond_t  ended;
+#endif
+
+    DTSBatchTask(std::vector<DTSBatchJob>& j, const DTSOptions& o, FILE* f, long long b) :
+        jobs(j), options(o), fileOut(f), budget(b), started(j.size(), false), reserved(0), running(0)
+    {
+#ifndef WIN32
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init (&ended, NULL);
+#endif
+    }
+
+    ~DTSBatchTask()
+    {
+#ifndef WIN32
+        pthread_mutex_destroy(&mutex);
+        pthread_cond_destroy (&ended);
+#endif
+    }
+
+    // First pending job that fits in the budget, run() is called once per
+    // job so there always is one left.
+    int take()
+    {
+        int index, count = (int)jobs.size();
+
+#ifndef WIN32
+        pthread_mutex_lock(&mutex);
+#endif
+
+        for (;;)
+        {
+            for (index = 0; index < count; index++)
+            {
+                if (!started[index] && ((budget <= 0) || (running == 0) || (reserved + jobs[index].predicted <= budget)))
+                {
+                    break;
+                }
+            }
+
+            if (index < count)
+            {
+                break;
+            }
+
+#ifndef WIN32
+            pthread_cond_wait(&ended, &mutex);
+#endif
+        }
+
+        started[index] = true;
+        reserved      += jobs[index].predicted;
+        running++;
+
+#ifndef WIN32
+        pthread_mutex_unlock(&mutex);
+#endif
+        return index;
+    }
+
+    void release(int index)
+    {
+#ifndef WIN32
+        pthread_mutex_lock(&mutex);
+#endif
+
+        reserved -= jobs[index].predicted;
+        running--;
+
+#ifndef WIN32
+        pthread_cond_broadcast(&ended);
+        pthread_mutex_unlock(&mutex);
+#endif
+    }
+
+    void run(int)
+    {
+        static const char* statusNames[] = { "pending", "converted", "cached", "failed" };
+
+        int          index = take();
+        DTSBatchJob& job(jobs[index]);
+        double       start = DTSSeconds();
+        long long    live  = DTSMemoryLive();
+
+        DTSMemoryResetPeak();
+
+        if (DTSCancelled())
+        {
+            job.status = DTSBatchJob::S_Failed;
+        }
+        else
+        {
+            DTSBatch::convert(job, options);
+        }
+
+        // Of this thread only, see DTSBatch.
+        job.seconds = DTSSeconds() - start;
+        job.peak    = DTSMemoryPeak() - live;
+        release(index);
+
+        fprintf(fileOut, "%-9s %8.2fs %8.1fM %8.1fM  %s\n", statusNames[job.status], job.seconds,
+                job.peak / 1048576.0, job.predicted / 1048576.0, job.output.c_str());
+        fflush(fileOut);
+    }
+};
+
+int DTSBatch::run(const DTSOptions& options, FILE* fileOut)
+{
+    DTSOptions jobOptions(options);
+    int        threads = options.threads;
+    int        failed  = 0;
+    double     start   = DTSSeconds();
+
+    // Jobs are the unit of parallelism, nested loops would only add threads.
+    jobOptions.threads = 1;
+
+    // The built-in writer runs jobs in parallel, the SDK one can't.
+    if (jobOptions.writer.empty())
+    {
+        jobOptions.writer = "binary";
+    }
+
+    // The FBX SDK is not thread safe.
+    if ((fbxWriterName(jobOptions) == "sdk") && (threads != 1))
+    {
+        fprintf(DTSErrorFile(), "The sdk writer converts one job at a time\n");
+        threads = 1;
+    }
+
+    std::sort(jobs.begin(), jobs.end(), largerJob);
+
+    DTSBatchTask task(jobs, jobOptions, fileOut, (long long)options.memBudget * 1048576);
+
+    fprintf(fileOut, "%-9s %9s %9s %9s  %s\n", "status", "time", "peak", "predicted", "output");
+    DTSMemoryAccount(true);
+    DTSParallelFor((int)jobs.size(), task, threads);
+    DTSMemoryAccount(false);
+
+    std::vector<DTSBatchJob>::const_iterator it, end(jobs.end());
+
+    for (it = jobs.begin(); it != end; ++it)
+    {
+        failed += ((*it).status == DTSBatchJob::S_Failed) ? 1 : 0;
+    }
+
+    fprintf(fileOut, "%i jobs, %i failed, %.2fs\n", (int)jobs.size(), failed, DTSSeconds() - start);
+    return (failed > 0) ? -1 : 0;
+}
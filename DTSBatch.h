@@ -0,0 +1,116 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSBatch_h
+#define DTSConverter_DTSBatch_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class DTSOptions;
+
+// Appends the files matching a shell pattern, or the pattern itself where
+// globbing is not available.
+void DTSGlob(const char* pattern, std::vector<std::string>& paths);
+
+/*
+ * One conversion of a batch manifest. Manifest lines follow the convert
+ * command line, blank lines and lines starting with # are skipped:
+ *
+ *   output.fbx shape.dts [sequences*.dsq ...]
+ *
+ * The output format comes from its extension, see exportOutputs. Paths are
+ * relative to the working directory and can't contain spaces.
+ */
+class DTSBatchJob
+{
+public:
+    enum Status
+    {
+        S_Pending,
+        S_Converted,
+        S_Cached,
+        S_Failed
+    };
+
+    int                      line;
+    std::string              output;
+    std::string              shapeFile;
+    std::vector<std::string> patterns;       // of the sequence files
+    std::vector<std::string> sequenceFiles;  // patterns expanded
+    std::vector<std::string> textures;       // paths tried for the materials, once loaded
+    unsigned long long       size;           // bytes of the sources
+    long long                predicted;      // peak heap bytes, see DTSBatch::estimate
+    long long                peak;           // measured
+
+    Status status;
+    double seconds;
+};
+
+/*
+ * Converts every job of a manifest in one process. Jobs are sorted by their
+ * predicted peak, largest first, and handed out one at a time to the
+ * workers: the last jobs to start are the small ones and no thread is left
+ * with a long tail. Each job converts on a single thread, the parallelism
+ * is across jobs. FBX files are written by the built-in binary writer
+ * unless --writer is given; with the sdk one, jobs run one at a time.
+ *
+ * With --mem-budget, a worker takes the first pending job whose predicted
+ * peak fits in what the running jobs leave of the budget, and waits for a
+ * job to end when none fits. A job larger than the budget runs alone.
+ *
+ * A status line is printed as every job ends, with its measured peak heap
+ * (DTSMemoryPeak) next to the predicted one. It's measured on the worker
+ * thread alone: blocks the job frees that another thread allocated, like
+ * shapes evicted from the memory cache under serve, lower it, and blocks
+ * it allocates that another thread frees stay counted against the worker.
+ */
+class DTSBatch
+{
+public:
+    std::vector<DTSBatchJob> jobs;
+
+public:
+    // Returns false when the manifest can't be read or a line is invalid.
+    bool load(const char* manifest);
+
+    // Returns 0 when every job succeeded.
+    int run(const DTSOptions& options, FILE* fileOut);
+
+    // Globs the sequence patterns again and updates the sizes.
+    static void expand(DTSBatchJob& job);
+
+    static void convert(DTSBatchJob& job, const DTSOptions& options);
+
+    // Loads the shape only, for its textures.
+    static void scan(DTSBatchJob& job, const DTSOptions& options);
+
+    // Peak heap of a job from the header of its shape (size of the streams,
+    // mesh and sequence counts) and the size of its sequence files, without
+    // loading anything.
+    static long long estimate(const DTSBatchJob& job);
+};
+
+#endif
@@ -0,0 +1,713 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/stat.h>
+#include <vector>
+#include <algorithm>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSOptions.h"
+#include "DTSScene.h"
+#include "DTSSkin.h"
+#include "DTSGLTF.h"
+#include "DTSThreads.h"
+#include "DTSBench.h"
+
+#ifdef WIN32
+#define PATHSEP "\\"
+#else
+#define PATHSEP "/"
+#endif
+
+// DTS2FBX.cpp
+int convertScene(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const char* fbxFile, const DTSOptions& options);
+
+static double fileSize(const std::string& path)
+{
+    struct stat s;
+
+    return (stat(path.c_str(), &s) == 0) ? (double)s.st_size : 0.0;
+}
+
+static bool loadFile(const std::string& path, const DTSShape* baseShape, DTSShape& shape)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    if (baseShape)
+    {
+        shape.loadSequenceFile(file, baseShape);
+    }
+    else
+    {
+        shape.loadShapeFile(file);
+    }
+
+    fclose(file);
+    return true;
+}
+
+/*
+ * Benchmarks
+ */
+
+// Everything the benchmarks share, loaded once.
+class DTSBenchData
+{
+public:
+    std::string           directory;
+    std::string           shapePath;
+    std::string           sequencePath;
+    DTSShape              shape;
+    std::vector<DTSShape> files;
+    DTSScene              scene;
+    const DTSOptions&     options;
+
+    DTSBenchData(const DTSOptions& o) : options(o) {}
+};
+
+class DTSBenchmark
+{
+public:
+    const char*   name;
+    const char*   stage;
+    DTSBenchData& data;
+
+    std::vector<DTSBenchAmount> amounts;
+
+    DTSBenchmark(const char* n, const char* st, DTSBenchData& d) : name(n), stage(st), data(d) {}
+    virtual ~DTSBenchmark() {}
+
+    // One iteration, returns false on failure.
+    virtual bool run() = 0;
+
+    void amount(const char* unit, double value)
+    {
+        amounts.push_back(DTSBenchAmount());
+        amounts.back().unit  = unit;
+        amounts.back().value = value;
+    }
+};
+
+class DTSLoadShapeBenchmark : public DTSBenchmark
+{
+public:
+    DTSLoadShapeBenchmark(DTSBenchData& d) : DTSBenchmark("load shape", "load", d)
+    {
+        size_t vertices = 0;
+
+        for (size_t index = 0; index < d.shape.meshes.size(); index++)
+        {
+            vertices += d.shape.meshes[index].verts.size();
+        }
+
+        amount("bytes",    fileSize(d.shapePath));
+        amount("vertices", (double)vertices);
+    }
+
+    bool run()
+    {
+        DTSShape shape;
+
+        return loadFile(data.shapePath, NULL, shape);
+    }
+};
+
+class DTSLoadSequencesBenchmark : public DTSBenchmark
+{
+public:
+    DTSLoadSequencesBenchmark(DTSBenchData& d) : DTSBenchmark("load sequences", "load", d)
+    {
+        const DTSShape& file(d.files[0]);
+
+        amount("bytes", fileSize(d.sequencePath));
+        amount("keys",  (double)(file.nodeRotations.size() + file.nodeTranslations.size()));
+    }
+
+    bool run()
+    {
+        DTSShape sequence;
+
+        return loadFile(data.sequencePath, &data.shape, sequence);
+    }
+};
+
+class DTSNormalBenchmark : public DTSBenchmark
+{
+public:
+    std::vector<Point> normals;
+
+    DTSNormalBenchmark(DTSBenchData& d) : DTSBenchmark("normal decode", "triangulation", d)
+    {
+        size_t vertices = 0;
+
+        for (size_t index = 0; index < d.shape.meshes.size(); index++)
+        {
+            vertices += d.shape.meshes[index].enormals.size();
+        }
+
+        amount("vertices", (double)vertices);
+    }
+
+    bool run()
+    {
+        std::vector<DTSMesh>::const_iterator it, end(data.shape.meshes.end());
+
+        for (it = data.shape.meshes.begin(); it != end; ++it)
+        {
+            const std::vector<unsigned char>& enormals((*it).enormals);
+
+            normals.resize(enormals.size());
+
+            for (size_t index = 0; index < enormals.size(); index++)
+            {
+                normals[index] = DTSScene::NormalTable[enormals[index]];
+            }
+        }
+
+        return true;
+    }
+};
+
+// Rigid copies of the meshes, skinning is measured apart.
+class DTSTriangulateBenchmark : public DTSBenchmark
+{
+public:
+    std::vector<DTSMesh> meshes;
+
+    DTSTriangulateBenchmark(DTSBenchData& d) : DTSBenchmark("triangulate", "triangulation", d), meshes(d.shape.meshes)
+    {
+        size_t triangles = 0;
+
+        for (size_t index = 0; index < meshes.size(); index++)
+        {
+            meshes[index].type = DTSMesh::T_Standard;
+            triangles += d.scene.meshes[index].indices.size() / 3;
+        }
+
+        amount("triangles", (double)triangles);
+    }
+
+    bool run()
+    {
+        for (size_t index = 0; index < meshes.size(); index++)
+        {
+            DTSSceneMesh out;
+
+            DTSScene::buildMesh(meshes[index], data.options, out);
+        }
+
+        return true;
+    }
+};
+
+class DTSSkinBenchmark : public DTSBenchmark
+{
+public:
+    DTSSkinBenchmark(DTSBenchData& d) : DTSBenchmark("skin", "triangulation", d)
+    {
+        size_t influences = 0;
+
+        for (size_t index = 0; index < d.shape.meshes.size(); index++)
+        {
+            influences += d.shape.meshes[index].vindex.size();
+        }
+
+        amount("influences", (double)influences);
+    }
+
+    bool run()
+    {
+        std::vector<DTSMesh>::const_iterator it, end(data.shape.meshes.end());
+
+        for (it = data.shape.meshes.begin(); it != end; ++it)
+        {
+            if ((*it).type == DTSMesh::T_Skin)
+            {
+                DTSSkin skin;
+
+                skin.build(*it, (*it).vertsPerFrame, data.options.maxInfluences, data.options.weightBits, data.options.influenceGroup);
+            }
+        }
+
+        return true;
+    }
+};
+
+class DTSBakeBenchmark : public DTSBenchmark
+{
+public:
+    DTSBakeBenchmark(DTSBenchData& d) : DTSBenchmark("bake", "bake", d)
+    {
+        double keys = 0.0;
+
+        for (size_t index = 0; index < d.scene.animations.size(); index++)
+        {
+            keys += (double)d.scene.animations[index].numKeyFrames * d.scene.animations[index].tracks.size();
+        }
+
+        amount("keys", keys);
+    }
+
+    bool run()
+    {
+        const DTSShape& file(data.files[0]);
+
+        for (size_t index = 0; index < file.sequences.size(); index++)
+        {
+            DTSSceneAnimation out;
+
+            DTSScene::buildAnimation(data.shape, file, file.sequences[index], out);
+        }
+
+        return true;
+    }
+};
+
+class DTSWriteBenchmark : public DTSBenchmark
+{
+public:
+    DTSOptions  options;
+    std::string path;
+    bool        gltf;
+
+    DTSWriteBenchmark(const char* n, DTSBenchData& d, const char* writer, const char* file) :
+        DTSBenchmark(n, "write", d), options(d.options), path(d.directory + PATHSEP + file), gltf(writer == NULL)
+    {
+        if (writer)
+        {
+            options.writer = writer;
+        }
+    }
+
+    bool run()
+    {
+        int result = gltf ? writeGLTF(data.scene, data.shape, data.files, path.c_str(), options) :
+                            convertScene(data.scene, data.shape, data.files, path.c_str(), options);
+
+        if (amounts.empty())
+        {
+            amount("bytes", fileSize(path));
+        }
+
+        return result == 0;
+    }
+};
+
+/*
+ * Statistics
+ */
+
+// 95% confidence interval of the median from the order statistics of the
+// samples, distribution free. Below 9 samples it is the whole range.
+static void median(std::vector<double> samples, double& value, double& low, double& high)
+{
+    size_t count = samples.size(), lower = 0;
+
+    std::sort(samples.begin(), samples.end());
+
+    value = (count % 2) ? samples[count / 2] : (samples[count / 2 - 1] + samples[count / 2]) * 0.5;
+
+    // Binomial(count, 1/2) cumulative probabilities.
+    double probability = pow(0.5, (double)count), cumulative = probability;
+
+    // [k-th, (count + 1 - k)-th] misses the median with a probability of
+    // twice P(B < k).
+    for (size_t k = 1; 2 * k <= count + 1; k++)
+    {
+        if (2.0 * cumulative > 0.05)
+        {
+            break;
+        }
+
+        lower        = k - 1;
+        probability *= (double)(count - k + 1) / k;
+        cumulative  += probability;
+    }
+
+    low  = samples[lower];
+    high = samples[count - 1 - lower];
+}
+
+/*
+ * DTSBench
+ */
+
+DTSBench::DTSBench() :
+    seconds  (0.1),
+    runs     (5),
+    warmup   (1),
+    threshold(5.0)
+{
+}
+
+bool DTSBench::parse(const char* argument)
+{
+    char* end;
+
+    if (strncmp(argument, "seconds=", 8) == 0)
+    {
+        seconds = strtod(argument + 8, &end);
+        return (*end == '\0') && (seconds > 0.0);
+    }
+
+    if (strncmp(argument, "threshold=", 10) == 0)
+    {
+        threshold = strtod(argument + 10, &end);
+        return (*end == '\0') && (threshold >= 0.0);
+    }
+
+    if (strncmp(argument, "runs=", 5) == 0)
+    {
+        runs = (int)strtol(argument + 5, &end, 10);
+        return (*end == '\0') && (runs > 0);
+    }
+
+    if (strncmp(argument, "warmup=", 7) == 0)
+    {
+        warmup = (int)strtol(argument + 7, &end, 10);
+        return (*end == '\0') && (warmup >= 0);
+    }
+
+    return spec.parse(argument);
+}
+
+void DTSBench::usage(FILE* fileOut)
+{
+    DTSBench defaults;
+
+    DTSSynthetic::usage(fileOut);
+    fprintf(fileOut, "Benchmarks (name=value):\n");
+    fprintf(fileOut, "  %-12s default %g, minimum time of each benchmark in a run\n", "seconds", defaults.seconds);
+    fprintf(fileOut, "  %-12s default %d, measured runs\n", "runs", defaults.runs);
+    fprintf(fileOut, "  %-12s default %d, runs before the measured ones\n", "warmup", defaults.warmup);
+    fprintf(fileOut, "  %-12s default %g, compare: percents of throughput a benchmark may lose\n", "threshold", defaults.threshold);
+}
+
+int DTSBench::run(const char* directory, const DTSOptions& options)
+{
+    DTSBenchData data(options);
+    DTSResolver  resolver;
+
+    data.directory    = directory;
+    data.shapePath    = data.directory + PATHSEP "synthetic.dts";
+    data.sequencePath = data.directory + PATHSEP "synthetic.dsq";
+    data.files.resize(1);
+
+    if (!spec.write(data.shapePath.c_str(), data.sequencePath.c_str()))
+    {
+        return -1;
+    }
+
+    if (!loadFile(data.shapePath, NULL, data.shape) || !loadFile(data.sequencePath, &data.shape, data.files[0]))
+    {
+        fprintf(DTSErrorFile(), "Failed to load the synthetic files in %s\n", directory);
+        return -1;
+    }
+
+    // Writers are measured on a built scene.
+    data.scene.build(resolver, data.shape, data.files, options);
+
+    std::vector<DTSBenchmark*> benchmarks;
+
+    benchmarks.push_back(new DTSLoadShapeBenchmark    (data));
+    benchmarks.push_back(new DTSLoadSequencesBenchmark(data));
+    benchmarks.push_back(new DTSNormalBenchmark       (data));
+    benchmarks.push_back(new DTSTriangulateBenchmark  (data));
+    benchmarks.push_back(new DTSSkinBenchmark         (data));
+    benchmarks.push_back(new DTSBakeBenchmark         (data));
+    benchmarks.push_back(new DTSWriteBenchmark("write ascii",  data, "ascii",  "synthetic-ascii.fbx"));
+    benchmarks.push_back(new DTSWriteBenchmark("write binary", data, "binary", "synthetic-binary.fbx"));
+    benchmarks.push_back(new DTSWriteBenchmark("write gltf",   data, NULL,     "synthetic.glb"));
+
+    size_t index;
+    int    result = 0;
+
+    results.clear();
+    results.resize(benchmarks.size());
+
+    for (index = 0; index < results.size(); index++)
+    {
+        results[index].iterations = 0;
+    }
+
+    // Runs go through every benchmark in turn, a drift of the machine
+    // spreads over all of them.
+    for (int run = 0; (run < warmup + runs) && (result == 0); run++)
+    {
+        for (index = 0; (index < benchmarks.size()) && (result == 0); index++)
+        {
+            DTSBenchmark& benchmark(*benchmarks[index]);
+            int           iterations = 0;
+            double        start      = DTSSeconds(), elapsed = 0.0;
+
+            do
+            {
+                if (!benchmark.run() || DTSCancelled())
+                {
+                    fprintf(DTSErrorFile(), "Benchmark %s failed\n", benchmark.name);
+                    result = -1;
+                    break;
+                }
+
+                iterations++;
+                elapsed = DTSSeconds() - start;
+            }
+            while (elapsed < seconds);
+
+            if ((run >= warmup) && (iterations > 0))
+            {
+                results[index].iterations += iterations;
+                results[index].samples.push_back(elapsed / iterations);
+            }
+        }
+    }
+
+    for (index = 0; index < benchmarks.size(); index++)
+    {
+        DTSBenchResult& out(results[index]);
+
+        out.name       = benchmarks[index]->name;
+        out.stage      = benchmarks[index]->stage;
+        out.amounts    = benchmarks[index]->amounts;
+        out.baseline   = 0.0;
+        out.regression = false;
+
+        if (out.samples.empty())
+        {
+            out.median = out.low = out.high = 0.0;
+        }
+        else
+        {
+            median(out.samples, out.median, out.low, out.high);
+        }
+
+        delete benchmarks[index];
+    }
+
+    return result;
+}
+
+bool DTSBench::loadBaseline(const char* path)
+{
+    FILE* file = fopen(path, "r");
+
+    if (file == NULL)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    // print() writes the spec and each benchmark on a line of their own.
+    std::string line;
+    char        buffer[1024];
+
+    baselineSpec.clear();
+    baselineResults.clear();
+
+    while (fgets(buffer, sizeof(buffer), file))
+    {
+        line += buffer;
+
+        if (line[line.size() - 1] != '\n')
+        {
+            continue;
+        }
+
+        size_t start = line.find("{\"spec\": {");
+
+        if (start != std::string::npos)
+        {
+            start       += 10;
+            baselineSpec = line.substr(start, line.find('}', start) - start);
+        }
+
+        start = line.find("{\"name\": \"");
+
+        size_t median = line.find("\"median\": ");
+
+        if ((start != std::string::npos) && (median != std::string::npos))
+        {
+            start += 10;
+            baselineResults.push_back(DTSBenchResult());
+            baselineResults.back().name   = line.substr(start, line.find('"', start) - start);
+            baselineResults.back().median = strtod(line.c_str() + median + 10, NULL);
+        }
+
+        line.clear();
+    }
+
+    fclose(file);
+
+    if (baselineSpec.empty() || baselineResults.empty())
+    {
+        fprintf(DTSErrorFile(), "%s is not the output of bench\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+int DTSBench::compare()
+{
+    int regressions = 0;
+
+    if (baselineSpec != spec.json())
+    {
+        fprintf(DTSErrorFile(), "The baseline was measured on other files: %s\n", baselineSpec.c_str());
+        return -1;
+    }
+
+    for (size_t index = 0; index < results.size(); index++)
+    {
+        DTSBenchResult& result(results[index]);
+
+        for (size_t base = 0; base < baselineResults.size(); base++)
+        {
+            if (baselineResults[base].name == result.name)
+            {
+                result.baseline = baselineResults[base].median;
+            }
+        }
+
+        // Slower beyond the threshold, and not by chance.
+        result.regression = (result.baseline > 0.0) &&
+                            (result.median > result.baseline * (1.0 + threshold / 100.0)) &&
+                            (result.low    > result.baseline);
+
+        if (result.regression)
+        {
+            regressions++;
+        }
+    }
+
+    return regressions;
+}
+
+static void printInterval(FILE* fileOut, double median, double low, double high)
+{
+    fprintf(fileOut, "{\"median\": %.9g, \"low\": %.9g, \"high\": %.9g}", median, low, high);
+}
+
+// Throughput gained against the baseline, in percents.
+static double change(double seconds, double baseline)
+{
+    return ((seconds > 0.0) && (baseline > 0.0)) ? (baseline / seconds - 1.0) * 100.0 : 0.0;
+}
+
+void DTSBench::print(FILE* fileOut) const
+{
+    static const char* const stages[] = { "load", "triangulation", "bake", "write" };
+
+    bool   compared = !baselineResults.empty();
+    int    regressions = 0;
+    size_t index;
+
+    fprintf(fileOut, "{\"spec\": {%s},\n", spec.json().c_str());
+    fprintf(fileOut, " \"seconds\": %g, \"runs\": %d, \"warmup\": %d,\n \"benchmarks\": [", seconds, runs, warmup);
+
+    for (index = 0; index < results.size(); index++)
+    {
+        const DTSBenchResult& result(results[index]);
+
+        fprintf(fileOut, "%s\n  {\"name\": \"%s\", \"stage\": \"%s\", \"iterations\": %d, \"seconds\": ",
+                (index > 0) ? "," : "", result.name.c_str(), result.stage.c_str(), result.iterations);
+        printInterval(fileOut, result.median, result.low, result.high);
+        fprintf(fileOut, ", \"throughput\": {");
+
+        // Bounds swap, the longest time gives the lowest throughput.
+        for (size_t amount = 0; amount < result.amounts.size(); amount++)
+        {
+            double value = result.amounts[amount].value;
+
+            fprintf(fileOut, "%s\"%s/s\": ", (amount > 0) ? ", " : "", result.amounts[amount].unit.c_str());
+            printInterval(fileOut, (result.median > 0.0) ? value / result.median : 0.0,
+                                   (result.high   > 0.0) ? value / result.high   : 0.0,
+                                   (result.low    > 0.0) ? value / result.low    : 0.0);
+        }
+
+        fprintf(fileOut, "}");
+
+        if (compared && (result.baseline > 0.0))
+        {
+            fprintf(fileOut, ", \"baseline\": %.9g, \"change\": %.2f, \"regression\": %s",
+                    result.baseline, change(result.median, result.baseline), result.regression ? "true" : "false");
+        }
+
+        regressions += result.regression ? 1 : 0;
+        fprintf(fileOut, "}");
+    }
+
+    fprintf(fileOut, "\n ],\n \"stages\": {");
+
+    // Sum of the medians of the benchmarks of each stage, compared on the
+    // benchmarks the baseline has.
+    for (int stage = 0; stage < (int)(sizeof(stages) / sizeof(stages[0])); stage++)
+    {
+        double total = 0.0, measured = 0.0, baseline = 0.0;
+
+        for (index = 0; index < results.size(); index++)
+        {
+            if (results[index].stage == stages[stage])
+            {
+                total += results[index].median;
+
+                if (results[index].baseline > 0.0)
+                {
+                    measured += results[index].median;
+                    baseline += results[index].baseline;
+                }
+            }
+        }
+
+        fprintf(fileOut, "%s\n  \"%s\": {\"seconds\": %.9g", (stage > 0) ? "," : "", stages[stage], total);
+
+        if (compared && (baseline > 0.0))
+        {
+            fprintf(fileOut, ", \"baseline\": %.9g, \"change\": %.2f", baseline, change(measured, baseline));
+        }
+
+        fprintf(fileOut, "}");
+    }
+
+    fprintf(fileOut, "\n }");
+
+    if (compared)
+    {
+        fprintf(fileOut, ",\n \"threshold\": %g, \"regressions\": %d", threshold, regressions);
+    }
+
+    fprintf(fileOut, "\n}\n");
+}
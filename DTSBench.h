@@ -0,0 +1,112 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSBench_h
+#define DTSConverter_DTSBench_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "DTSSynthetic.h"
+
+class DTSOptions;
+
+// Amount of something processed by one iteration, "vertices", "bytes"...
+class DTSBenchAmount
+{
+public:
+    std::string unit;
+    double      value;
+};
+
+class DTSBenchResult
+{
+public:
+    std::string name;
+    std::string stage;      // load, triangulation, bake or write
+    int         iterations; // measured, warm-up runs excluded
+
+    // Time of one iteration in each run, their median and the 95%
+    // confidence interval of the median.
+    std::vector<double> samples;
+    double              median;
+    double              low;
+    double              high;
+
+    // Median of the baseline, 0 when the baseline does not have it.
+    double baseline;
+    bool   regression;
+
+    std::vector<DTSBenchAmount> amounts;
+};
+
+/*
+ * Micro benchmarks of the stages of a conversion (loading, normal decoding,
+ * triangulation, skinning, baking, writing) on synthetic files, see
+ * DTSSynthetic. A run measures each benchmark until it took the requested
+ * time. Warm-up runs are dropped, the others give the median time of one
+ * iteration, its confidence interval, and the throughput of what the
+ * benchmark processes.
+ *
+ * Compared to a baseline (the output of an earlier bench), a benchmark
+ * regresses when its median throughput dropped by more than the threshold
+ * and the whole confidence interval is below the baseline median.
+ */
+class DTSBench
+{
+public:
+    DTSSynthetic spec;
+    double       seconds;   // per benchmark and run
+    int          runs;
+    int          warmup;    // runs before the measured ones
+    double       threshold; // percent
+
+    std::vector<DTSBenchResult> results;
+
+    std::string                 baselineSpec;
+    std::vector<DTSBenchResult> baselineResults;
+
+public:
+    DTSBench();
+
+    // Synthetic parameter, seconds=, runs=, warmup= or threshold=value.
+    bool parse(const char* argument);
+
+    static void usage(FILE* fileOut);
+
+    // Writes the files and their outputs in directory.
+    int run(const char* directory, const DTSOptions& options);
+
+    // Reads the medians of a file written by print().
+    bool loadBaseline(const char* path);
+
+    // Returns the number of regressions, -1 when the baseline was measured
+    // on other files.
+    int compare();
+
+    void print(FILE* fileOut) const;
+};
+
+#endif
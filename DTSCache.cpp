@@ -0,0 +1,1234 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <errno.h>
+#include <ctype.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSOptions.h"
+#include "DTSCache.h"
+#include "DTSTrace.h"
+#include "DTSThreads.h"
+
+// Bumped when a change of the converter changes its outputs.
+#define DTS_CACHE_VERSION 1
+
+// DTS2FBX.cpp
+std::string fbxWriterName(const DTSOptions& options);
+
+#ifdef WIN32
+#define PATHSEP "\\"
+#else
+#define PATHSEP "/"
+#endif
+
+unsigned long long DTSHash(const void* data, size_t size, unsigned long long seed)
+{
+    const unsigned long long prime = 0x100000001b3ULL;
+    const unsigned char*     bytes = (const unsigned char*)data;
+    unsigned long long       hash  = (seed ^ 0xcbf29ce484222325ULL) + size;
+    unsigned long long       word;
+
+    for (; size >= 8; bytes += 8, size -= 8)
+    {
+        memcpy(&word, bytes, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+
+    for (; size > 0; bytes++, size--)
+    {
+        hash = (hash ^ *bytes) * prime;
+    }
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+bool DTSSaveFile(const char* path, const void* data, size_t size)
+{
+    char        suffix[64];
+    int         marker;
+    std::string temporary(path);
+
+    // Unique between processes and between threads of one process.
+#ifndef WIN32
+    snprintf(suffix, sizeof(suffix), ".%d.%p.tmp", (int)getpid(), (const void*)&marker);
+#else
+    snprintf(suffix, sizeof(suffix), ".%p.tmp", (const void*)&marker);
+#endif
+    temporary += suffix;
+
+    FILE* f = fopen(temporary.c_str(), "wb");
+
+    if (f == NULL)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", temporary.c_str(), strerror(errno));
+        return false;
+    }
+
+    size_t written = size ? fwrite(data, 1, size, f) : 0;
+
+    if ((fclose(f) != 0) || (written != size))
+    {
+        fprintf(DTSErrorFile(), "Failed to produce %s\n", path);
+        remove(temporary.c_str());
+        return false;
+    }
+
+#ifdef WIN32
+    remove(path);
+#endif
+
+    if (rename(temporary.c_str(), path) != 0)
+    {
+        fprintf(DTSErrorFile(), "Failed to produce %s: %s\n", path, strerror(errno));
+        remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+DTSMappedFile::DTSMappedFile() :
+    mapping(NULL),
+    data   (NULL),
+    size   (0)
+{
+}
+
+DTSMappedFile::~DTSMappedFile()
+{
+    close();
+}
+
+void DTSMappedFile::close()
+{
+#ifndef WIN32
+    if (mapping)
+    {
+        munmap(mapping, size);
+    }
+#endif
+
+    storage.clear();
+    mapping = NULL;
+    data    = NULL;
+    size    = 0;
+}
+
+bool DTSMappedFile::load(const char* path)
+{
+    close();
+
+#ifndef WIN32
+    int         fd = ::open(path, O_RDONLY);
+    struct stat s;
+
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    if (fstat(fd, &s) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+
+    // Empty files can't be mapped.
+    if (s.st_size == 0)
+    {
+        ::close(fd);
+        data = "";
+        return true;
+    }
+
+    void* mapped = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    ::close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+
+    mapping = mapped;
+    data    = (const char*)mapped;
+    size    = s.st_size;
+    return true;
+#else
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL)
+    {
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    storage.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+
+    size_t readed = storage.empty() ? 0 : fread(&storage[0], 1, storage.size(), f);
+
+    fclose(f);
+
+    if (readed != storage.size())
+    {
+        storage.clear();
+        return false;
+    }
+
+    data = storage.empty() ? "" : &storage[0];
+    size = storage.size();
+    return true;
+#endif
+}
+
+/*
+ * DTSShapeImageWriter
+ */
+
+DTSImageArray DTSShapeImageWriter::append(const void* data, size_t elementSize, size_t count)
+{
+    DTSImageArray value;
+    size_t        offset = (buffer.size() + 15) & ~(size_t)15;
+
+    buffer.resize(offset + elementSize * count);
+
+    if (count)
+    {
+        memcpy(&buffer[offset], data, elementSize * count);
+    }
+
+    value.offset = (unsigned int)offset;
+    value.count  = (unsigned int)count;
+    return value;
+}
+
+DTSImageArray DTSShapeImageWriter::append(const std::string& value)
+{
+    DTSImageArray result = append(value.c_str(), 1, value.size() + 1);
+
+    result.count--;
+    return result;
+}
+
+DTSImageArray DTSShapeImageWriter::append(const std::vector<bool>& value)
+{
+    std::vector<unsigned char> bytes(value.begin(), value.end());
+
+    return append(bytes);
+}
+
+bool DTSShapeImageWriter::convert(const DTSShape& shape, bool sequenceFile, unsigned long long sourceHash, unsigned long long sourceSize)
+{
+    DTSImageHeader header;
+    int            index;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DTS_IMAGE_MAGIC, 4);
+    header.version      = DTS_IMAGE_VERSION;
+    header.sequenceFile = sequenceFile ? 1 : 0;
+    header.sourceHash   = sourceHash;
+    header.sourceSize   = sourceSize;
+    header.dtsVersion   = shape.dtsVersion;
+
+    const int counts[DTSImageHeader::NumCounts] =
+    {
+        shape.numNodes,         shape.numObjects,           shape.numDecals,
+        shape.numSubshapes,     shape.numIFLmaterials,      shape.numNodeRotations,
+        shape.numNodeTranslations, shape.numNodeScalesUniform, shape.numNodeScalesAligned,
+        shape.numNodeScalesArbitrary, shape.numGroundFrames, shape.numObjectStates,
+        shape.numDecalStates,   shape.numTriggers,          shape.numDetailLevels,
+        shape.numMeshes,        shape.numSkins,             shape.numNames
+    };
+
+    memcpy(header.counts, counts, sizeof(counts));
+    header.smallestSize        = shape.smallestSize;
+    header.smallestDetailLevel = shape.smallestDetailLevel;
+    header.radius              = shape.radius;
+    header.tubeRadius          = shape.tubeRadius;
+    header.center              = shape.center;
+    header.bounds              = shape.bounds;
+
+    header.materialListVersion     = shape.materialListVersion;
+    header.numExportedObjects      = shape.numExportedObjects;
+    header.numExportedObjectStates = shape.numExportedObjectStates;
+
+    buffer.clear();
+    buffer.resize(sizeof(header));
+
+    DTSImageArray* arrays = header.arrays;
+
+    arrays[DTSImageHeader::A_Nodes]                  = append(shape.nodes);
+    arrays[DTSImageHeader::A_Objects]                = append(shape.objects);
+    arrays[DTSImageHeader::A_Decals]                 = append(shape.decals);
+    arrays[DTSImageHeader::A_IFLMaterials]           = append(shape.IFLmaterials);
+    arrays[DTSImageHeader::A_Subshapes]              = append(shape.subshapes);
+    arrays[DTSImageHeader::A_NodeDefRotations]       = append(shape.nodeDefRotations);
+    arrays[DTSImageHeader::A_NodeDefTranslations]    = append(shape.nodeDefTranslations);
+    arrays[DTSImageHeader::A_NodeRotations]          = append(shape.nodeRotations);
+    arrays[DTSImageHeader::A_NodeTranslations]       = append(shape.nodeTranslations);
+    arrays[DTSImageHeader::A_NodeScalesUniform]      = append(shape.nodeScalesUniform);
+    arrays[DTSImageHeader::A_NodeScalesAligned]      = append(shape.nodeScalesAligned);
+    arrays[DTSImageHeader::A_NodeScalesArbitrary]    = append(shape.nodeScalesArbitrary);
+    arrays[DTSImageHeader::A_NodeScaleRotsArbitrary] = append(shape.nodeScaleRotsArbitrary);
+    arrays[DTSImageHeader::A_GroundRotations]        = append(shape.groundRotations);
+    arrays[DTSImageHeader::A_GroundTranslations]     = append(shape.groundTranslations);
+    arrays[DTSImageHeader::A_ObjectStates]           = append(shape.objectStates);
+    arrays[DTSImageHeader::A_DecalStates]            = append(shape.decalStates);
+    arrays[DTSImageHeader::A_DetailLevels]           = append(shape.detailLevels);
+    arrays[DTSImageHeader::A_Triggers]               = append(shape.triggers);
+    arrays[DTSImageHeader::A_Parents]                = append(shape.hierarchy.parents);
+    arrays[DTSImageHeader::A_Depths]                 = append(shape.hierarchy.depths);
+    arrays[DTSImageHeader::A_Preorder]               = append(shape.hierarchy.preorder);
+    arrays[DTSImageHeader::A_PreorderIndex]          = append(shape.hierarchy.preorderIndex);
+    arrays[DTSImageHeader::A_SubtreeEnds]            = append(shape.hierarchy.subtreeEnds);
+    arrays[DTSImageHeader::A_BreadthFirst]           = append(shape.hierarchy.breadthFirst);
+    arrays[DTSImageHeader::A_BreadthFirstIndex]      = append(shape.hierarchy.breadthFirstIndex);
+    arrays[DTSImageHeader::A_MeshIndexList]          = append(shape.meshIndexList);
+
+    // Records go in after the arrays they point to.
+    std::vector<DTSImageMesh> meshes(shape.meshes.size());
+
+    for (index = 0; index < (int)meshes.size(); index++)
+    {
+        const DTSMesh& mesh  = shape.meshes[index];
+        DTSImageMesh&  image = meshes[index];
+
+        memset(&image, 0, sizeof(image));
+        image.type = mesh.type;
+
+        // Only the type of null meshes is read.
+        if (mesh.type == DTSMesh::T_Null)
+        {
+            continue;
+        }
+
+        image.numFrames     = mesh.numFrames;
+        image.matFrames     = mesh.matFrames;
+        image.parent        = mesh.parent;
+        image.bounds        = mesh.bounds;
+        image.center        = mesh.center;
+        image.radius        = mesh.radius;
+        image.vertsPerFrame = mesh.vertsPerFrame;
+        image.flags         = mesh.flags;
+
+        image.baseVertsDiffer  = (mesh.type == DTSMesh::T_Skin)   ? mesh.baseVertsDiffer  : 0;
+        image.alwaysWriteDepth = (mesh.type == DTSMesh::T_Sorted) ? mesh.alwaysWriteDepth : 0;
+
+        image.arrays[DTSImageMesh::M_Verts]         = append(mesh.verts);
+        image.arrays[DTSImageMesh::M_TVerts]        = append(mesh.tverts);
+        image.arrays[DTSImageMesh::M_Normals]       = append(mesh.normals);
+        image.arrays[DTSImageMesh::M_ENormals]      = append(mesh.enormals);
+        image.arrays[DTSImageMesh::M_Primitives]    = append(mesh.primitives);
+        image.arrays[DTSImageMesh::M_Indices]       = append(mesh.indices);
+        image.arrays[DTSImageMesh::M_MIndices]      = append(mesh.mindices);
+        image.arrays[DTSImageMesh::M_VIndex]        = append(mesh.vindex);
+        image.arrays[DTSImageMesh::M_VBone]         = append(mesh.vbone);
+        image.arrays[DTSImageMesh::M_VWeight]       = append(mesh.vweight);
+        image.arrays[DTSImageMesh::M_NodeIndex]     = append(mesh.nodeIndex);
+        image.arrays[DTSImageMesh::M_NodeTransform] = append(mesh.nodeTransform);
+        image.arrays[DTSImageMesh::M_Clusters]      = append(mesh.clusters);
+        image.arrays[DTSImageMesh::M_StartCluster]  = append(mesh.startCluster);
+        image.arrays[DTSImageMesh::M_FirstVerts]    = append(mesh.firstVerts);
+        image.arrays[DTSImageMesh::M_NumVerts]      = append(mesh.numVerts);
+        image.arrays[DTSImageMesh::M_FirstTVerts]   = append(mesh.firstTVerts);
+        image.arrays[DTSImageMesh::M_BaseVerts]     = append(mesh.baseVerts);
+        image.arrays[DTSImageMesh::M_BaseNormals]   = append(mesh.baseNormals);
+        image.arrays[DTSImageMesh::M_BaseENormals]  = append(mesh.baseEnormals);
+    }
+
+    arrays[DTSImageHeader::A_Meshes] = append(meshes);
+
+    std::vector<DTSImageSequence> sequences(shape.sequences.size());
+
+    for (index = 0; index < (int)sequences.size(); index++)
+    {
+        const DTSSequence& sequence = shape.sequences[index];
+        DTSImageSequence&  image    = sequences[index];
+
+        memset(&image, 0, sizeof(image));
+        image.name             = append(sequence.name);
+        image.nameIndex        = sequence.nameIndex;
+        image.flags            = sequence.flags;
+        image.numKeyFrames     = sequence.numKeyFrames;
+        image.duration         = sequence.duration;
+        image.priority         = sequence.priority;
+        image.firstGroundFrame = sequence.firstGroundFrame;
+        image.numGroundFrames  = sequence.numGroundFrames;
+        image.baseRotation     = sequence.baseRotation;
+        image.baseTranslation  = sequence.baseTranslation;
+        image.baseScale        = sequence.baseScale;
+        image.baseObjectState  = sequence.baseObjectState;
+        image.baseDecalState   = sequence.baseDecalState;
+        image.firstTrigger     = sequence.firstTrigger;
+        image.numTriggers      = sequence.numTriggers;
+        image.toolBegin        = sequence.toolBegin;
+
+        image.matters[DTSImageSequence::S_Rotation]    = append(sequence.matters.rotation);
+        image.matters[DTSImageSequence::S_Translation] = append(sequence.matters.translation);
+        image.matters[DTSImageSequence::S_Scale]       = append(sequence.matters.scale);
+        image.matters[DTSImageSequence::S_Decal]       = append(sequence.matters.decal);
+        image.matters[DTSImageSequence::S_IFL]         = append(sequence.matters.ifl);
+        image.matters[DTSImageSequence::S_Vis]         = append(sequence.matters.vis);
+        image.matters[DTSImageSequence::S_Frame]       = append(sequence.matters.frame);
+        image.matters[DTSImageSequence::S_MatFrame]    = append(sequence.matters.matframe);
+    }
+
+    arrays[DTSImageHeader::A_Sequences] = append(sequences);
+
+    std::vector<DTSImageMaterial> materials(shape.materials.size());
+
+    for (index = 0; index < (int)materials.size(); index++)
+    {
+        const DTSMaterial& material = shape.materials[index];
+        DTSImageMaterial&  image    = materials[index];
+
+        image.name        = append(material.name);
+        image.flags       = material.flags;
+        image.reflectance = material.reflectance;
+        image.bump        = material.bump;
+        image.detail      = material.detail;
+        image.detailScale = material.detailScale;
+        image.reflection  = material.reflection;
+    }
+
+    arrays[DTSImageHeader::A_Materials] = append(materials);
+
+    std::vector<DTSImageArray> names(shape.names.size());
+
+    for (index = 0; index < (int)names.size(); index++)
+    {
+        names[index] = append(shape.names[index]);
+    }
+
+    arrays[DTSImageHeader::A_Names] = append(names);
+
+    if (buffer.size() > 0xffffffffUL)
+    {
+        buffer.clear();
+        return false;
+    }
+
+    header.size = (unsigned int)buffer.size();
+    memcpy(&buffer[0], &header, sizeof(header));
+    return true;
+}
+
+bool DTSShapeImageWriter::save(const char* imageFile) const
+{
+    return DTSSaveFile(imageFile, buffer.empty() ? NULL : &buffer[0], buffer.size());
+}
+
+/*
+ * DTSShapeImage
+ */
+
+static size_t imageElementSize(int which)
+{
+    switch (which)
+    {
+        case DTSImageHeader::A_Nodes:                  return sizeof(DTSNode);
+        case DTSImageHeader::A_Objects:                return sizeof(DTSObject);
+        case DTSImageHeader::A_Decals:                 return sizeof(DTSDecal);
+        case DTSImageHeader::A_IFLMaterials:           return sizeof(DTSIFLMaterial);
+        case DTSImageHeader::A_Subshapes:              return sizeof(DTSSubshape);
+        case DTSImageHeader::A_NodeDefRotations:       return sizeof(Quaternion);
+        case DTSImageHeader::A_NodeDefTranslations:    return sizeof(Point);
+        case DTSImageHeader::A_NodeRotations:          return sizeof(Quaternion);
+        case DTSImageHeader::A_NodeTranslations:       return sizeof(Point);
+        case DTSImageHeader::A_NodeScalesUniform:      return sizeof(float);
+        case DTSImageHeader::A_NodeScalesAligned:      return sizeof(Point);
+        case DTSImageHeader::A_NodeScalesArbitrary:    return sizeof(Point);
+        case DTSImageHeader::A_NodeScaleRotsArbitrary: return sizeof(Quaternion);
+        case DTSImageHeader::A_GroundRotations:        return sizeof(Quaternion);
+        case DTSImageHeader::A_GroundTranslations:     return sizeof(Point);
+        case DTSImageHeader::A_ObjectStates:           return sizeof(DTSObjectState);
+        case DTSImageHeader::A_DecalStates:            return sizeof(DTSDecalState);
+        case DTSImageHeader::A_DetailLevels:           return sizeof(DTSDetailLevel);
+        case DTSImageHeader::A_Triggers:               return sizeof(DTSTrigger);
+        case DTSImageHeader::A_Meshes:                 return sizeof(DTSImageMesh);
+        case DTSImageHeader::A_Sequences:              return sizeof(DTSImageSequence);
+        case DTSImageHeader::A_Materials:              return sizeof(DTSImageMaterial);
+        case DTSImageHeader::A_Names:                  return sizeof(DTSImageArray);
+        default:                                       return sizeof(int);
+    }
+}
+
+DTSShapeImage::DTSShapeImage() :
+    data(NULL),
+    size(0)
+{
+}
+
+void DTSShapeImage::close()
+{
+    file.close();
+    data = NULL;
+    size = 0;
+}
+
+bool DTSShapeImage::load(const char* imageFile)
+{
+    close();
+
+    if (!file.load(imageFile))
+    {
+        return false;
+    }
+
+    if (!open(file.data, file.size))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool DTSShapeImage::open(const void* imageData, size_t imageSize)
+{
+    const DTSImageHeader* h = (const DTSImageHeader*)imageData;
+
+    if ((imageData == NULL) || (imageSize < sizeof(DTSImageHeader)) ||
+        (memcmp(h->magic, DTS_IMAGE_MAGIC, 4) != 0) ||
+        (h->version != DTS_IMAGE_VERSION) ||
+        (h->size    != imageSize))
+    {
+        return false;
+    }
+
+    data = (const char*)imageData;
+    size = imageSize;
+
+    for (int which = 0; which < DTSImageHeader::A_Count; which++)
+    {
+        if (!valid(h->arrays[which], imageElementSize(which)))
+        {
+            data = NULL;
+            size = 0;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool DTSShapeImage::valid(const DTSImageArray& value, size_t elementSize) const
+{
+    return ((value.offset & 3) == 0) &&
+           (value.offset <= size) &&
+           (value.count  <= (size - value.offset) / elementSize);
+}
+
+const char* DTSShapeImage::name(int index) const
+{
+    return data + array<DTSImageArray>(header().arrays[DTSImageHeader::A_Names])[index].offset;
+}
+
+bool DTSShapeImage::copy(const DTSImageArray& value, std::string& out) const
+{
+    if (!valid(value, 1))
+    {
+        return false;
+    }
+
+    out.assign(data + value.offset, value.count);
+    return true;
+}
+
+bool DTSShapeImage::copy(const DTSImageArray& value, std::vector<bool>& out) const
+{
+    if (!valid(value, 1))
+    {
+        return false;
+    }
+
+    const unsigned char* first = array<unsigned char>(value);
+
+    out.assign(first, first + value.count);
+    return true;
+}
+
+bool DTSShapeImage::shape(DTSShape& shape) const
+{
+    const DTSImageHeader& h      = header();
+    const DTSImageArray*  arrays = h.arrays;
+    int                   index, count;
+
+    int* counts[DTSImageHeader::NumCounts] =
+    {
+        &shape.numNodes,         &shape.numObjects,           &shape.numDecals,
+        &shape.numSubshapes,     &shape.numIFLmaterials,      &shape.numNodeRotations,
+        &shape.numNodeTranslations, &shape.numNodeScalesUniform, &shape.numNodeScalesAligned,
+        &shape.numNodeScalesArbitrary, &shape.numGroundFrames, &shape.numObjectStates,
+        &shape.numDecalStates,   &shape.numTriggers,          &shape.numDetailLevels,
+        &shape.numMeshes,        &shape.numSkins,             &shape.numNames
+    };
+
+    for (index = 0; index < DTSImageHeader::NumCounts; index++)
+    {
+        *counts[index] = h.counts[index];
+    }
+
+    shape.dtsVersion          = h.dtsVersion;
+    shape.smallestSize        = h.smallestSize;
+    shape.smallestDetailLevel = h.smallestDetailLevel;
+    shape.radius              = h.radius;
+    shape.tubeRadius          = h.tubeRadius;
+    shape.center              = h.center;
+    shape.bounds              = h.bounds;
+
+    shape.materialListVersion     = h.materialListVersion;
+    shape.numExportedObjects      = h.numExportedObjects;
+    shape.numExportedObjectStates = h.numExportedObjectStates;
+
+    // Top level arrays were checked by open().
+    copy(arrays[DTSImageHeader::A_Nodes],                  shape.nodes);
+    copy(arrays[DTSImageHeader::A_Objects],                shape.objects);
+    copy(arrays[DTSImageHeader::A_Decals],                 shape.decals);
+    copy(arrays[DTSImageHeader::A_IFLMaterials],           shape.IFLmaterials);
+    copy(arrays[DTSImageHeader::A_Subshapes],              shape.subshapes);
+    copy(arrays[DTSImageHeader::A_NodeDefRotations],       shape.nodeDefRotations);
+    copy(arrays[DTSImageHeader::A_NodeDefTranslations],    shape.nodeDefTranslations);
+    copy(arrays[DTSImageHeader::A_NodeRotations],          shape.nodeRotations);
+    copy(arrays[DTSImageHeader::A_NodeTranslations],       shape.nodeTranslations);
+    copy(arrays[DTSImageHeader::A_NodeScalesUniform],      shape.nodeScalesUniform);
+    copy(arrays[DTSImageHeader::A_NodeScalesAligned],      shape.nodeScalesAligned);
+    copy(arrays[DTSImageHeader::A_NodeScalesArbitrary],    shape.nodeScalesArbitrary);
+    copy(arrays[DTSImageHeader::A_NodeScaleRotsArbitrary], shape.nodeScaleRotsArbitrary);
+    copy(arrays[DTSImageHeader::A_GroundRotations],        shape.groundRotations);
+    copy(arrays[DTSImageHeader::A_GroundTranslations],     shape.groundTranslations);
+    copy(arrays[DTSImageHeader::A_ObjectStates],           shape.objectStates);
+    copy(arrays[DTSImageHeader::A_DecalStates],            shape.decalStates);
+    copy(arrays[DTSImageHeader::A_DetailLevels],           shape.detailLevels);
+    copy(arrays[DTSImageHeader::A_Triggers],               shape.triggers);
+    copy(arrays[DTSImageHeader::A_Parents],                shape.hierarchy.parents);
+    copy(arrays[DTSImageHeader::A_Depths],                 shape.hierarchy.depths);
+    copy(arrays[DTSImageHeader::A_Preorder],               shape.hierarchy.preorder);
+    copy(arrays[DTSImageHeader::A_PreorderIndex],          shape.hierarchy.preorderIndex);
+    copy(arrays[DTSImageHeader::A_SubtreeEnds],            shape.hierarchy.subtreeEnds);
+    copy(arrays[DTSImageHeader::A_BreadthFirst],           shape.hierarchy.breadthFirst);
+    copy(arrays[DTSImageHeader::A_BreadthFirstIndex],      shape.hierarchy.breadthFirstIndex);
+    copy(arrays[DTSImageHeader::A_MeshIndexList],          shape.meshIndexList);
+
+    const DTSImageMesh* meshes = array<DTSImageMesh>(DTSImageHeader::A_Meshes, count);
+
+    shape.meshes.clear();
+    shape.meshes.resize(count);
+
+    for (index = 0; index < count; index++)
+    {
+        const DTSImageMesh&  image  = meshes[index];
+        const DTSImageArray* marray = image.arrays;
+        DTSMesh&             mesh   = shape.meshes[index];
+
+        mesh.type = image.type;
+
+        if (mesh.type == DTSMesh::T_Null)
+        {
+            continue;
+        }
+
+        mesh.numFrames     = image.numFrames;
+        mesh.matFrames     = image.matFrames;
+        mesh.parent        = image.parent;
+        mesh.bounds        = image.bounds;
+        mesh.center        = image.center;
+        mesh.radius        = image.radius;
+        mesh.vertsPerFrame = image.vertsPerFrame;
+        mesh.flags         = image.flags;
+
+        mesh.baseVertsDiffer  = (image.baseVertsDiffer != 0);
+        mesh.alwaysWriteDepth = image.alwaysWriteDepth;
+
+        if (!copy(marray[DTSImageMesh::M_Verts],         mesh.verts)         ||
+            !copy(marray[DTSImageMesh::M_TVerts],        mesh.tverts)        ||
+            !copy(marray[DTSImageMesh::M_Normals],       mesh.normals)       ||
+            !copy(marray[DTSImageMesh::M_ENormals],      mesh.enormals)      ||
+            !copy(marray[DTSImageMesh::M_Primitives],    mesh.primitives)    ||
+            !copy(marray[DTSImageMesh::M_Indices],       mesh.indices)       ||
+            !copy(marray[DTSImageMesh::M_MIndices],      mesh.mindices)      ||
+            !copy(marray[DTSImageMesh::M_VIndex],        mesh.vindex)        ||
+            !copy(marray[DTSImageMesh::M_VBone],         mesh.vbone)         ||
+            !copy(marray[DTSImageMesh::M_VWeight],       mesh.vweight)       ||
+            !copy(marray[DTSImageMesh::M_NodeIndex],     mesh.nodeIndex)     ||
+            !copy(marray[DTSImageMesh::M_NodeTransform], mesh.nodeTransform) ||
+            !copy(marray[DTSImageMesh::M_Clusters],      mesh.clusters)      ||
+            !copy(marray[DTSImageMesh::M_StartCluster],  mesh.startCluster)  ||
+            !copy(marray[DTSImageMesh::M_FirstVerts],    mesh.firstVerts)    ||
+            !copy(marray[DTSImageMesh::M_NumVerts],      mesh.numVerts)      ||
+            !copy(marray[DTSImageMesh::M_FirstTVerts],   mesh.firstTVerts)   ||
+            !copy(marray[DTSImageMesh::M_BaseVerts],     mesh.baseVerts)     ||
+            !copy(marray[DTSImageMesh::M_BaseNormals],   mesh.baseNormals)   ||
+            !copy(marray[DTSImageMesh::M_BaseENormals],  mesh.baseEnormals))
+        {
+            return false;
+        }
+    }
+
+    const DTSImageSequence* sequences = array<DTSImageSequence>(DTSImageHeader::A_Sequences, count);
+
+    shape.sequences.clear();
+    shape.sequences.resize(count);
+
+    for (index = 0; index < count; index++)
+    {
+        const DTSImageSequence& image    = sequences[index];
+        DTSSequence&            sequence = shape.sequences[index];
+
+        sequence.nameIndex        = image.nameIndex;
+        sequence.flags            = image.flags;
+        sequence.numKeyFrames     = image.numKeyFrames;
+        sequence.duration         = image.duration;
+        sequence.priority         = image.priority;
+        sequence.firstGroundFrame = image.firstGroundFrame;
+        sequence.numGroundFrames  = image.numGroundFrames;
+        sequence.baseRotation     = image.baseRotation;
+        sequence.baseTranslation  = image.baseTranslation;
+        sequence.baseScale        = image.baseScale;
+        sequence.baseObjectState  = image.baseObjectState;
+        sequence.baseDecalState   = image.baseDecalState;
+        sequence.firstTrigger     = image.firstTrigger;
+        sequence.numTriggers      = image.numTriggers;
+        sequence.toolBegin        = image.toolBegin;
+
+        if (!copy(image.name, sequence.name) ||
+            !copy(image.matters[DTSImageSequence::S_Rotation],    sequence.matters.rotation)    ||
+            !copy(image.matters[DTSImageSequence::S_Translation], sequence.matters.translation) ||
+            !copy(image.matters[DTSImageSequence::S_Scale],       sequence.matters.scale)       ||
+            !copy(image.matters[DTSImageSequence::S_Decal],       sequence.matters.decal)       ||
+            !copy(image.matters[DTSImageSequence::S_IFL],         sequence.matters.ifl)         ||
+            !copy(image.matters[DTSImageSequence::S_Vis],         sequence.matters.vis)         ||
+            !copy(image.matters[DTSImageSequence::S_Frame],       sequence.matters.frame)       ||
+            !copy(image.matters[DTSImageSequence::S_MatFrame],    sequence.matters.matframe))
+        {
+            return false;
+        }
+    }
+
+    const DTSImageMaterial* materials = array<DTSImageMaterial>(DTSImageHeader::A_Materials, count);
+
+    shape.materials.resize(count);
+
+    for (index = 0; index < count; index++)
+    {
+        const DTSImageMaterial& image    = materials[index];
+        DTSMaterial&            material = shape.materials[index];
+
+        material.flags       = image.flags;
+        material.reflectance = image.reflectance;
+        material.bump        = image.bump;
+        material.detail      = image.detail;
+        material.detailScale = image.detailScale;
+        material.reflection  = image.reflection;
+
+        if (!copy(image.name, material.name))
+        {
+            return false;
+        }
+    }
+
+    const DTSImageArray* names = array<DTSImageArray>(DTSImageHeader::A_Names, count);
+
+    shape.names.resize(count);
+
+    for (index = 0; index < count; index++)
+    {
+        if (!copy(names[index], shape.names[index]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool loadSource(const char* path, bool sequenceFile, const DTSShape* baseShape, DTSShape& shape)
+{
+    FILE* f = fopen(path, "rb");
+
+    if (f == NULL)
+    {
+        return false;
+    }
+
+    if (sequenceFile)
+    {
+        shape.loadSequenceFile(f, baseShape);
+    }
+    else
+    {
+        shape.loadShapeFile(f);
+    }
+
+    fclose(f);
+    return true;
+}
+
+/*
+ * DTSShapeMemoryCache
+ */
+
+class DTSShapeMemoryEntry
+{
+public:
+    unsigned long long hash;
+    unsigned long long size;
+    bool               sequenceFile;
+    unsigned long long lastUse;
+    DTSShape           shape;
+};
+
+static std::vector<DTSShapeMemoryEntry> memoryEntries;
+static int                              memoryCapacity = 0;
+static unsigned long long               memoryClock    = 0;
+
+#ifndef WIN32
+static pthread_mutex_t memoryMutex = PTHREAD_MUTEX_INITIALIZER;
+#define DTS_MEMORY_LOCK()   pthread_mutex_lock  (&memoryMutex)
+#define DTS_MEMORY_UNLOCK() pthread_mutex_unlock(&memoryMutex)
+#else
+#define DTS_MEMORY_LOCK()
+#define DTS_MEMORY_UNLOCK()
+#endif
+
+void DTSShapeMemoryCache::enable(int capacity)
+{
+    DTS_MEMORY_LOCK();
+    memoryCapacity = capacity;
+    DTS_MEMORY_UNLOCK();
+}
+
+bool DTSShapeMemoryCache::enabled()
+{
+    return memoryCapacity > 0;
+}
+
+bool DTSShapeMemoryCache::find(unsigned long long hash, unsigned long long size, bool sequenceFile, DTSShape& shape)
+{
+    bool found = false;
+
+    DTS_MEMORY_LOCK();
+
+    std::vector<DTSShapeMemoryEntry>::iterator it, end(memoryEntries.end());
+
+    for (it = memoryEntries.begin(); it != end; ++it)
+    {
+        if (((*it).hash == hash) && ((*it).size == size) && ((*it).sequenceFile == sequenceFile))
+        {
+            (*it).lastUse = ++memoryClock;
+            shape         = (*it).shape;
+            found         = true;
+            break;
+        }
+    }
+
+    DTS_MEMORY_UNLOCK();
+    return found;
+}
+
+void DTSShapeMemoryCache::insert(unsigned long long hash, unsigned long long size, bool sequenceFile, const DTSShape& shape)
+{
+    DTS_MEMORY_LOCK();
+
+    if ((int)memoryEntries.size() >= memoryCapacity)
+    {
+        std::vector<DTSShapeMemoryEntry>::iterator it, oldest(memoryEntries.begin()), end(memoryEntries.end());
+
+        for (it = memoryEntries.begin(); it != end; ++it)
+        {
+            oldest = ((*it).lastUse < (*oldest).lastUse) ? it : oldest;
+        }
+
+        if (oldest != end)
+        {
+            memoryEntries.erase(oldest);
+        }
+    }
+
+    if (memoryCapacity > 0)
+    {
+        memoryEntries.push_back(DTSShapeMemoryEntry());
+        memoryEntries.back().hash         = hash;
+        memoryEntries.back().size         = size;
+        memoryEntries.back().sequenceFile = sequenceFile;
+        memoryEntries.back().lastUse      = ++memoryClock;
+        memoryEntries.back().shape        = shape;
+    }
+
+    DTS_MEMORY_UNLOCK();
+}
+
+bool DTSLoadShape(const char* path, bool sequenceFile, const DTSShape* baseShape, const std::string& cacheDirectory, DTSShape& shape)
+{
+    DTSTraceScope trace("load", path);
+    bool          memory = DTSShapeMemoryCache::enabled();
+
+    if (cacheDirectory.empty() && !memory)
+    {
+        return loadSource(path, sequenceFile, baseShape, shape);
+    }
+
+    DTSMappedFile source;
+
+    if (!source.load(path))
+    {
+        return false;
+    }
+
+    unsigned long long hash       = DTSHash(source.data, source.size);
+    unsigned long long sourceSize = source.size;
+    char               name[32];
+
+    source.close();
+
+    if (memory && DTSShapeMemoryCache::find(hash, sourceSize, sequenceFile, shape))
+    {
+        return true;
+    }
+
+    snprintf(name, sizeof(name), "%016llx.dtsi", hash);
+
+    std::string imageFile(cacheDirectory);
+
+    imageFile += PATHSEP;
+    imageFile += name;
+
+    if (!cacheDirectory.empty())
+    {
+        DTSShapeImage image;
+
+        if (image.load(imageFile.c_str()) &&
+            (image.header().sourceHash   == hash) &&
+            (image.header().sourceSize   == sourceSize) &&
+            (image.header().sequenceFile == (sequenceFile ? 1 : 0)) &&
+            image.shape(shape))
+        {
+            if (memory)
+            {
+                DTSShapeMemoryCache::insert(hash, sourceSize, sequenceFile, shape);
+            }
+
+            return true;
+        }
+    }
+
+    shape = DTSShape();
+
+    if (!loadSource(path, sequenceFile, baseShape, shape))
+    {
+        return false;
+    }
+
+    if (memory)
+    {
+        DTSShapeMemoryCache::insert(hash, sourceSize, sequenceFile, shape);
+    }
+
+    if (cacheDirectory.empty())
+    {
+        return true;
+    }
+
+#ifndef WIN32
+    mkdir(cacheDirectory.c_str(), 0777);
+#endif
+
+    DTSShapeImageWriter writer;
+
+    if (!writer.convert(shape, sequenceFile, hash, sourceSize) || !writer.save(imageFile.c_str()))
+    {
+        fprintf(DTSErrorFile(), "Warning: %s not cached\n", path);
+    }
+
+    return true;
+}
+
+/*
+ * DTSConversionCache
+ */
+
+static std::string hexKey(unsigned long long key)
+{
+    char text[32];
+
+    snprintf(text, sizeof(text), "%016llx", key);
+    return text;
+}
+
+DTSConversionCache::DTSConversionCache(const std::string& cacheDirectory) :
+    directory(cacheDirectory),
+    sourceKey(0),
+    hits     (0),
+    misses   (0)
+{
+}
+
+bool DTSConversionCache::hashSources(const char* shapeFile, const std::vector<std::string>& sequenceFiles, const DTSOptions& options)
+{
+    DTSMappedFile file;
+    char          settings[256];
+
+    snprintf(settings, sizeof(settings), "%d %s %d %d %d %d", DTS_CACHE_VERSION, fbxWriterName(options).c_str(),
+             options.fbxVersion, options.maxInfluences, options.weightBits, options.quantize);
+
+    sourceKey = DTSHash(settings, strlen(settings));
+
+    for (size_t index = 0; index <= sequenceFiles.size(); index++)
+    {
+        const char* path = (index == 0) ? shapeFile : sequenceFiles[index - 1].c_str();
+
+        if (!file.load(path))
+        {
+            directory.clear();
+            return false;
+        }
+
+        sourceKey = DTSHash(file.data, file.size, sourceKey);
+    }
+
+    return true;
+}
+
+bool DTSConversionCache::cacheable(const std::string& path)
+{
+    size_t dot = path.rfind('.');
+
+    return (dot == std::string::npos) || (strcasecmp(path.c_str() + dot, ".clip") != 0);
+}
+
+bool DTSConversionCache::outputKey(const DTSResolver& resolver, const std::string& path, std::string& namesFile, std::string& outputFile) const
+{
+    std::string extension;
+    size_t      dot = path.rfind('.');
+
+    if (dot != std::string::npos)
+    {
+        for (size_t index = dot; index < path.size(); index++)
+        {
+            extension += (char)tolower(path[index]);
+        }
+    }
+
+    unsigned long long key = DTSHash(extension.data(), extension.size(), sourceKey);
+
+    namesFile = directory + PATHSEP + hexKey(sourceKey) + ".names";
+
+    DTSMappedFile names;
+
+    if (!names.load(namesFile.c_str()))
+    {
+        return false;
+    }
+
+    const char*        line     = names.data;
+    const char*        end      = names.data + names.size;
+    unsigned long long textures = 0;
+
+    while (line < end)
+    {
+        const char* next = (const char*)memchr(line, '\n', end - line);
+
+        next = next ? next : end;
+
+        std::string resolved = resolver.resolve(std::string(line, next - line));
+
+        textures = DTSHash(resolved.c_str(), resolved.size() + 1, textures);
+        line     = next + 1;
+    }
+
+    outputFile = directory + PATHSEP + hexKey(key) + "-" + hexKey(textures) + ".out";
+    return true;
+}
+
+bool DTSConversionCache::fetch(const DTSResolver& resolver, const std::string& path)
+{
+    std::string   namesFile, outputFile;
+    DTSMappedFile stored;
+
+    if (directory.empty() || !cacheable(path))
+    {
+        return false;
+    }
+
+    if (!outputKey(resolver, path, namesFile, outputFile) ||
+        !stored.load(outputFile.c_str()) ||
+        !DTSSaveFile(path.c_str(), stored.data, stored.size))
+    {
+        misses++;
+        return false;
+    }
+
+    hits++;
+    return true;
+}
+
+bool DTSConversionCache::store(const DTSShape& shape, const DTSResolver& resolver, const std::string& path)
+{
+    std::string names, namesFile, outputFile;
+
+    if (directory.empty() || !cacheable(path))
+    {
+        return false;
+    }
+
+    std::vector<DTSMaterial>::const_iterator it, end(shape.materials.end());
+
+    for (it = shape.materials.begin(); it != end; ++it)
+    {
+        names += (*it).name;
+        names += "\n";
+    }
+
+#ifndef WIN32
+    mkdir(directory.c_str(), 0777);
+#endif
+
+    namesFile = directory + PATHSEP + hexKey(sourceKey) + ".names";
+
+    DTSMappedFile output;
+
+    if (!DTSSaveFile(namesFile.c_str(), names.data(), names.size()) ||
+        !outputKey(resolver, path, namesFile, outputFile) ||
+        !output.load(path.c_str()) ||
+        !DTSSaveFile(outputFile.c_str(), output.data, output.size))
+    {
+        fprintf(DTSErrorFile(), "Warning: %s not cached\n", path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+void DTSConversionCache::record() const
+{
+    if (directory.empty() || ((hits == 0) && (misses == 0)))
+    {
+        return;
+    }
+
+    std::string statsFile(directory + PATHSEP + "stats");
+    int         totalHits = 0, totalMisses = 0;
+
+#ifndef WIN32
+    // Locked, concurrent builds share the counters.
+    int fd = ::open(statsFile.c_str(), O_RDWR | O_CREAT, 0666);
+
+    if (fd < 0)
+    {
+        return;
+    }
+
+    flock(fd, LOCK_EX);
+
+    FILE* f = fdopen(fd, "r+");
+
+    if (f == NULL)
+    {
+        ::close(fd);
+        return;
+    }
+
+    if (fscanf(f, "hits %d\nmisses %d\n", &totalHits, &totalMisses) != 2)
+    {
+        totalHits = totalMisses = 0;
+    }
+
+    rewind(f);
+    fprintf(f, "hits %d\nmisses %d\n", totalHits + hits, totalMisses + misses);
+    fflush(f);
+    ftruncate(fd, ftell(f));
+    fclose(f);
+#else
+    FILE* f = fopen(statsFile.c_str(), "r");
+
+    if (f)
+    {
+        if (fscanf(f, "hits %d\nmisses %d\n", &totalHits, &totalMisses) != 2)
+        {
+            totalHits = totalMisses = 0;
+        }
+
+        fclose(f);
+    }
+
+    if ((f = fopen(statsFile.c_str(), "w")) != NULL)
+    {
+        fprintf(f, "hits %d\nmisses %d\n", totalHits + hits, totalMisses + misses);
+        fclose(f);
+    }
+#endif
+}
+
+int DTSConversionCache::printStats(FILE* fileOut, const std::string& directory)
+{
+    std::string statsFile(directory + PATHSEP + "stats");
+    int         totalHits = 0, totalMisses = 0;
+    FILE*       f = fopen(statsFile.c_str(), "r");
+
+    if (f == NULL)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", statsFile.c_str(), strerror(errno));
+        return -1;
+    }
+
+    if (fscanf(f, "hits %d\nmisses %d\n", &totalHits, &totalMisses) != 2)
+    {
+        totalHits = totalMisses = 0;
+    }
+
+    fclose(f);
+
+    int lookups = totalHits + totalMisses;
+
+    fprintf(fileOut, "Conversion cache %s:\n", directory.c_str());
+    fprintf(fileOut, "  hits:     %i\n", totalHits);
+    fprintf(fileOut, "  misses:   %i\n", totalMisses);
+    fprintf(fileOut, "  hit rate: %.1f%%\n", lookups ? totalHits * 100.0 / lookups : 0.0);
+    return 0;
+}
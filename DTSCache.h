@@ -0,0 +1,387 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSCache_h
+#define DTSConverter_DTSCache_h
+
+#include "DTSTypes.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class DTSShape;
+class DTSResolver;
+class DTSOptions;
+
+// 64 bit content hash, multiply-xor over 8 byte words with a final mix.
+// Hashes are chained through seed.
+unsigned long long DTSHash(const void* data, size_t size, unsigned long long seed = 0);
+
+// Writes a temporary file renamed over path, readers never see a partial file.
+bool DTSSaveFile(const char* path, const void* data, size_t size);
+
+// Read only view of a whole file, mapped when the platform allows it.
+class DTSMappedFile
+{
+protected:
+    void*             mapping;
+    std::vector<char> storage;
+
+public:
+    const char* data;
+    size_t      size;
+
+public:
+    DTSMappedFile();
+    ~DTSMappedFile();
+
+    // Quiet, errno tells why it failed.
+    bool load(const char* path);
+    void close();
+};
+
+/*
+ * Shape images hold a decoded DTSShape (from a .dts or a .dsq), so that
+ * reopening a shape skips the stream decoding. The image is pointer free:
+ * arrays are {offset, count} pairs relative to the start of the file, every
+ * array is 16 bytes aligned and a mapped image is used in place.
+ *
+ *   DTSImageHeader           counts, bounds and the top level arrays
+ *   arrays                   raw DTSNode, DTSObject, ... Point, Quaternion
+ *   DTSImageMesh[numMeshes]  mesh scalars and the arrays of every mesh
+ *   DTSImageSequence[]       sequence fields, matters as one byte per node
+ *   DTSImageMaterial[]
+ *   names                    DTSImageArray per name, NUL terminated chars
+ *
+ * The header records the hash and the size of the source file, an image is
+ * only valid for the exact bytes it was built from. Images are written with
+ * the layout of the host, they are a local cache and not an exchange format.
+ */
+
+#define DTS_IMAGE_MAGIC   "DSHI"
+#define DTS_IMAGE_VERSION 2
+
+class DTSImageArray
+{
+public:
+    unsigned int offset;
+    unsigned int count;
+};
+
+class DTSImageHeader
+{
+public:
+    enum
+    {
+        A_Nodes,
+        A_Objects,
+        A_Decals,
+        A_IFLMaterials,
+        A_Subshapes,
+        A_NodeDefRotations,
+        A_NodeDefTranslations,
+        A_NodeRotations,
+        A_NodeTranslations,
+        A_NodeScalesUniform,
+        A_NodeScalesAligned,
+        A_NodeScalesArbitrary,
+        A_NodeScaleRotsArbitrary,
+        A_GroundRotations,
+        A_GroundTranslations,
+        A_ObjectStates,
+        A_DecalStates,
+        A_DetailLevels,
+        A_Triggers,
+        A_Meshes,
+        A_Sequences,
+        A_Materials,
+        A_Names,
+        A_Parents,
+        A_Depths,
+        A_Preorder,
+        A_PreorderIndex,
+        A_SubtreeEnds,
+        A_BreadthFirst,
+        A_BreadthFirstIndex,
+        A_MeshIndexList,
+        A_Count
+    };
+
+    // numNodes to numNames, in the order of DTSShape.
+    enum { NumCounts = 18 };
+
+public:
+    char               magic[4];
+    int                version;
+    unsigned int       size;
+    int                sequenceFile;
+    unsigned long long sourceHash;
+    unsigned long long sourceSize;
+
+    int   dtsVersion;
+    int   counts[NumCounts];
+    float smallestSize;
+    int   smallestDetailLevel;
+    float radius;
+    float tubeRadius;
+    Point center;
+    Box   bounds;
+    int   materialListVersion;
+    int   numExportedObjects;
+    int   numExportedObjectStates;
+
+    DTSImageArray arrays[A_Count];
+};
+
+class DTSImageMesh
+{
+public:
+    enum
+    {
+        M_Verts,
+        M_TVerts,
+        M_Normals,
+        M_ENormals,
+        M_Primitives,
+        M_Indices,
+        M_MIndices,
+        M_VIndex,
+        M_VBone,
+        M_VWeight,
+        M_NodeIndex,
+        M_NodeTransform,
+        M_Clusters,
+        M_StartCluster,
+        M_FirstVerts,
+        M_NumVerts,
+        M_FirstTVerts,
+        M_BaseVerts,
+        M_BaseNormals,
+        M_BaseENormals,
+        M_Count
+    };
+
+public:
+    int   type;
+    int   numFrames;
+    int   matFrames;
+    int   parent;
+    Box   bounds;
+    Point center;
+    float radius;
+    int   vertsPerFrame;
+    int   flags;
+    int   baseVertsDiffer;
+    int   alwaysWriteDepth;
+
+    DTSImageArray arrays[M_Count];
+};
+
+class DTSImageSequence
+{
+public:
+    enum
+    {
+        S_Rotation,
+        S_Translation,
+        S_Scale,
+        S_Decal,
+        S_IFL,
+        S_Vis,
+        S_Frame,
+        S_MatFrame,
+        S_Count
+    };
+
+public:
+    DTSImageArray name;
+    int           nameIndex;
+    int           flags;
+    int           numKeyFrames;
+    float         duration;
+    int           priority;
+    int           firstGroundFrame;
+    int           numGroundFrames;
+    int           baseRotation;
+    int           baseTranslation;
+    int           baseScale;
+    int           baseObjectState;
+    int           baseDecalState;
+    int           firstTrigger;
+    int           numTriggers;
+    float         toolBegin;
+
+    DTSImageArray matters[S_Count];
+};
+
+class DTSImageMaterial
+{
+public:
+    DTSImageArray name;
+    int           flags;
+    int           reflectance;
+    int           bump;
+    int           detail;
+    int           detailScale;
+    int           reflection;
+};
+
+class DTSShapeImageWriter
+{
+public:
+    std::vector<char> buffer;
+
+protected:
+    DTSImageArray append(const void* data, size_t elementSize, size_t count);
+    DTSImageArray append(const std::string& value);
+    DTSImageArray append(const std::vector<bool>& value);
+
+    template <typename DataType> DTSImageArray append(const std::vector<DataType>& value)
+    {
+        return append(value.empty() ? NULL : &value[0], sizeof(DataType), value.size());
+    }
+
+public:
+    // Returns false when the shape does not fit 32 bit offsets.
+    bool convert(const DTSShape& shape, bool sequenceFile, unsigned long long sourceHash, unsigned long long sourceSize);
+
+    // Written to a temporary file first, readers never see a partial image.
+    bool save(const char* imageFile) const;
+};
+
+class DTSShapeImage
+{
+protected:
+    DTSMappedFile file;
+    const char*   data;
+    size_t        size;
+
+    template <typename DataType> bool copy(const DTSImageArray& value, std::vector<DataType>& out) const
+    {
+        if (!valid(value, sizeof(DataType)))
+        {
+            return false;
+        }
+
+        const DataType* first = array<DataType>(value);
+
+        out.assign(first, first + value.count);
+        return true;
+    }
+
+    bool copy(const DTSImageArray& value, std::string& out) const;
+    bool copy(const DTSImageArray& value, std::vector<bool>& out) const;
+
+public:
+    DTSShapeImage();
+
+    bool load(const char* imageFile);
+    bool open(const void* data, size_t size);
+    void close();
+
+public:
+    const DTSImageHeader& header() const { return *(const DTSImageHeader*)data; }
+
+    bool valid(const DTSImageArray& value, size_t elementSize) const;
+
+    template <typename DataType> const DataType* array(const DTSImageArray& value) const
+    {
+        return (const DataType*)(data + value.offset);
+    }
+
+    template <typename DataType> const DataType* array(int which, int& count) const
+    {
+        count = (int)header().arrays[which].count;
+        return array<DataType>(header().arrays[which]);
+    }
+
+    const char* name(int index) const;
+
+    // Unpacks the image into the arrays of a shape.
+    bool shape(DTSShape& shape) const;
+};
+
+// Decoded shapes kept in memory by a long running process (serve), keyed
+// like the images by the hash and the size of their source. Lookups copy
+// the shape out, past capacity the least recently used shape is dropped.
+class DTSShapeMemoryCache
+{
+public:
+    static void enable(int capacity);
+    static bool enabled();
+
+    static bool find  (unsigned long long hash, unsigned long long size, bool sequenceFile, DTSShape& shape);
+    static void insert(unsigned long long hash, unsigned long long size, bool sequenceFile, const DTSShape& shape);
+};
+
+// Loads a .dts, or a .dsq when sequenceFile is true. With a cache directory
+// the decoded shape is stored there, named after the hash of the source, and
+// later loads of the same bytes come from that image, or from memory when
+// DTSShapeMemoryCache is enabled. Returns false when the source can't be
+// opened.
+bool DTSLoadShape(const char* path, bool sequenceFile, const DTSShape* baseShape, const std::string& cacheDirectory, DTSShape& shape);
+
+/*
+ * Converted outputs (--cache=dir), keyed by the hashes of the .dts, of every
+ * .dsq in order, of the options changing the output and of its format:
+ *
+ *   dir/<key>.names           material names of the shape, one per line
+ *   dir/<key>-<textures>.out  the output, <textures> hashing the paths the
+ *                             resolver gives for those names
+ *   dir/stats                 hit and miss counters
+ *
+ * A lookup reads the sources to hash them but decodes nothing, the material
+ * names come from the .names file. Hits are copied to the output path.
+ * .clip directories are not cached.
+ */
+class DTSConversionCache
+{
+public:
+    std::string        directory;
+    unsigned long long sourceKey;
+    int                hits;
+    int                misses;
+
+protected:
+    bool outputKey(const DTSResolver& resolver, const std::string& path, std::string& namesFile, std::string& outputFile) const;
+
+public:
+    DTSConversionCache(const std::string& directory);
+
+    // Disables the cache when a source can't be read.
+    bool hashSources(const char* shapeFile, const std::vector<std::string>& sequenceFiles, const DTSOptions& options);
+
+    static bool cacheable(const std::string& path);
+
+    // Copies the stored output to path, false on a miss.
+    bool fetch(const DTSResolver& resolver, const std::string& path);
+    bool store(const DTSShape& shape, const DTSResolver& resolver, const std::string& path);
+
+    // Adds the hits and misses of this run to the stats file.
+    void record() const;
+
+    static int printStats(FILE* fileOut, const std::string& directory);
+};
+
+#endif
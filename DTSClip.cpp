@@ -0,0 +1,595 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+#include <errno.h>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSClip.h"
+#include "DTSExport.h"
+#include "DTSStats.h"
+#include "DTSThreads.h"
+
+#ifdef WIN32
+#define PATHSEP "\\"
+#else
+#define PATHSEP "/"
+#endif
+
+// Range of the three smallest components of a unit quaternion.
+static const float SmallestThreeRange = 0.70710678f;
+
+static size_t appendAligned(std::vector<char>& buffer, const void* data, size_t size)
+{
+    size_t offset = buffer.size();
+
+    buffer.resize((offset + size + 3) & ~3);
+
+    if (size && data)
+    {
+        memcpy(&buffer[offset], data, size);
+    }
+
+    return offset;
+}
+
+void DTSClipExporter::encode(const Quaternion& q, unsigned short packed[3])
+{
+    float c[4] = { q.x, q.y, q.z, q.w };
+    float length = sqrtf(c[0] * c[0] + c[1] * c[1] + c[2] * c[2] + c[3] * c[3]);
+    int   index, largest = 0, slot = 0;
+
+    for (index = 1; index < 4; index++)
+    {
+        if (fabsf(c[index]) > fabsf(c[largest]))
+        {
+            largest = index;
+        }
+    }
+
+    // q and -q are the same rotation, keep the dropped component positive.
+    float scale = (length > 0.0f ? 1.0f / length : 1.0f) * (c[largest] < 0.0f ? -1.0f : 1.0f);
+
+    for (index = 0; index < 4; index++)
+    {
+        if (index == largest)
+        {
+            continue;
+        }
+
+        float v = (c[index] * scale / SmallestThreeRange) * 0.5f + 0.5f;
+        int   n = (int)floorf(v * 32767.0f + 0.5f);
+
+        if (n < 0)     n = 0;
+        if (n > 32767) n = 32767;
+
+        packed[slot++] = (unsigned short)n;
+    }
+
+    packed[0] |= (unsigned short)((largest & 1) << 15);
+    packed[1] |= (unsigned short)((largest >> 1) << 15);
+}
+
+void DTSClipExporter::decode(const unsigned short packed[3], Quaternion& q)
+{
+    // Position of each decoded value in x, y, z, w for every dropped component.
+    static const int slots[4][4] =
+    {
+        { 3, 0, 1, 2 },
+        { 0, 3, 1, 2 },
+        { 0, 1, 3, 2 },
+        { 0, 1, 2, 3 }
+    };
+
+    const float unpack = 2.0f * SmallestThreeRange / 32767.0f;
+
+    float v[4];
+    int   largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+
+    v[0] = (packed[0] & 0x7fff) * unpack - SmallestThreeRange;
+    v[1] = (packed[1] & 0x7fff) * unpack - SmallestThreeRange;
+    v[2] = (packed[2] & 0x7fff) * unpack - SmallestThreeRange;
+    v[3] = 1.0f - v[0] * v[0] - v[1] * v[1] - v[2] * v[2];
+    v[3] = sqrtf(v[3] > 0.0f ? v[3] : 0.0f);
+
+    const int* slot = slots[largest];
+
+    q.x = v[slot[0]];
+    q.y = v[slot[1]];
+    q.z = v[slot[2]];
+    q.w = v[slot[3]];
+}
+
+void DTSClipExporter::convert(const DTSShape& shape, const DTSShape& file, const DTSSequence& sequence)
+{
+    std::vector<DTSNodeTrack>        fileTracks;
+    std::vector<const DTSNodeTrack*> nodeTracks(shape.nodes.size(), (const DTSNodeTrack*)NULL);
+    std::vector<DTSClipTrack>        tracks(shape.nodes.size());
+
+    file.sequenceTracks(shape, sequence, fileTracks);
+
+    {
+        std::vector<DTSNodeTrack>::const_iterator it, end(fileTracks.end());
+
+        for (it = fileTracks.begin(); it != end; ++it)
+        {
+            if ((*it).node >= 0)
+            {
+                nodeTracks[(*it).node] = &(*it);
+            }
+        }
+    }
+
+    DTSClipHeader header;
+    int           index, key, numKeyFrames = sequence.numKeyFrames > 0 ? sequence.numKeyFrames : 1;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DTS_CLIP_MAGIC, 4);
+    header.version      = DTS_CLIP_VERSION;
+    header.flags        = sequence.flags;
+    header.numTracks    = (int)tracks.size();
+    header.numKeyFrames = numKeyFrames;
+    header.duration     = sequence.duration;
+
+    buffer.clear();
+    appendAligned(buffer, &header, sizeof(header));
+    header.trackOffset = (int)appendAligned(buffer, NULL, sizeof(DTSClipTrack) * tracks.size());
+    header.nameOffset  = (int)appendAligned(buffer, sequence.name.c_str(), sequence.name.size() + 1);
+
+    for (index = 0; index < (int)tracks.size(); index++)
+    {
+        DTSClipTrack& track = tracks[index];
+        std::string   name  = shape.nodeNameAtIndex(index);
+
+        memset(&track, 0, sizeof(track));
+        track.nameOffset = (int)appendAligned(buffer, name.c_str(), name.size() + 1);
+        track.parent     = shape.nodes[index].parent;
+    }
+
+    for (index = 0; index < (int)tracks.size(); index++)
+    {
+        DTSClipTrack&       track = tracks[index];
+        const DTSNodeTrack* from  = nodeTracks[index];
+
+        // Rotations, reduced to one key when every key packs the same.
+        {
+            std::vector<unsigned short> keys;
+            bool                        constant = true;
+
+            if (from && (from->firstRotation >= 0))
+            {
+                track.flags |= DTSClipTrack::F_RotationMatters;
+                keys.resize(numKeyFrames * 3);
+
+                for (key = 0; key < numKeyFrames; key++)
+                {
+                    encode(file.nodeRotations[from->firstRotation + key], &keys[key * 3]);
+                    constant = constant && (memcmp(&keys[key * 3], &keys[0], sizeof(unsigned short) * 3) == 0);
+                }
+            }
+            else
+            {
+                keys.resize(3);
+                encode(shape.nodeDefRotations[index], &keys[0]);
+            }
+
+            if (constant)
+            {
+                keys.resize(3);
+            }
+
+            track.numRotations   = (int)(keys.size() / 3);
+            track.rotationOffset = (int)appendAligned(buffer, &keys[0], keys.size() * sizeof(unsigned short));
+        }
+
+        // Translations, quantized inside their own bounding range.
+        {
+            std::vector<Point>          values;
+            std::vector<unsigned short> keys;
+            int                         axis;
+
+            if (from && (from->firstTranslation >= 0))
+            {
+                track.flags |= DTSClipTrack::F_TranslationMatters;
+                values.assign(file.nodeTranslations.begin() + from->firstTranslation,
+                              file.nodeTranslations.begin() + from->firstTranslation + numKeyFrames);
+            }
+            else
+            {
+                values.push_back(shape.nodeDefTranslations[index]);
+            }
+
+            float minimum[3] = { values[0].x, values[0].y, values[0].z };
+            float maximum[3] = { values[0].x, values[0].y, values[0].z };
+
+            for (key = 1; key < (int)values.size(); key++)
+            {
+                const float v[3] = { values[key].x, values[key].y, values[key].z };
+
+                for (axis = 0; axis < 3; axis++)
+                {
+                    if (v[axis] < minimum[axis]) minimum[axis] = v[axis];
+                    if (v[axis] > maximum[axis]) maximum[axis] = v[axis];
+                }
+            }
+
+            for (axis = 0; axis < 3; axis++)
+            {
+                track.translationMin  [axis] = minimum[axis];
+                track.translationScale[axis] = (maximum[axis] - minimum[axis]) / 65535.0f;
+            }
+
+            if ((minimum[0] == maximum[0]) && (minimum[1] == maximum[1]) && (minimum[2] == maximum[2]))
+            {
+                values.resize(1);
+            }
+
+            keys.resize(values.size() * 3);
+
+            for (key = 0; key < (int)values.size(); key++)
+            {
+                const float v[3] = { values[key].x, values[key].y, values[key].z };
+
+                for (axis = 0; axis < 3; axis++)
+                {
+                    float range = maximum[axis] - minimum[axis];
+                    float n     = (range > 0.0f) ? (v[axis] - minimum[axis]) / range * 65535.0f + 0.5f : 0.0f;
+
+                    keys[key * 3 + axis] = (unsigned short)(n > 65535.0f ? 65535.0f : n);
+                }
+            }
+
+            track.numTranslations   = (int)values.size();
+            track.translationOffset = (int)appendAligned(buffer, &keys[0], keys.size() * sizeof(unsigned short));
+        }
+    }
+
+    header.size = (int)buffer.size();
+    memcpy(&buffer[0], &header, sizeof(header));
+
+    if (!tracks.empty())
+    {
+        memcpy(&buffer[header.trackOffset], &tracks[0], sizeof(DTSClipTrack) * tracks.size());
+    }
+}
+
+bool DTSClipExporter::save(const char* clipFile) const
+{
+    FILE* f = fopen(clipFile, "wb");
+
+    if (f == NULL)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", clipFile, strerror(errno));
+        return false;
+    }
+
+    size_t written = fwrite(&buffer[0], 1, buffer.size(), f);
+
+    fclose(f);
+
+    if (written != buffer.size())
+    {
+        fprintf(DTSErrorFile(), "Failed to produce clip file %s\n", clipFile);
+        return false;
+    }
+
+    return true;
+}
+
+DTSClip::DTSClip() :
+    data   (NULL),
+    size   (0),
+    mapping(NULL)
+{
+}
+
+DTSClip::~DTSClip()
+{
+    close();
+}
+
+void DTSClip::close()
+{
+#ifndef WIN32
+    if (mapping)
+    {
+        munmap(mapping, size);
+    }
+#endif
+
+    storage.clear();
+    mapping = NULL;
+    data    = NULL;
+    size    = 0;
+}
+
+bool DTSClip::load(const char* clipFile)
+{
+    close();
+
+#ifndef WIN32
+    int         fd = ::open(clipFile, O_RDONLY);
+    struct stat s;
+
+    if (fd < 0)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", clipFile, strerror(errno));
+        return false;
+    }
+
+    if ((fstat(fd, &s) != 0) || (s.st_size < (off_t)sizeof(DTSClipHeader)))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    void* mapped = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    ::close(fd);
+
+    if (mapped == MAP_FAILED)
+    {
+        fprintf(DTSErrorFile(), "Failed to map %s: %s\n", clipFile, strerror(errno));
+        return false;
+    }
+
+    mapping = mapped;
+    size    = s.st_size;
+
+    if (!open(mapped, s.st_size))
+    {
+        close();
+        return false;
+    }
+
+    return true;
+#else
+    FILE* f = fopen(clipFile, "rb");
+
+    if (f == NULL)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", clipFile, strerror(errno));
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    storage.resize(ftell(f));
+    fseek(f, 0, SEEK_SET);
+
+    size_t readed = storage.empty() ? 0 : fread(&storage[0], 1, storage.size(), f);
+
+    fclose(f);
+
+    if (readed != storage.size())
+    {
+        return false;
+    }
+
+    return open(storage.empty() ? NULL : &storage[0], storage.size());
+#endif
+}
+
+// Whether count elements of elementSize bytes at offset, aligned on
+// alignment, fit in a clip of clipSize bytes.
+static bool validRange(int offset, int count, size_t elementSize, size_t alignment, size_t clipSize)
+{
+    return (offset >= 0) && (count >= 0) && ((offset % alignment) == 0) && ((size_t)offset <= clipSize) &&
+           ((size_t)count <= (clipSize - offset) / elementSize);
+}
+
+static bool validName(const char* clipData, int offset, size_t clipSize)
+{
+    return (offset >= 0) && ((size_t)offset < clipSize) && (memchr(clipData + offset, '\0', clipSize - offset) != NULL);
+}
+
+bool DTSClip::open(const void* clipData, size_t clipSize)
+{
+    const DTSClipHeader* h     = (const DTSClipHeader*)clipData;
+    bool                 valid = (clipData != NULL) && (clipSize >= sizeof(DTSClipHeader)) &&
+                                 (memcmp(h->magic, DTS_CLIP_MAGIC, 4) == 0) &&
+                                 (h->version == DTS_CLIP_VERSION) &&
+                                 (h->size    == (int)clipSize) &&
+                                 (h->numKeyFrames > 0) &&
+                                 validName ((const char*)clipData, h->nameOffset, clipSize) &&
+                                 validRange(h->trackOffset, h->numTracks, sizeof(DTSClipTrack), 4, clipSize);
+
+    // Keys are read unchecked when sampling, every track needs at least
+    // one key of each channel inside the file.
+    for (int index = 0; valid && (index < h->numTracks); index++)
+    {
+        const DTSClipTrack& t = ((const DTSClipTrack*)((const char*)clipData + h->trackOffset))[index];
+
+        valid = validName((const char*)clipData, t.nameOffset, clipSize) &&
+                (t.numRotations > 0) && (t.numTranslations > 0) &&
+                validRange(t.rotationOffset,    t.numRotations,    sizeof(unsigned short) * 3, 2, clipSize) &&
+                validRange(t.translationOffset, t.numTranslations, sizeof(unsigned short) * 3, 2, clipSize);
+    }
+
+    if (!valid)
+    {
+        fprintf(DTSErrorFile(), "Invalid clip file\n");
+        return false;
+    }
+
+    data = (const char*)clipData;
+    size = clipSize;
+    return true;
+}
+
+const DTSClipTrack& DTSClip::track(int index) const
+{
+    assert((index >= 0) && (index < header().numTracks));
+
+    return ((const DTSClipTrack*)(data + header().trackOffset))[index];
+}
+
+const char* DTSClip::name() const
+{
+    return data + header().nameOffset;
+}
+
+const char* DTSClip::trackName(int index) const
+{
+    return data + track(index).nameOffset;
+}
+
+int DTSClip::findTrack(const char* nodeName) const
+{
+    int index, count = header().numTracks;
+
+    for (index = 0; index < count; index++)
+    {
+        if (strcmp(trackName(index), nodeName) == 0)
+        {
+            return index;
+        }
+    }
+
+    return -1;
+}
+
+void DTSClip::rotation(int index, int key, Quaternion& q) const
+{
+    const DTSClipTrack& t    = track(index);
+    int                 last = t.numRotations - 1;
+
+    DTSClipExporter::decode((const unsigned short*)(data + t.rotationOffset) + (key < last ? key : last) * 3, q);
+}
+
+void DTSClip::translation(int index, int key, Point& p) const
+{
+    const DTSClipTrack&   t    = track(index);
+    int                   last = t.numTranslations - 1;
+    const unsigned short* k    = (const unsigned short*)(data + t.translationOffset) + (key < last ? key : last) * 3;
+
+    p.x = t.translationMin[0] + k[0] * t.translationScale[0];
+    p.y = t.translationMin[1] + k[1] * t.translationScale[1];
+    p.z = t.translationMin[2] + k[2] * t.translationScale[2];
+}
+
+void DTSClip::samplePose(float time, Quaternion* rotations, Point* translations) const
+{
+    const DTSClipHeader& h = header();
+
+    int   key0, key1;
+    float t;
+
+    DTSSequence::keyFrames(time, h.duration, h.numKeyFrames, (h.flags & DTSSequence::F_Cyclic) != 0, key0, key1, t);
+
+    int index;
+
+    for (index = 0; index < h.numTracks; index++)
+    {
+        Quaternion q0, q1;
+        Point      p0, p1;
+
+        rotation   (index, key0, q0);
+        rotation   (index, key1, q1);
+        translation(index, key0, p0);
+        translation(index, key1, p1);
+
+        // Normalized lerp along the shortest arc.
+        float dot  = q0.x * q1.x + q0.y * q1.y + q0.z * q1.z + q0.w * q1.w;
+        float s    = (dot < 0.0f) ? -t : t;
+        float x    = q0.x + (q1.x * s - q0.x * t);
+        float y    = q0.y + (q1.y * s - q0.y * t);
+        float z    = q0.z + (q1.z * s - q0.z * t);
+        float w    = q0.w + (q1.w * s - q0.w * t);
+        float n    = 1.0f / sqrtf(x * x + y * y + z * z + w * w);
+
+        rotations[index].x = x * n;
+        rotations[index].y = y * n;
+        rotations[index].z = z * n;
+        rotations[index].w = w * n;
+
+        translations[index].x = p0.x + (p1.x - p0.x) * t;
+        translations[index].y = p0.y + (p1.y - p0.y) * t;
+        translations[index].z = p0.z + (p1.z - p0.z) * t;
+    }
+}
+
+int exportClips(const DTSShape& shape, const std::vector<DTSShape>& files, const char* directory)
+{
+    DTSStatsScope   scope(DTSStats::P_Write);
+    DTSClipExporter exporter;
+    int             result = 0;
+
+    // Sequences of the shape, then of every file.
+    std::vector<const DTSShape*>    sources;
+    std::vector<const DTSSequence*> sequences;
+    std::vector<std::string>        names, fileNames;
+
+    for (int index = -1; index < (int)files.size(); index++)
+    {
+        const DTSShape& file((index == -1) ? shape : files[index]);
+
+        std::vector<DTSSequence>::const_iterator seqIt, seqEnd(file.sequences.end());
+
+        for (seqIt = file.sequences.begin(); seqIt != seqEnd; ++seqIt)
+        {
+            sources  .push_back(&file);
+            sequences.push_back(&*seqIt);
+            names    .push_back((*seqIt).name);
+        }
+    }
+
+    DTSOutputNames(names, std::vector<std::string>(), fileNames);
+
+    if (!DTSCreateDirectory(directory))
+    {
+        return -1;
+    }
+
+    for (size_t index = 0; index < sequences.size(); index++)
+    {
+        std::string path(directory);
+
+        path += PATHSEP;
+        path += fileNames[index];
+        path += ".clip";
+
+        exporter.convert(shape, *sources[index], *sequences[index]);
+
+        if (!exporter.save(path.c_str()))
+        {
+            result = -1;
+        }
+    }
+
+    return result;
+}
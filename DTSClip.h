@@ -0,0 +1,137 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSClip_h
+#define DTSConverter_DTSClip_h
+
+#include "DTSTypes.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class DTSShape;
+class DTSSequence;
+
+/*
+ * Clip files hold one sequence, baked against the nodes of the base shape.
+ * All offsets are relative to the start of the file and every section is
+ * 4 bytes aligned, so a mapped file is used in place:
+ *
+ *   DTSClipHeader
+ *   DTSClipTrack[numTracks]   one track per node of the base shape
+ *   names                     NUL terminated strings
+ *   rotation keys             3 x uint16, smallest-three quaternions
+ *   translation keys          3 x uint16, quantized inside the track range
+ *
+ * A channel with a single key is constant. Sampling clamps the key index to
+ * the key count, so constant and animated channels decode the same way.
+ */
+
+#define DTS_CLIP_MAGIC   "DCLP"
+#define DTS_CLIP_VERSION 2
+
+class DTSClipHeader
+{
+public:
+    char  magic[4];
+    int   version;
+    int   size;
+    int   flags;
+    int   numTracks;
+    int   numKeyFrames;
+    float duration;
+    int   nameOffset;
+    int   trackOffset;
+};
+
+class DTSClipTrack
+{
+public:
+    enum
+    {
+        F_RotationMatters    = 1 << 0,
+        F_TranslationMatters = 1 << 1
+    };
+
+public:
+    int            nameOffset;
+    int            parent;
+    int            flags;
+    int            rotationOffset;
+    int            translationOffset;
+    int            numRotations;
+    int            numTranslations;
+    float          translationMin  [3];
+    float          translationScale[3];
+};
+
+class DTSClipExporter
+{
+public:
+    std::vector<char> buffer;
+
+public:
+    void convert(const DTSShape& shape, const DTSShape& file, const DTSSequence& sequence);
+    bool save(const char* clipFile) const;
+
+public:
+    static void encode(const Quaternion& q, unsigned short packed[3]);
+    static void decode(const unsigned short packed[3], Quaternion& q);
+};
+
+class DTSClip
+{
+protected:
+    const char*       data;
+    size_t            size;
+    void*             mapping;
+    std::vector<char> storage;
+
+public:
+    DTSClip();
+    ~DTSClip();
+
+    bool load(const char* clipFile);
+    bool open(const void* data, size_t size);
+    void close();
+
+public:
+    const DTSClipHeader& header() const { return *(const DTSClipHeader*)data; }
+    const DTSClipTrack&  track(int index) const;
+
+    const char* name() const;
+    const char* trackName(int index) const;
+    int         findTrack(const char* nodeName) const;
+
+    void rotation   (int track, int key, Quaternion& q) const;
+    void translation(int track, int key, Point& p) const;
+
+    void samplePose(float time, Quaternion* rotations, Point* translations) const;
+};
+
+// Writes directory/<sequence>.clip for the sequences of the shape and of
+// files, creating directory, see DTSOutputNames for names that clash.
+int exportClips(const DTSShape& shape, const std::vector<DTSShape>& files, const char* directory);
+
+#endif
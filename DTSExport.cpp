@@ -0,0 +1,390 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <map>
+#include <set>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/stat.h>
+#include <sys/types.h>
+#else
+#include <direct.h>
+#endif
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSOptions.h"
+#include "DTSScene.h"
+#include "DTSThreads.h"
+#include "DTSClip.h"
+#include "DTSGLTF.h"
+#include "DTSExport.h"
+
+#ifdef WIN32
+#define PATHSEP "\\"
+#else
+#define PATHSEP "/"
+#endif
+
+// DTS2FBX.cpp
+std::string fbxWriterName(const DTSOptions& options);
+int         convertScene(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const char* fbxFile, const DTSOptions& options);
+
+enum DTSOutputFormat
+{
+    DTSOutputUnknown,
+    DTSOutputFBX,
+    DTSOutputGLTF,
+    DTSOutputClip
+};
+
+static DTSOutputFormat outputFormat(const std::string& path)
+{
+    size_t dot = path.rfind('.');
+
+    if (dot != std::string::npos)
+    {
+        const char* extension = path.c_str() + dot;
+
+        if (strcasecmp(extension, ".fbx") == 0)
+        {
+            return DTSOutputFBX;
+        }
+
+        if (strcasecmp(extension, ".glb") == 0)
+        {
+            return DTSOutputGLTF;
+        }
+
+        if (strcasecmp(extension, ".clip") == 0)
+        {
+            return DTSOutputClip;
+        }
+    }
+
+    return DTSOutputUnknown;
+}
+
+class DTSOutputTask : public DTSTask
+{
+public:
+    const DTSScene&                 scene;
+    const DTSShape&                 shape;
+    const std::vector<DTSShape>&    files;
+    const DTSOptions&               options;
+    const std::vector<std::string>& paths;
+    std::vector<int>                results;
+
+    DTSOutputTask(const DTSScene& sc, const DTSShape& s, const std::vector<DTSShape>& f, const DTSOptions& o, const std::vector<std::string>& p) :
+        scene(sc), shape(s), files(f), options(o), paths(p), results(p.size(), 0) {}
+
+    void run(int index)
+    {
+        const char* path = paths[index].c_str();
+
+        switch (outputFormat(paths[index]))
+        {
+            case DTSOutputFBX:
+                results[index] = convertScene(scene, shape, files, path, options);
+                break;
+            case DTSOutputGLTF:
+                results[index] = writeGLTF(scene, shape, files, path, options);
+                break;
+            case DTSOutputClip:
+                results[index] = exportClips(shape, files, path);
+                break;
+            default:
+                results[index] = -1;
+                break;
+        }
+    }
+};
+
+int exportOutputs(const DTSResolver& resolver, const DTSShape& shape, const std::vector<DTSShape>& files, const std::vector<std::string>& outputs, const DTSOptions& options)
+{
+    std::vector<std::string> concurrent, serial;
+    bool                     sdk = (fbxWriterName(options) == "sdk");
+
+    std::vector<std::string>::const_iterator it, end(outputs.end());
+
+    for (it = outputs.begin(); it != end; ++it)
+    {
+        DTSOutputFormat format = outputFormat(*it);
+
+        if (format == DTSOutputUnknown)
+        {
+            fprintf(DTSErrorFile(), "Unknown output format %s\n", (*it).c_str());
+            return -1;
+        }
+
+        // The FBX SDK is not thread safe.
+        if ((format == DTSOutputFBX) && sdk)
+        {
+            serial.push_back(*it);
+        }
+        else
+        {
+            concurrent.push_back(*it);
+        }
+    }
+
+    DTSScene   scene;
+    DTSOptions sceneOptions(options);
+
+    // Padded skin streams are what glTF needs, the FBX writers only use
+    // the per bone lists.
+    sceneOptions.influenceGroup = GLTFWriter::InfluenceGroup;
+    scene.build(resolver, shape, files, sceneOptions);
+
+    DTSOutputTask concurrentTask(scene, shape, files, options, concurrent);
+    DTSOutputTask serialTask    (scene, shape, files, options, serial);
+    int           index, result = 0;
+
+    DTSParallelFor((int)concurrent.size(), concurrentTask, options.threads);
+
+    for (index = 0; index < (int)serial.size(); index++)
+    {
+        serialTask.run(index);
+    }
+
+    for (index = 0; index < (int)concurrent.size(); index++)
+    {
+        result = (concurrentTask.results[index] != 0) ? -1 : result;
+    }
+
+    for (index = 0; index < (int)serial.size(); index++)
+    {
+        result = (serialTask.results[index] != 0) ? -1 : result;
+    }
+
+    return result;
+}
+
+bool DTSCreateDirectory(const char* directory)
+{
+#ifndef WIN32
+    int result = mkdir(directory, 0777);
+#else
+    int result = _mkdir(directory);
+#endif
+
+    if ((result != 0) && (errno != EEXIST))
+    {
+        fprintf(DTSErrorFile(), "Failed to create %s: %s\n", directory, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static std::string safeFileName(const std::string& name)
+{
+    std::string fileName(name);
+
+    for (size_t index = 0; index < fileName.size(); index++)
+    {
+        if ((fileName[index] == '/') || (fileName[index] == '\\'))
+        {
+            fileName[index] = '_';
+        }
+    }
+
+    if (fileName.empty() || (fileName == ".") || (fileName == ".."))
+    {
+        fileName = "_" + fileName;
+    }
+
+    return fileName;
+}
+
+static std::string lowerCase(const std::string& name)
+{
+    std::string lower(name);
+
+    for (size_t index = 0; index < lower.size(); index++)
+    {
+        lower[index] = (char)tolower((unsigned char)lower[index]);
+    }
+
+    return lower;
+}
+
+void DTSOutputNames(const std::vector<std::string>& names, const std::vector<std::string>& sources, std::vector<std::string>& fileNames)
+{
+    std::map<std::string, int> counts;
+    std::set<std::string>      used;
+    size_t                     index;
+
+    fileNames.resize(names.size());
+
+    for (index = 0; index < names.size(); index++)
+    {
+        fileNames[index] = safeFileName(names[index]);
+        counts[lowerCase(fileNames[index])]++;
+    }
+
+    for (index = 0; index < names.size(); index++)
+    {
+        std::string fileName(fileNames[index]);
+
+        if ((counts[lowerCase(fileName)] > 1) && (index < sources.size()))
+        {
+            fileName += "-" + safeFileName(sources[index]);
+        }
+
+        std::string unique(fileName);
+
+        for (int number = 2; !used.insert(lowerCase(unique)).second; number++)
+        {
+            char suffix[16];
+
+            snprintf(suffix, sizeof(suffix), "-%d", number);
+            unique = fileName + suffix;
+        }
+
+        if (unique != fileNames[index])
+        {
+            fprintf(DTSErrorFile(), "Several outputs named %s, writing %s\n", names[index].c_str(), unique.c_str());
+        }
+
+        fileNames[index] = unique;
+    }
+}
+
+// File name without its directory and extension.
+static std::string baseName(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    size_t start = (slash == std::string::npos) ? 0 : slash + 1;
+    size_t dot   = path.rfind('.');
+
+    return path.substr(start, ((dot == std::string::npos) || (dot < start)) ? std::string::npos : dot - start);
+}
+
+class DTSAnimationOutputTask : public DTSTask
+{
+public:
+    const DTSScene&                 skeleton;
+    const DTSShape&                 shape;
+    const std::vector<DTSShape>&    files;
+    const DTSOptions&               options;
+    const std::vector<std::string>& paths;
+    const std::vector<int>&         firsts;
+    std::vector<int>                results;
+
+    DTSAnimationOutputTask(const DTSScene& sk, const DTSShape& s, const std::vector<DTSShape>& f, const DTSOptions& o, const std::vector<std::string>& p, const std::vector<int>& fi) :
+        skeleton(sk), shape(s), files(f), options(o), paths(p), firsts(fi), results(p.size(), 0) {}
+
+    void run(int index)
+    {
+        DTSScene scene;
+
+        // Output index holds the listed animations [firsts[index], firsts[index + 1]),
+        // baked one at a time by the writer.
+        scene.nodes = skeleton.nodes;
+        scene.order = skeleton.order;
+        scene.animations.assign(skeleton.animations.begin() + firsts[index], skeleton.animations.begin() + firsts[index + 1]);
+
+        results[index] = convertScene(scene, shape, files, paths[index].c_str(), options);
+    }
+};
+
+int exportAnimations(const DTSShape& shape, const std::vector<DTSShape>& files, const char* shapeFile, const std::vector<std::string>& sequenceFiles, const char* directory, const DTSOptions& commandOptions)
+{
+    // The SDK can't write files in parallel, the default is the binary writer.
+    DTSOptions options(commandOptions);
+
+    if (options.writer.empty())
+    {
+        options.writer = "binary";
+    }
+
+    if (fbxWriterName(options) == "sdk")
+    {
+        fprintf(DTSErrorFile(), "anim needs --writer=binary or --writer=ascii\n");
+        return -1;
+    }
+
+    DTSScene skeleton;
+
+    skeleton.buildNodes(shape);
+    skeleton.listAnimations(shape, files, true);
+
+    std::vector<std::string> names, sources, paths;
+    std::vector<int>         firsts;
+    bool                     perFile = (options.animSplit == "file");
+    int                      index, count = (int)skeleton.animations.size();
+
+    for (index = 0; index < count; index++)
+    {
+        const DTSSceneAnimation& animation(skeleton.animations[index]);
+        const DTSShape&          file((animation.file == -1) ? shape : files[animation.file]);
+
+        // Animations are listed file by file.
+        if (perFile && (index > 0) && (skeleton.animations[index - 1].file == animation.file))
+        {
+            continue;
+        }
+
+        std::string source(baseName((animation.file == -1) ? shapeFile : sequenceFiles[animation.file]));
+
+        names  .push_back(perFile ? source : file.sequences[animation.sequence].name);
+        sources.push_back(source);
+        firsts .push_back(index);
+    }
+
+    firsts.push_back(count);
+
+    // Tasks write their files at the same time, no two may share a path.
+    DTSOutputNames(names, perFile ? std::vector<std::string>() : sources, paths);
+
+    for (index = 0; index < (int)paths.size(); index++)
+    {
+        paths[index] = directory + std::string(PATHSEP) + paths[index] + ".fbx";
+    }
+
+    if (!DTSCreateDirectory(directory))
+    {
+        return -1;
+    }
+
+    DTSAnimationOutputTask task(skeleton, shape, files, options, paths, firsts);
+    int                    result = 0;
+
+    DTSParallelFor((int)paths.size(), task, options.threads);
+
+    for (index = 0; index < (int)paths.size(); index++)
+    {
+        result = (task.results[index] != 0) ? -1 : result;
+    }
+
+    return result;
+}
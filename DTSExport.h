@@ -0,0 +1,72 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSExport_h
+#define DTSConverter_DTSExport_h
+
+#include <string>
+#include <vector>
+
+class DTSShape;
+class DTSResolver;
+class DTSOptions;
+
+/*
+ * Writes several outputs from one parse and one bake. The format of every
+ * output comes from its extension:
+ *
+ *   .fbx   FBX, with the --writer writer
+ *   .glb   binary glTF
+ *   .clip  directory receiving one clip file per sequence
+ *
+ * The scene is built once, then the writers run concurrently and only read
+ * it. FBX SDK outputs are written after the others, on the calling thread.
+ */
+int exportOutputs(const DTSResolver& resolver, const DTSShape& shape, const std::vector<DTSShape>& files, const std::vector<std::string>& outputs, const DTSOptions& options);
+
+/*
+ * Animation only FBX files: the node hierarchy of the shape and the curves,
+ * no mesh, material or texture. Engines bind them to the skeleton of the
+ * full model by node name, sequence file nodes being matched to the shape
+ * with DTSShape::findNode. With --anim-split=sequence (the default) every
+ * sequence goes to directory/<sequence>.fbx, with --anim-split=file every
+ * source goes to directory/<file name>.fbx, see DTSOutputNames for names
+ * that clash. Files are written in parallel, with the built-in binary
+ * writer unless --writer is ascii. sequenceFiles are the paths of files.
+ */
+int exportAnimations(const DTSShape& shape, const std::vector<DTSShape>& files, const char* shapeFile, const std::vector<std::string>& sequenceFiles, const char* directory, const DTSOptions& options);
+
+// Creates directory unless it exists, its parent must. Prints why it can't.
+bool DTSCreateDirectory(const char* directory);
+
+/*
+ * File names, without extension, of outputs named after names (sequences or
+ * source files). Path separators are replaced and "." or ".." prefixed, so
+ * every output stays in its directory. Names equal but for case clash, for
+ * case insensitive file systems: they get "-source" when sources (may be
+ * empty) tell them apart, then a number, with a message.
+ */
+void DTSOutputNames(const std::vector<std::string>& names, const std::vector<std::string>& sources, std::vector<std::string>& fileNames);
+
+#endif
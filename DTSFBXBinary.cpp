@@ -0,0 +1,535 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <zlib.h>
+
+#include "DTSTypes.h"
+#include "DTSThreads.h"
+#include "DTSFBXWriter.h"
+
+// Bytes kept in memory before being written out.
+#define FBX_BUFFER_SIZE (4 << 20)
+
+// Arrays smaller than this are stored raw, larger ones are deflated in
+// blocks of FBX_DEFLATE_BLOCK bytes, one block per task.
+#define FBX_DEFLATE_MIN   128
+#define FBX_DEFLATE_BLOCK (256 << 10)
+
+// Arrays of fewer blocks are deflated on the calling thread, starting
+// workers costs more than it saves.
+#define FBX_DEFLATE_PARALLEL 4
+
+// Window primed from the end of the previous block, so splitting costs
+// almost nothing in ratio.
+#define FBX_DEFLATE_WINDOW 32768
+
+// Offsets past 2 GB, long is 32 bit on some platforms.
+#ifdef WIN32
+#define FBX_FSEEK(file, offset) _fseeki64(file, offset, SEEK_SET)
+#else
+#define FBX_FSEEK(file, offset) fseeko(file, (off_t)(offset), SEEK_SET)
+#endif
+
+// Highest offset of a 7400 file.
+#define FBX_7400_MAX_OFFSET 0xffffffffLL
+
+static const char FBXMagic[23] = "Kaydara FBX Binary  \0\x1a";
+
+// FileId and CreationTime must match the footer id, any matching set is
+// accepted. These are the ones used by most third party writers.
+static const unsigned char FBXFileId[16] =
+{
+    0x28, 0xb3, 0x2a, 0xeb, 0xb6, 0x24, 0xcc, 0xc2,
+    0xbf, 0xc8, 0xb0, 0x2a, 0xa9, 0x2b, 0xfc, 0xf1
+};
+
+static const char FBXCreationTime[] = "1970-01-01 10:00:00:000";
+
+static const unsigned char FBXFooterId[16] =
+{
+    0xfa, 0xbc, 0xab, 0x09, 0xd0, 0xc8, 0xd4, 0x66,
+    0xb1, 0x76, 0xfb, 0x83, 0x1c, 0xf7, 0x26, 0x7e
+};
+
+static const unsigned char FBXFooterMagic[16] =
+{
+    0xf8, 0x5a, 0x8c, 0x6a, 0xde, 0xf5, 0xd9, 0x7e,
+    0xec, 0xe9, 0x0c, 0xe3, 0x75, 0x8f, 0x29, 0x0b
+};
+
+/********************
+ * Deflate          *
+ ********************/
+
+// Compresses one block as raw deflate data. Every block but the last ends
+// with a sync flush, on a byte boundary, so blocks can be concatenated.
+class FBXDeflateTask : public DTSTask
+{
+public:
+    const unsigned char*            data;
+    size_t                          size;
+    std::vector<std::vector<char> > blocks;
+    std::vector<uLong>              checksums;
+    bool                            failed;
+
+    size_t blockSize(int index) const
+    {
+        size_t start = (size_t)index * FBX_DEFLATE_BLOCK;
+
+        return ((size - start) < FBX_DEFLATE_BLOCK) ? (size - start) : FBX_DEFLATE_BLOCK;
+    }
+
+    virtual void run(int index)
+    {
+        size_t             start  = (size_t)index * FBX_DEFLATE_BLOCK;
+        size_t             length = blockSize(index);
+        int                flush  = (index == (int)blocks.size() - 1) ? Z_FINISH : Z_SYNC_FLUSH;
+        std::vector<char>& out(blocks[index]);
+        z_stream           stream;
+        size_t             used = 0;
+
+        memset(&stream, 0, sizeof(stream));
+
+        if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        {
+            failed = true;
+            return;
+        }
+
+        if (index > 0)
+        {
+            size_t window = (start < FBX_DEFLATE_WINDOW) ? start : FBX_DEFLATE_WINDOW;
+
+            deflateSetDictionary(&stream, data + start - window, (uInt)window);
+        }
+
+        out.resize(deflateBound(&stream, (uLong)length) + 16);
+
+        stream.next_in  = (Bytef*)(data + start);
+        stream.avail_in = (uInt)length;
+
+        for (;;)
+        {
+            stream.next_out  = (Bytef*)&out[used];
+            stream.avail_out = (uInt)(out.size() - used);
+
+            int result = deflate(&stream, flush);
+
+            used = out.size() - stream.avail_out;
+
+            if ((result == Z_STREAM_END) || ((flush == Z_SYNC_FLUSH) && (result == Z_OK) && (stream.avail_out > 0)))
+            {
+                break;
+            }
+
+            if ((result != Z_OK) && (result != Z_BUF_ERROR))
+            {
+                failed = true;
+                break;
+            }
+
+            out.resize(out.size() * 2);
+        }
+
+        out.resize(used);
+        checksums[index] = adler32(adler32(0, NULL, 0), data + start, (uInt)length);
+        deflateEnd(&stream);
+    }
+};
+
+bool FBXBinaryEmitter::deflateData(const void* data, size_t size, int threads, std::vector<char>& out)
+{
+    FBXDeflateTask task;
+    int            count = (int)((size + FBX_DEFLATE_BLOCK - 1) / FBX_DEFLATE_BLOCK);
+    int            index;
+
+    task.data   = (const unsigned char*)data;
+    task.size   = size;
+    task.failed = false;
+    task.blocks   .resize(count);
+    task.checksums.resize(count);
+
+    DTSParallelFor(count, task, (count >= FBX_DEFLATE_PARALLEL) ? threads : 1);
+
+    if (task.failed)
+    {
+        return false;
+    }
+
+    // zlib header (deflate, 32K window, default level), the blocks, then
+    // the adler32 of the whole data, big endian.
+    uLong checksum = adler32(0, NULL, 0);
+
+    out.clear();
+    out.push_back((char)0x78);
+    out.push_back((char)0x9c);
+
+    for (index = 0; index < count; index++)
+    {
+        out.insert(out.end(), task.blocks[index].begin(), task.blocks[index].end());
+        checksum = adler32_combine(checksum, task.checksums[index], (z_off_t)task.blockSize(index));
+    }
+
+    out.push_back((char)((checksum >> 24) & 0xff));
+    out.push_back((char)((checksum >> 16) & 0xff));
+    out.push_back((char)((checksum >>  8) & 0xff));
+    out.push_back((char)( checksum        & 0xff));
+    return true;
+}
+
+/********************
+ * Binary emitter   *
+ ********************/
+
+// Values are written in memory order, FBX is little endian like every
+// platform the converter builds on.
+
+FBXBinaryEmitter::FBXBinaryEmitter(int version, int t) :
+    file       (NULL),
+    fileVersion(version),
+    threads    (t),
+    failed     (false),
+    overflowed (false),
+    bufferStart(0)
+{
+}
+
+FBXBinaryEmitter::~FBXBinaryEmitter()
+{
+    if (file)
+    {
+        fclose(file);
+    }
+}
+
+bool FBXBinaryEmitter::open(const char* path)
+{
+    file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    unsigned int version = (unsigned int)fileVersion;
+
+    buffer.reserve(FBX_BUFFER_SIZE);
+    write(FBXMagic, sizeof(FBXMagic));
+    write(&version, 4);
+    return true;
+}
+
+void FBXBinaryEmitter::flush()
+{
+    if (!buffer.empty() && (fwrite(&buffer[0], 1, buffer.size(), file) != buffer.size()))
+    {
+        failed = true;
+    }
+
+    bufferStart += (long long)buffer.size();
+    buffer.clear();
+}
+
+void FBXBinaryEmitter::write(const void* data, size_t size)
+{
+    // Large payloads (compressed arrays) skip the copy.
+    if (size >= FBX_BUFFER_SIZE)
+    {
+        flush();
+
+        if (fwrite(data, 1, size, file) != size)
+        {
+            failed = true;
+        }
+
+        bufferStart += (long long)size;
+        return;
+    }
+
+    buffer.insert(buffer.end(), (const char*)data, (const char*)data + size);
+
+    if (buffer.size() >= FBX_BUFFER_SIZE)
+    {
+        flush();
+    }
+}
+
+// 7400 files can't address past 4 GB, the output fails rather than
+// holding truncated offsets.
+void FBXBinaryEmitter::checkOffset(long long value)
+{
+    if ((fileVersion < 7500) && (value > FBX_7400_MAX_OFFSET) && !overflowed)
+    {
+        fprintf(DTSErrorFile(), "FBX %d files are limited to 4 GB, use --fbx-version=7500\n", fileVersion);
+        overflowed = true;
+        failed     = true;
+    }
+}
+
+void FBXBinaryEmitter::writeOffset(long long value)
+{
+    checkOffset(value);
+
+    if (fileVersion >= 7500)
+    {
+        write(&value, 8);
+    }
+    else
+    {
+        unsigned int narrow = (unsigned int)value;
+
+        write(&narrow, 4);
+    }
+}
+
+void FBXBinaryEmitter::writeNull()
+{
+    static const char zeros[25] = { 0 };
+
+    write(zeros, (fileVersion >= 7500) ? 25 : 13);
+}
+
+void FBXBinaryEmitter::patch(long long offset, long long value)
+{
+    size_t       size   = (fileVersion >= 7500) ? 8 : 4;
+    unsigned int narrow = (unsigned int)value;
+    const void*  data   = (size == 8) ? (const void*)&value : (const void*)&narrow;
+
+    checkOffset(value);
+
+    // Offsets are written by a single write() call, never split by a flush.
+    if (offset >= bufferStart)
+    {
+        memcpy(&buffer[(size_t)(offset - bufferStart)], data, size);
+        return;
+    }
+
+    // Only nodes larger than the buffer (Objects, big geometries) get here.
+    if ((FBX_FSEEK(file, offset) != 0) || (fwrite(data, 1, size, file) != size) || (fseek(file, 0, SEEK_END) != 0))
+    {
+        failed = true;
+    }
+}
+
+void FBXBinaryEmitter::beginNode(const char* name)
+{
+    if (!levels.empty() && (levels.back().length < 0))
+    {
+        levels.back().length = position() - levels.back().properties;
+    }
+
+    Level         level;
+    unsigned char length = (unsigned char)strlen(name);
+
+    level.header = position();
+    level.length = -1;
+    level.count  = 0;
+
+    // End offset, property count and property list length, patched when
+    // the node ends.
+    writeOffset(0);
+    writeOffset(0);
+    writeOffset(0);
+    write(&length, 1);
+    write(name, length);
+
+    level.properties = position();
+    levels.push_back(level);
+}
+
+void FBXBinaryEmitter::endNode()
+{
+    Level& level(levels.back());
+    size_t size     = (fileVersion >= 7500) ? 8 : 4;
+    bool   children = (level.length >= 0);
+
+    if (!children)
+    {
+        level.length = position() - level.properties;
+    }
+
+    // Children, and nodes without anything, end with a null record.
+    if (children || (level.count == 0))
+    {
+        writeNull();
+    }
+
+    patch(level.header,            position());
+    patch(level.header + size,     level.count);
+    patch(level.header + size * 2, level.length);
+    levels.pop_back();
+}
+
+void FBXBinaryEmitter::beginProperty(char type)
+{
+    levels.back().count++;
+    write(&type, 1);
+}
+
+void FBXBinaryEmitter::property(int value)
+{
+    beginProperty('I');
+    write(&value, 4);
+}
+
+void FBXBinaryEmitter::property(long long value)
+{
+    beginProperty('L');
+    write(&value, 8);
+}
+
+void FBXBinaryEmitter::property(double value)
+{
+    beginProperty('D');
+    write(&value, 8);
+}
+
+void FBXBinaryEmitter::writeString(char type, const char* value, size_t size)
+{
+    unsigned int length = (unsigned int)size;
+
+    beginProperty(type);
+    write(&length, 4);
+    write(value, size);
+}
+
+void FBXBinaryEmitter::property(const char* value)
+{
+    writeString('S', value, strlen(value));
+}
+
+void FBXBinaryEmitter::propertyName(const char* className, const char* name)
+{
+    // Binary files store "name\x00\x01Class".
+    std::string full(name);
+
+    full += '\0';
+    full += '\1';
+    full += className;
+    writeString('S', full.data(), full.size());
+}
+
+void FBXBinaryEmitter::writeArray(char type, const void* values, int count, size_t size)
+{
+    std::vector<char> compressed;
+    unsigned int      header[3];
+    size_t            bytes = (size_t)count * size;
+
+    beginProperty(type);
+
+    header[0] = (unsigned int)count;
+
+    if ((bytes >= FBX_DEFLATE_MIN) && deflateData(values, bytes, threads, compressed) && (compressed.size() < bytes))
+    {
+        header[1] = 1;
+        header[2] = (unsigned int)compressed.size();
+        write(header, sizeof(header));
+        write(&compressed[0], compressed.size());
+    }
+    else
+    {
+        header[1] = 0;
+        header[2] = (unsigned int)bytes;
+        write(header, sizeof(header));
+        write(values, bytes);
+    }
+}
+
+void FBXBinaryEmitter::propertyArray(const int* values, int count)
+{
+    writeArray('i', values, count, 4);
+}
+
+void FBXBinaryEmitter::propertyArray(const long long* values, int count)
+{
+    writeArray('l', values, count, 8);
+}
+
+void FBXBinaryEmitter::propertyArray(const float* values, int count)
+{
+    writeArray('f', values, count, 4);
+}
+
+void FBXBinaryEmitter::propertyArray(const double* values, int count)
+{
+    writeArray('d', values, count, 8);
+}
+
+void FBXBinaryEmitter::propertyFloatBits(const int* bits, int count)
+{
+    writeArray('f', bits, count, 4);
+}
+
+void FBXBinaryEmitter::fileHeader()
+{
+    beginNode("FileId");
+    writeString('R', (const char*)FBXFileId, sizeof(FBXFileId));
+    endNode();
+
+    beginNode("CreationTime");
+    property(FBXCreationTime);
+    endNode();
+
+    beginNode("Creator");
+    property("dts2fbx");
+    endNode();
+}
+
+bool FBXBinaryEmitter::close()
+{
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    static const char zeros[128] = { 0 };
+
+    unsigned int version = (unsigned int)fileVersion;
+
+    // End of the top level list, then the footer, its padding aligns the
+    // version on 16 bytes.
+    writeNull();
+    write(FBXFooterId, sizeof(FBXFooterId));
+    write(zeros, 4);
+
+    size_t padding = (size_t)(16 - (position() & 15));
+
+    write(zeros, padding);
+    write(&version, 4);
+    write(zeros, 120);
+    write(FBXFooterMagic, sizeof(FBXFooterMagic));
+    flush();
+
+    if (fclose(file) != 0)
+    {
+        failed = true;
+    }
+
+    file = NULL;
+    return !failed;
+}
@@ -0,0 +1,1243 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+#include <vector>
+#include <map>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSMath.h"
+#include "DTSOptions.h"
+#include "DTSScene.h"
+#include "DTSFBXWriter.h"
+#include "DTSStats.h"
+#include "DTSTrace.h"
+#include "DTSThreads.h"
+
+// FBX time unit, KTime ticks per second.
+#define FBX_TICKS_PER_SECOND 46186158000.0
+
+// Key attributes, as written by the SDK for cubic (auto tangent) and
+// constant keys.
+#define FBX_KEY_CUBIC    0x00000108
+#define FBX_KEY_CONSTANT 0x00000002
+
+/********************
+ * ASCII emitter    *
+ ********************/
+
+FBXAsciiEmitter::FBXAsciiEmitter() :
+    file(NULL)
+{
+}
+
+FBXAsciiEmitter::~FBXAsciiEmitter()
+{
+    if (file)
+    {
+        fclose(file);
+    }
+}
+
+bool FBXAsciiEmitter::open(const char* path)
+{
+    file = fopen(path, "w");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    fprintf(file, "; FBX 7.4.0 project file\n");
+    fprintf(file, "; Created by dts2fbx\n");
+    fprintf(file, "; ----------------------------------------------------\n\n");
+    return true;
+}
+
+void FBXAsciiEmitter::indent(int depth)
+{
+    for (int index = 0; index < depth; index++)
+    {
+        fputc('\t', file);
+    }
+}
+
+void FBXAsciiEmitter::separator()
+{
+    fputs((levels.back().properties++ > 0) ? ", " : " ", file);
+}
+
+void FBXAsciiEmitter::beginNode(const char* name)
+{
+    if (!levels.empty() && !levels.back().open)
+    {
+        fputs(" {\n", file);
+        levels.back().open = true;
+    }
+
+    Level level;
+
+    level.properties = 0;
+    level.open       = false;
+
+    indent((int)levels.size());
+    fprintf(file, "%s:", name);
+    levels.push_back(level);
+}
+
+void FBXAsciiEmitter::endNode()
+{
+    bool open = levels.back().open;
+
+    levels.pop_back();
+
+    if (open)
+    {
+        indent((int)levels.size());
+        fputs("}\n", file);
+    }
+    else
+    {
+        fputs("\n", file);
+    }
+
+    if (levels.empty())
+    {
+        fputs("\n", file);
+    }
+}
+
+void FBXAsciiEmitter::property(int value)
+{
+    separator();
+    fprintf(file, "%d", value);
+}
+
+void FBXAsciiEmitter::property(long long value)
+{
+    separator();
+    fprintf(file, "%lld", value);
+}
+
+void FBXAsciiEmitter::property(double value)
+{
+    separator();
+    fprintf(file, "%.15g", value);
+}
+
+void FBXAsciiEmitter::property(const char* value)
+{
+    separator();
+    fputc('"', file);
+
+    // Text files have no escape sequences, quotes are entities.
+    for (; *value; value++)
+    {
+        if (*value == '"')
+        {
+            fputs("&quot;", file);
+        }
+        else
+        {
+            fputc(*value, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+void FBXAsciiEmitter::propertyName(const char* className, const char* name)
+{
+    std::string full(className);
+
+    full += "::";
+    full += name;
+    property(full.c_str());
+}
+
+// Arrays are the only property of their node, written as a child block.
+#define FBX_ASCII_ARRAY(format)                                           \
+    int depth = (int)levels.size();                                       \
+                                                                          \
+    fprintf(file, " *%d {\n", count);                                     \
+    indent(depth);                                                        \
+    fputs("a: ", file);                                                   \
+                                                                          \
+    for (int index = 0; index < count; index++)                           \
+    {                                                                     \
+        if (index > 0)                                                    \
+        {                                                                 \
+            fputs(((index % 32) == 0) ? ",\n" : ",", file);               \
+        }                                                                 \
+                                                                          \
+        fprintf(file, format, values[index]);                             \
+    }                                                                     \
+                                                                          \
+    fputs("\n", file);                                                    \
+    indent(depth - 1);                                                    \
+    fputs("}", file);                                                     \
+    levels.back().properties++;
+
+void FBXAsciiEmitter::propertyArray(const int* values, int count)
+{
+    FBX_ASCII_ARRAY("%d")
+}
+
+void FBXAsciiEmitter::propertyArray(const long long* values, int count)
+{
+    FBX_ASCII_ARRAY("%lld")
+}
+
+void FBXAsciiEmitter::propertyArray(const float* values, int count)
+{
+    FBX_ASCII_ARRAY("%.9g")
+}
+
+void FBXAsciiEmitter::propertyArray(const double* values, int count)
+{
+    FBX_ASCII_ARRAY("%.15g")
+}
+
+void FBXAsciiEmitter::propertyFloatBits(const int* values, int count)
+{
+    FBX_ASCII_ARRAY("%d")
+}
+
+bool FBXAsciiEmitter::close()
+{
+    bool ok = (file != NULL) && !ferror(file);
+
+    if (file && (fclose(file) != 0))
+    {
+        ok = false;
+    }
+
+    file = NULL;
+    return ok;
+}
+
+/********************
+ * Scene writer     *
+ ********************/
+
+FBXSceneWriter::FBXSceneWriter(const DTSScene& s, const DTSShape& sh, const std::vector<DTSShape>& f, const DTSOptions& o, FBXEmitter& e) :
+    scene  (s),
+    shape  (sh),
+    files  (f),
+    options(o),
+    emitter(e),
+    nextId (1000000)
+{
+}
+
+void FBXSceneWriter::convertPoint(const Point& point, bool invertYZ, Point& out)
+{
+    // Same as the AxisRotation matrix of the SDK exporter.
+    if (invertYZ)
+    {
+        out.x = -point.x * 100.0f;
+        out.y =  point.z * 100.0f;
+        out.z =  point.y * 100.0f;
+    }
+    else
+    {
+        out.x = point.x * 100.0f;
+        out.y = point.y * 100.0f;
+        out.z = point.z * 100.0f;
+    }
+}
+
+void FBXSceneWriter::convertTransform(const Quaternion& rotation, const Point& translation, bool invertYZ, Matrix<4,4>& out)
+{
+    Point scaled;
+
+    convertPoint(translation, false, scaled);
+
+    if (!invertYZ)
+    {
+        DTSMatrixSet(rotation, scaled, out);
+        return;
+    }
+
+    Matrix<4,4> local, axis;
+
+    DTSMatrixSet(rotation, scaled, local);
+    DTSMatrixIdentity(axis);
+    axis.data[0]  = -1.0f;
+    axis.data[5]  =  0.0f; axis.data[6] = 1.0f;
+    axis.data[9]  =  1.0f; axis.data[10] = 0.0f;
+    DTSMatrixMultiply(axis, local, out);
+}
+
+void FBXSceneWriter::convertTransform(const Quaternion& rotation, const Point& translation, bool invertYZ, Point& fbxTranslation, Point& fbxRotation)
+{
+    Matrix<4,4> m;
+
+    convertTransform(rotation, translation, invertYZ, m);
+
+    fbxTranslation.x = m.data[3];
+    fbxTranslation.y = m.data[7];
+    fbxTranslation.z = m.data[11];
+    DTSMatrixEulerXYZ(m, fbxRotation);
+}
+
+static void FBXMatrix(const Matrix<4,4>& m, double* out)
+{
+    // FBX stores matrices column by column.
+    for (int column = 0; column < 4; column++)
+    {
+        for (int row = 0; row < 4; row++)
+        {
+            out[column * 4 + row] = m.data[row * 4 + column];
+        }
+    }
+}
+
+void FBXSceneWriter::connect(long long child, long long parent, const char* property)
+{
+    Connection connection;
+
+    connection.child    = child;
+    connection.parent   = parent;
+    connection.property = property;
+    connections.push_back(connection);
+}
+
+void FBXSceneWriter::property70(const char* name, const char* type, const char* label, const char* flags)
+{
+    emitter.beginNode("P");
+    emitter.property(name);
+    emitter.property(type);
+    emitter.property(label);
+    emitter.property(flags);
+}
+
+void FBXSceneWriter::property70(const char* name, const char* type, const char* label, const char* flags, double value)
+{
+    property70(name, type, label, flags);
+    emitter.property(value);
+    emitter.endNode();
+}
+
+void FBXSceneWriter::property70(const char* name, const char* type, const char* label, const char* flags, long long value)
+{
+    property70(name, type, label, flags);
+    emitter.property(value);
+    emitter.endNode();
+}
+
+void FBXSceneWriter::property70(const char* name, const char* type, const char* label, const char* flags, const Point& value)
+{
+    property70(name, type, label, flags);
+    emitter.property((double)value.x);
+    emitter.property((double)value.y);
+    emitter.property((double)value.z);
+    emitter.endNode();
+}
+
+void FBXSceneWriter::usedNodes(const std::vector<int>& bones, std::vector<bool>& used) const
+{
+    std::vector<int>::const_iterator         it, end(bones.end());
+    std::vector<int>::const_reverse_iterator reverseIt, reverseEnd(scene.order.rend());
+
+    used.assign(scene.nodes.size(), false);
+
+    for (it = bones.begin(); it != end; ++it)
+    {
+        used[*it] = true;
+    }
+
+    // Same selection as FBXExporter::convertSkeleton, bones and ancestors.
+    for (reverseIt = scene.order.rbegin(); reverseIt != reverseEnd; ++reverseIt)
+    {
+        if (used[*reverseIt] && (scene.nodes[*reverseIt].parent != -1))
+        {
+            used[scene.nodes[*reverseIt].parent] = true;
+        }
+    }
+}
+
+void FBXSceneWriter::writeHeader()
+{
+    DTSTraceScope trace("write header");
+
+    time_t     now = time(NULL);
+    struct tm* t   = localtime(&now);
+    double     stop = 0.0;
+
+    emitter.beginNode("FBXHeaderExtension");
+    emitter.beginNode("FBXHeaderVersion"); emitter.property(1003); emitter.endNode();
+    emitter.beginNode("FBXVersion");       emitter.property(emitter.version()); emitter.endNode();
+    emitter.beginNode("CreationTimeStamp");
+    emitter.beginNode("Version");     emitter.property(1000);              emitter.endNode();
+    emitter.beginNode("Year");        emitter.property(t->tm_year + 1900); emitter.endNode();
+    emitter.beginNode("Month");       emitter.property(t->tm_mon + 1);     emitter.endNode();
+    emitter.beginNode("Day");         emitter.property(t->tm_mday);        emitter.endNode();
+    emitter.beginNode("Hour");        emitter.property(t->tm_hour);        emitter.endNode();
+    emitter.beginNode("Minute");      emitter.property(t->tm_min);         emitter.endNode();
+    emitter.beginNode("Second");      emitter.property(t->tm_sec);         emitter.endNode();
+    emitter.beginNode("Millisecond"); emitter.property(0);                 emitter.endNode();
+    emitter.endNode();
+    emitter.beginNode("Creator"); emitter.property("dts2fbx"); emitter.endNode();
+    emitter.endNode();
+    emitter.fileHeader();
+
+    std::vector<DTSSceneAnimation>::const_iterator it, end(scene.animations.end());
+
+    for (it = scene.animations.begin(); it != end; ++it)
+    {
+        const DTSShape& file(((*it).file == -1) ? shape : files[(*it).file]);
+        double          duration = file.sequences[(*it).sequence].duration;
+
+        stop = (duration > stop) ? duration : stop;
+    }
+
+    // Y up, right handed, centimeters, like the SDK default scene.
+    emitter.beginNode("GlobalSettings");
+    emitter.beginNode("Version"); emitter.property(1000); emitter.endNode();
+    emitter.beginNode("Properties70");
+    property70("UpAxis",                  "int",    "Integer", "", (long long)1);
+    property70("UpAxisSign",              "int",    "Integer", "", (long long)1);
+    property70("FrontAxis",               "int",    "Integer", "", (long long)2);
+    property70("FrontAxisSign",           "int",    "Integer", "", (long long)1);
+    property70("CoordAxis",               "int",    "Integer", "", (long long)0);
+    property70("CoordAxisSign",           "int",    "Integer", "", (long long)1);
+    property70("OriginalUpAxis",          "int",    "Integer", "", (long long)1);
+    property70("OriginalUpAxisSign",      "int",    "Integer", "", (long long)1);
+    property70("UnitScaleFactor",         "double", "Number",  "", 1.0);
+    property70("OriginalUnitScaleFactor", "double", "Number",  "", 1.0);
+    property70("TimeSpanStart",           "KTime",  "Time",    "", (long long)0);
+    property70("TimeSpanStop",            "KTime",  "Time",    "", (long long)(stop * FBX_TICKS_PER_SECOND + 0.5));
+    emitter.endNode();
+    emitter.endNode();
+
+    emitter.beginNode("Documents");
+    emitter.beginNode("Count"); emitter.property(1); emitter.endNode();
+    emitter.beginNode("Document");
+    emitter.property(newId());
+    emitter.property("");
+    emitter.property("Scene");
+    emitter.beginNode("Properties70");
+    property70("SourceObject", "object", "", ""); emitter.endNode();
+    emitter.endNode();
+    emitter.beginNode("RootNode"); emitter.property((long long)0); emitter.endNode();
+    emitter.endNode();
+    emitter.endNode();
+
+    emitter.beginNode("References");
+    emitter.endNode();
+}
+
+void FBXSceneWriter::writeDefinitions()
+{
+    DTSTraceScope trace("write definitions");
+
+    // Object counts, computed from the listing without building anything.
+    int models = 0, geometries = 0, attributes = 0, deformers = 0;
+    int stacks = (int)scene.animations.size(), curveNodes = 0, curves = 0;
+
+    std::vector<bool> inSkeleton(scene.nodes.size(), false);
+    std::vector<bool> used;
+
+    models += (scene.numSubshapes > 1) ? scene.numSubshapes : 0;
+
+    std::vector<DTSSceneMesh>::const_iterator meshIt, meshEnd(scene.meshes.end());
+
+    for (meshIt = scene.meshes.begin(); meshIt != meshEnd; ++meshIt)
+    {
+        const DTSMesh& mesh(shape.meshes[(*meshIt).source]);
+
+        models++;
+
+        if (mesh.vertsPerFrame == 0)
+        {
+            continue;
+        }
+
+        geometries++;
+
+        if (mesh.type == DTSMesh::T_Skin)
+        {
+            usedNodes(mesh.nodeIndex, used);
+
+            models++;
+            deformers += 1 + (int)mesh.nodeIndex.size();
+
+            for (size_t index = 0; index < used.size(); index++)
+            {
+                if (used[index])
+                {
+                    models++;
+                    attributes++;
+                    inSkeleton[index] = true;
+                }
+            }
+        }
+    }
+
+    if (scene.meshes.empty() && !scene.nodes.empty())
+    {
+        models    += 1 + (int)scene.nodes.size();
+        attributes = (int)scene.nodes.size();
+        inSkeleton.assign(scene.nodes.size(), true);
+    }
+
+    std::vector<DTSSceneAnimation>::const_iterator animIt, animEnd(scene.animations.end());
+
+    for (animIt = scene.animations.begin(); animIt != animEnd; ++animIt)
+    {
+        const DTSShape&           file(((*animIt).file == -1) ? shape : files[(*animIt).file]);
+        std::vector<DTSNodeTrack> tracks;
+
+        file.sequenceTracks(shape, file.sequences[(*animIt).sequence], tracks);
+
+        std::vector<DTSNodeTrack>::const_iterator it, end(tracks.end());
+
+        for (it = tracks.begin(); it != end; ++it)
+        {
+            int node = ((*animIt).file == -1) ? (*it).fileNode : (*it).node;
+
+            if (((*it).firstRotation < 0) && ((*it).firstTranslation < 0))
+            {
+                continue;
+            }
+
+            if ((node < 0) || (node >= (int)inSkeleton.size()) || !inSkeleton[node])
+            {
+                continue;
+            }
+
+            bool root = (scene.nodes[node].parent == -1);
+
+            curveNodes += (((*it).firstTranslation >= 0) || root) ? 1 : 0;
+            curveNodes += (((*it).firstRotation    >= 0) || root) ? 1 : 0;
+        }
+    }
+
+    curves = curveNodes * 3;
+
+    const char* types[] =
+    {
+        "GlobalSettings", "Model", "Geometry", "NodeAttribute", "Material", "Texture", "Deformer",
+        "AnimationStack", "AnimationLayer", "AnimationCurveNode", "AnimationCurve"
+    };
+
+    int counts[] =
+    {
+        1, models, geometries, attributes, (int)scene.materials.size(), (int)scene.materials.size(), deformers,
+        stacks, stacks, curveNodes, curves
+    };
+
+    int index, total = 0, typeCount = (int)(sizeof(counts) / sizeof(counts[0]));
+
+    for (index = 0; index < typeCount; index++)
+    {
+        total += counts[index];
+    }
+
+    emitter.beginNode("Definitions");
+    emitter.beginNode("Version"); emitter.property(100);   emitter.endNode();
+    emitter.beginNode("Count");   emitter.property(total); emitter.endNode();
+
+    for (index = 0; index < typeCount; index++)
+    {
+        if (counts[index] > 0)
+        {
+            emitter.beginNode("ObjectType");
+            emitter.property(types[index]);
+            emitter.beginNode("Count"); emitter.property(counts[index]); emitter.endNode();
+            emitter.endNode();
+        }
+    }
+
+    emitter.endNode();
+}
+
+void FBXSceneWriter::writeMaterials()
+{
+    DTSTraceScope trace("write materials");
+
+    std::vector<DTSSceneMaterial>::const_iterator it, end(scene.materials.end());
+
+    for (it = scene.materials.begin(); it != end; ++it)
+    {
+        long long materialId = newId();
+        long long textureId  = newId();
+
+        emitter.beginNode("Material");
+        emitter.property(materialId);
+        emitter.propertyName("Material", (*it).name.c_str());
+        emitter.property("");
+        emitter.beginNode("Version");      emitter.property(102);     emitter.endNode();
+        emitter.beginNode("ShadingModel"); emitter.property("phong"); emitter.endNode();
+        emitter.beginNode("MultiLayer");   emitter.property(0);       emitter.endNode();
+        emitter.endNode();
+
+        emitter.beginNode("Texture");
+        emitter.property(textureId);
+        emitter.propertyName("Texture", "Diffuse Texture");
+        emitter.property("");
+        emitter.beginNode("Type");        emitter.property("TextureVideoClip"); emitter.endNode();
+        emitter.beginNode("Version");     emitter.property(202); emitter.endNode();
+        emitter.beginNode("TextureName"); emitter.propertyName("Texture", "Diffuse Texture"); emitter.endNode();
+        emitter.beginNode("Properties70");
+        property70("UseMaterial", "bool", "", "", (long long)1);
+        emitter.endNode();
+        emitter.beginNode("FileName");           emitter.property((*it).path.c_str()); emitter.endNode();
+        emitter.beginNode("RelativeFilename");   emitter.property((*it).path.c_str()); emitter.endNode();
+        emitter.beginNode("ModelUVTranslation"); emitter.property(0.0); emitter.property(0.0); emitter.endNode();
+        emitter.beginNode("ModelUVScaling");     emitter.property(1.0); emitter.property(1.0); emitter.endNode();
+        emitter.beginNode("Texture_Alpha_Source"); emitter.property("None"); emitter.endNode();
+        emitter.beginNode("Cropping");
+        emitter.property(0); emitter.property(0); emitter.property(0); emitter.property(0);
+        emitter.endNode();
+        emitter.endNode();
+
+        connect(textureId, materialId, "DiffuseColor");
+        materialIds.push_back(materialId);
+    }
+}
+
+void FBXSceneWriter::beginModel(long long id, const char* name, const char* type)
+{
+    emitter.beginNode("Model");
+    emitter.property(id);
+    emitter.propertyName("Model", name);
+    emitter.property(type);
+    emitter.beginNode("Version"); emitter.property(232); emitter.endNode();
+}
+
+void FBXSceneWriter::endModel(const Point& translation, const Point& rotation)
+{
+    emitter.beginNode("Properties70");
+    property70("Lcl Translation", "Lcl Translation", "", "A", translation);
+    property70("Lcl Rotation",    "Lcl Rotation",    "", "A", rotation);
+    emitter.endNode();
+    emitter.beginNode("Culling"); emitter.property("CullingOff"); emitter.endNode();
+    emitter.endNode();
+}
+
+void FBXSceneWriter::writeMeshes()
+{
+    long long parentId = 0;
+    int       subshape;
+
+    std::vector<DTSSceneMesh>::const_iterator meshIt(scene.meshes.begin()), meshEnd(scene.meshes.end());
+
+    skeletonIds.assign(scene.nodes.size(), 0);
+
+    // Animation only scenes carry the whole hierarchy, curves are bound to
+    // it by node name.
+    if (scene.meshes.empty() && !scene.nodes.empty())
+    {
+        writeSkeleton(std::vector<bool>(scene.nodes.size(), true), 0);
+        return;
+    }
+
+    for (subshape = 0; subshape < scene.numSubshapes; subshape++)
+    {
+        // A single subshape goes straight under the root.
+        if (scene.numSubshapes > 1)
+        {
+            char  subshapeName[64];
+            Point zero = { 0.0f, 0.0f, 0.0f };
+
+            snprintf(subshapeName, 64, "Subshape %i", subshape);
+
+            parentId = newId();
+            beginModel(parentId, subshapeName, "Null");
+            endModel(zero, zero);
+            connect(parentId, 0);
+        }
+
+        // Meshes are sorted by subshape, each one only lives while written
+        // unless the scene is already filled.
+        for (; (meshIt != meshEnd) && ((*meshIt).subshape == subshape); ++meshIt)
+        {
+            DTSSceneMesh mesh;
+
+            if (scene.filled)
+            {
+                writeMesh(*meshIt, parentId);
+                continue;
+            }
+
+            scene.buildMesh(shape, options, (int)(meshIt - scene.meshes.begin()), mesh);
+            writeMesh(mesh, parentId);
+        }
+    }
+}
+
+void FBXSceneWriter::writeMesh(const DTSSceneMesh& mesh, long long parentId)
+{
+    DTSTraceScope trace("write mesh", mesh.name.c_str());
+
+    long long modelId = newId();
+    Point     translation = { 0.0f, 0.0f, 0.0f };
+    Point     rotation    = { 0.0f, 0.0f, 0.0f };
+    int       index, count = (int)mesh.positions.size();
+
+    if (mesh.node != -1)
+    {
+        const DTSSceneNode& node(scene.nodes[mesh.node]);
+
+        convertTransform(node.rotation, node.translation, false, translation, rotation);
+    }
+
+    beginModel(modelId, mesh.name.c_str(), (count > 0) ? "Mesh" : "Null");
+    endModel(translation, rotation);
+    connect(modelId, parentId);
+
+    if (count == 0)
+    {
+        return;
+    }
+
+    long long           geometryId = newId();
+    int                 triangles  = (int)mesh.indices.size() / 3;
+    std::vector<double> values(count * 3);
+    std::vector<int>    indices(mesh.indices);
+
+    emitter.beginNode("Geometry");
+    emitter.property(geometryId);
+    emitter.propertyName("Geometry", mesh.name.c_str());
+    emitter.property("Mesh");
+
+    for (index = 0; index < count; index++)
+    {
+        Point p;
+
+        convertPoint(mesh.positions[index], true, p);
+        values[index * 3 + 0] = p.x;
+        values[index * 3 + 1] = p.y;
+        values[index * 3 + 2] = p.z;
+    }
+
+    emitter.beginNode("Vertices"); emitter.propertyArray(&values[0], count * 3); emitter.endNode();
+
+    // The last corner of every polygon is stored as -(index + 1).
+    for (index = 2; index < (int)indices.size(); index += 3)
+    {
+        indices[index] = ~indices[index];
+    }
+
+    emitter.beginNode("PolygonVertexIndex");
+    emitter.propertyArray(indices.empty() ? NULL : &indices[0], (int)indices.size());
+    emitter.endNode();
+    emitter.beginNode("GeometryVersion"); emitter.property(124); emitter.endNode();
+
+    for (index = 0; index < count; index++)
+    {
+        values[index * 3 + 0] = mesh.normals[index].x;
+        values[index * 3 + 1] = mesh.normals[index].y;
+        values[index * 3 + 2] = mesh.normals[index].z;
+    }
+
+    emitter.beginNode("LayerElementNormal");
+    emitter.property(0);
+    emitter.beginNode("Version");                  emitter.property(101);        emitter.endNode();
+    emitter.beginNode("Name");                     emitter.property("");         emitter.endNode();
+    emitter.beginNode("MappingInformationType");   emitter.property("ByVertice"); emitter.endNode();
+    emitter.beginNode("ReferenceInformationType"); emitter.property("Direct");   emitter.endNode();
+    emitter.beginNode("Normals"); emitter.propertyArray(&values[0], count * 3); emitter.endNode();
+    emitter.endNode();
+
+    for (index = 0; index < count; index++)
+    {
+        values[index * 2 + 0] = mesh.uvs[index].x;
+        values[index * 2 + 1] = 1.0 - mesh.uvs[index].y;
+    }
+
+    emitter.beginNode("LayerElementUV");
+    emitter.property(0);
+    emitter.beginNode("Version");                  emitter.property(101);        emitter.endNode();
+    emitter.beginNode("Name");                     emitter.property("UV");       emitter.endNode();
+    emitter.beginNode("MappingInformationType");   emitter.property("ByVertice"); emitter.endNode();
+    emitter.beginNode("ReferenceInformationType"); emitter.property("Direct");   emitter.endNode();
+    emitter.beginNode("UV"); emitter.propertyArray(&values[0], count * 2); emitter.endNode();
+    emitter.endNode();
+
+    // Materials are numbered in order of first use, like node->AddMaterial.
+    std::vector<int>  polygonMaterials(triangles);
+    std::vector<int>  modelMaterials;
+    std::map<int,int> materialMap;
+
+    std::vector<DTSSceneMaterialRange>::const_iterator rangeIt, rangeEnd(mesh.ranges.end());
+
+    for (rangeIt = mesh.ranges.begin(); rangeIt != rangeEnd; ++rangeIt)
+    {
+        std::map<int,int>::const_iterator matIt = materialMap.find((*rangeIt).material);
+        int                               local;
+
+        if (matIt == materialMap.end())
+        {
+            local = (int)modelMaterials.size();
+            materialMap.insert(std::pair<int,int>((*rangeIt).material, local));
+            modelMaterials.push_back((*rangeIt).material);
+        }
+        else
+        {
+            local = matIt->second;
+        }
+
+        for (index = 0; index < (*rangeIt).numTriangles; index++)
+        {
+            polygonMaterials[(*rangeIt).firstTriangle + index] = local;
+        }
+    }
+
+    emitter.beginNode("LayerElementMaterial");
+    emitter.property(0);
+    emitter.beginNode("Version");                  emitter.property(101);             emitter.endNode();
+    emitter.beginNode("Name");                     emitter.property("");              emitter.endNode();
+    emitter.beginNode("MappingInformationType");   emitter.property("ByPolygon");     emitter.endNode();
+    emitter.beginNode("ReferenceInformationType"); emitter.property("IndexToDirect"); emitter.endNode();
+    emitter.beginNode("Materials");
+    emitter.propertyArray(polygonMaterials.empty() ? NULL : &polygonMaterials[0], triangles);
+    emitter.endNode();
+    emitter.endNode();
+
+    const char* layers[] = { "LayerElementNormal", "LayerElementUV", "LayerElementMaterial" };
+
+    emitter.beginNode("Layer");
+    emitter.property(0);
+    emitter.beginNode("Version"); emitter.property(100); emitter.endNode();
+
+    for (index = 0; index < 3; index++)
+    {
+        emitter.beginNode("LayerElement");
+        emitter.beginNode("Type");       emitter.property(layers[index]); emitter.endNode();
+        emitter.beginNode("TypedIndex"); emitter.property(0);             emitter.endNode();
+        emitter.endNode();
+    }
+
+    emitter.endNode();
+    emitter.endNode();
+
+    connect(geometryId, modelId);
+
+    std::vector<int>::const_iterator it, end(modelMaterials.end());
+
+    for (it = modelMaterials.begin(); it != end; ++it)
+    {
+        if (*it < (int)materialIds.size())
+        {
+            connect(materialIds[*it], modelId);
+        }
+    }
+
+    if (mesh.skinned)
+    {
+        writeSkeleton(mesh, modelId);
+        writeSkin(mesh, geometryId);
+    }
+}
+
+void FBXSceneWriter::writeSkeleton(const DTSSceneMesh& mesh, long long parentId)
+{
+    std::vector<bool> used;
+
+    usedNodes(mesh.bones, used);
+    writeSkeleton(used, parentId);
+}
+
+void FBXSceneWriter::writeSkeleton(const std::vector<bool>& used, long long parentId)
+{
+    long long skeletonId = newId();
+    Point     zero = { 0.0f, 0.0f, 0.0f };
+
+    beginModel(skeletonId, "Skeleton", "Null");
+    endModel(zero, zero);
+    connect(skeletonId, parentId);
+
+    // Parents come first, their id is always known.
+    std::vector<int>::const_iterator it, end(scene.order.end());
+
+    for (it = scene.order.begin(); it != end; ++it)
+    {
+        int index = *it;
+
+        if (!used[index])
+        {
+            continue;
+        }
+
+        const DTSSceneNode& node(scene.nodes[index]);
+        bool                root        = (node.parent == -1);
+        long long           modelId     = newId();
+        long long           attributeId = newId();
+        const char*         type        = root ? "Root" : "LimbNode";
+        Point               translation, rotation;
+
+        emitter.beginNode("NodeAttribute");
+        emitter.property(attributeId);
+        emitter.propertyName("NodeAttribute", node.name.c_str());
+        emitter.property(type);
+        emitter.beginNode("TypeFlags");
+
+        if (root)
+        {
+            emitter.property("Null");
+        }
+
+        emitter.property("Skeleton");
+
+        if (root)
+        {
+            emitter.property("Root");
+        }
+
+        emitter.endNode();
+        emitter.endNode();
+
+        convertTransform(node.rotation, node.translation, root, translation, rotation);
+        beginModel(modelId, node.name.c_str(), type);
+        endModel(translation, rotation);
+
+        connect(attributeId, modelId);
+        connect(modelId, root ? skeletonId : skeletonIds[node.parent]);
+        skeletonIds[index] = modelId;
+    }
+}
+
+void FBXSceneWriter::writeSkin(const DTSSceneMesh& mesh, long long geometryId)
+{
+    long long skinId = newId();
+
+    emitter.beginNode("Deformer");
+    emitter.property(skinId);
+    emitter.propertyName("Deformer", "");
+    emitter.property("Skin");
+    emitter.beginNode("Version");            emitter.property(101); emitter.endNode();
+    emitter.beginNode("Link_DeformAcuracy"); emitter.property(50.0); emitter.endNode();
+    emitter.endNode();
+    connect(skinId, geometryId);
+
+    if (bindMatrices.empty())
+    {
+        computeBindMatrices();
+    }
+
+    // Global matrix of the mesh model, its parents are at the origin. The
+    // skeleton is under the mesh, bones are at the mesh times their bind.
+    const DTSSkin& skin(mesh.skin);
+    Matrix<4,4>    meshMatrix, linkMatrix;
+    double         matrix[16];
+    int            index;
+
+    if (mesh.node != -1)
+    {
+        const DTSSceneNode& node(scene.nodes[mesh.node]);
+
+        convertTransform(node.rotation, node.translation, false, meshMatrix);
+    }
+    else
+    {
+        DTSMatrixIdentity(meshMatrix);
+    }
+
+    for (index = 0; index < skin.boneCount; index++)
+    {
+        int       node      = mesh.bones[index];
+        long long clusterId = newId();
+        int       first     = skin.boneStarts[index];
+        int       count     = skin.boneStarts[index + 1] - first;
+
+        emitter.beginNode("Deformer");
+        emitter.property(clusterId);
+        emitter.propertyName("SubDeformer", scene.nodes[node].name.c_str());
+        emitter.property("Cluster");
+        emitter.beginNode("Version");  emitter.property(100); emitter.endNode();
+        emitter.beginNode("UserData"); emitter.property("");  emitter.property(""); emitter.endNode();
+
+        if (count > 0)
+        {
+            std::vector<double> weights(skin.weights.begin() + first, skin.weights.begin() + first + count);
+
+            emitter.beginNode("Indexes"); emitter.propertyArray(&skin.vertices[first], count); emitter.endNode();
+            emitter.beginNode("Weights"); emitter.propertyArray(&weights[0], count);          emitter.endNode();
+        }
+
+        FBXMatrix(meshMatrix, matrix);
+        emitter.beginNode("Transform"); emitter.propertyArray(matrix, 16); emitter.endNode();
+        DTSMatrixMultiply(meshMatrix, bindMatrices[node], linkMatrix);
+        FBXMatrix(linkMatrix, matrix);
+        emitter.beginNode("TransformLink"); emitter.propertyArray(matrix, 16); emitter.endNode();
+        emitter.endNode();
+
+        connect(clusterId, skinId);
+        connect(skeletonIds[node], clusterId);
+    }
+}
+
+// Same matrices as FBXExporter::computeBindMatrices.
+void FBXSceneWriter::computeBindMatrices()
+{
+    std::vector<int>::const_iterator nodeIt, nodeEnd(scene.order.end());
+
+    bindMatrices.resize(scene.nodes.size());
+
+    for (nodeIt = scene.order.begin(); nodeIt != nodeEnd; ++nodeIt)
+    {
+        const DTSSceneNode& node(scene.nodes[*nodeIt]);
+
+        if (node.parent == -1)
+        {
+            convertTransform(node.rotation, node.translation, true, bindMatrices[*nodeIt]);
+        }
+        else
+        {
+            Matrix<4,4> local;
+
+            convertTransform(node.rotation, node.translation, false, local);
+            DTSMatrixMultiply(bindMatrices[node.parent], local, bindMatrices[*nodeIt]);
+        }
+    }
+}
+
+void FBXSceneWriter::writeCurves(long long modelId, const char* channel, const char* property, const std::vector<float>* values, const std::vector<long long>& times, int flags, long long layerId)
+{
+    static const char* axes[] = { "d|X", "d|Y", "d|Z" };
+
+    long long nodeId = newId();
+    int       axis, count = (int)times.size();
+    int       data[4] = { 0, 0, 218434821, 0 };
+
+    emitter.beginNode("AnimationCurveNode");
+    emitter.property(nodeId);
+    emitter.propertyName("AnimCurveNode", channel);
+    emitter.property("");
+    emitter.beginNode("Properties70");
+
+    for (axis = 0; axis < 3; axis++)
+    {
+        property70(axes[axis], "Number", "", "A", (double)values[axis][0]);
+    }
+
+    emitter.endNode();
+    emitter.endNode();
+
+    connect(nodeId, layerId);
+    connect(nodeId, modelId, property);
+
+    for (axis = 0; axis < 3; axis++)
+    {
+        long long curveId = newId();
+
+        emitter.beginNode("AnimationCurve");
+        emitter.property(curveId);
+        emitter.propertyName("AnimCurve", "");
+        emitter.property("");
+        emitter.beginNode("Default");          emitter.property((double)values[axis][0]); emitter.endNode();
+        emitter.beginNode("KeyVer");           emitter.property(4009);                    emitter.endNode();
+        emitter.beginNode("KeyTime");          emitter.propertyArray(&times[0], count);   emitter.endNode();
+        emitter.beginNode("KeyValueFloat");    emitter.propertyArray(&values[axis][0], count); emitter.endNode();
+        emitter.beginNode("KeyAttrFlags");     emitter.propertyArray(&flags, 1);          emitter.endNode();
+        emitter.beginNode("KeyAttrDataFloat"); emitter.propertyFloatBits(data, 4);        emitter.endNode();
+        emitter.beginNode("KeyAttrRefCount");  emitter.propertyArray(&count, 1);          emitter.endNode();
+        emitter.endNode();
+
+        connect(curveId, nodeId, axes[axis]);
+    }
+}
+
+void FBXSceneWriter::writeAnimation(const DTSSceneAnimation& animation)
+{
+    DTSTraceScope trace("write animation", animation.name.c_str());
+
+    long long stackId = newId();
+    long long layerId = newId();
+    long long stop    = (long long)(animation.duration * FBX_TICKS_PER_SECOND + 0.5);
+    int       frame, count = animation.numKeyFrames;
+
+    emitter.beginNode("AnimationStack");
+    emitter.property(stackId);
+    emitter.propertyName("AnimStack", animation.name.c_str());
+    emitter.property("");
+    emitter.beginNode("Properties70");
+    property70("LocalStart",     "KTime", "Time", "", (long long)0);
+    property70("LocalStop",      "KTime", "Time", "", stop);
+    property70("ReferenceStart", "KTime", "Time", "", (long long)0);
+    property70("ReferenceStop",  "KTime", "Time", "", stop);
+    emitter.endNode();
+    emitter.endNode();
+
+    emitter.beginNode("AnimationLayer");
+    emitter.property(layerId);
+    emitter.propertyName("AnimLayer", "Base Layer");
+    emitter.property("");
+    emitter.endNode();
+    connect(layerId, stackId);
+
+    if (count <= 0)
+    {
+        return;
+    }
+
+    std::vector<long long> times(count);
+    std::vector<float>     translations[3], rotations[3];
+    double                 timePerFrame = animation.duration / double(count);
+
+    for (frame = 0; frame < count; frame++)
+    {
+        times[frame] = (long long)(timePerFrame * frame * FBX_TICKS_PER_SECOND + 0.5);
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        translations[axis].resize(count);
+        rotations   [axis].resize(count);
+    }
+
+    std::vector<DTSSceneTrack>::const_iterator it, end(animation.tracks.end());
+
+    for (it = animation.tracks.begin(); it != end; ++it)
+    {
+        const DTSSceneTrack& track(*it);
+        int                  node = (animation.file == -1) ? track.fileNode : track.node;
+
+        if ((node < 0) || (node >= (int)skeletonIds.size()) || (skeletonIds[node] == 0))
+        {
+            continue;
+        }
+
+        // Same conversion as FBXExporter::convertAnimation.
+        bool invertYZ          = (scene.nodes[node].parent == -1);
+        bool updateTranslation = track.animatesTranslation || invertYZ;
+        bool updateRotation    = track.animatesRotation    || invertYZ;
+
+        for (frame = 0; frame < count; frame++)
+        {
+            Point translation, rotation;
+
+            convertPoint(track.translations[frame], invertYZ && !track.animatesRotation, translation);
+
+            Point unscaled = { translation.x / 100.0f, translation.y / 100.0f, translation.z / 100.0f };
+
+            convertTransform(track.rotations[frame], unscaled, invertYZ, translation, rotation);
+
+            translations[0][frame] = translation.x;
+            translations[1][frame] = translation.y;
+            translations[2][frame] = translation.z;
+            rotations   [0][frame] = rotation.x;
+            rotations   [1][frame] = rotation.y;
+            rotations   [2][frame] = rotation.z;
+        }
+
+        if (updateTranslation)
+        {
+            writeCurves(skeletonIds[node], "T", "Lcl Translation", translations, times, FBX_KEY_CUBIC, layerId);
+        }
+
+        if (updateRotation)
+        {
+            writeCurves(skeletonIds[node], "R", "Lcl Rotation", rotations, times, FBX_KEY_CONSTANT, layerId);
+        }
+    }
+}
+
+void FBXSceneWriter::writeConnections()
+{
+    DTSTraceScope trace("write connections");
+
+    std::vector<Connection>::const_iterator it, end(connections.end());
+
+    emitter.beginNode("Connections");
+
+    for (it = connections.begin(); it != end; ++it)
+    {
+        emitter.beginNode("C");
+        emitter.property((*it).property ? "OP" : "OO");
+        emitter.property((*it).child);
+        emitter.property((*it).parent);
+
+        if ((*it).property)
+        {
+            emitter.property((*it).property);
+        }
+
+        emitter.endNode();
+    }
+
+    emitter.endNode();
+
+    emitter.beginNode("Takes");
+    emitter.beginNode("Current"); emitter.property(""); emitter.endNode();
+    emitter.endNode();
+}
+
+bool FBXSceneWriter::write()
+{
+    writeHeader();
+    writeDefinitions();
+
+    emitter.beginNode("Objects");
+    writeMaterials();
+    writeMeshes();
+
+    int index, count = (int)scene.animations.size();
+
+    // Sequences are baked one at a time as well.
+    for (index = 0; index < count; index++)
+    {
+        DTSSceneAnimation animation;
+
+        if (scene.filled)
+        {
+            writeAnimation(scene.animations[index]);
+            continue;
+        }
+
+        scene.buildAnimation(shape, files, index, animation);
+        writeAnimation(animation);
+    }
+
+    emitter.endNode();
+
+    writeConnections();
+
+    DTSTraceScope trace("close");
+
+    return emitter.close();
+}
+
+int writeFBX(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const DTSOptions& options, FBXEmitter& emitter)
+{
+    DTSStatsScope  scope(DTSStats::P_Write);
+    FBXSceneWriter writer(scene, shape, files, options, emitter);
+
+    if (!writer.write())
+    {
+        fprintf(DTSErrorFile(), "Failed to produce FBX file\n");
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,268 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSFBXWriter_h
+#define DTSConverter_DTSFBXWriter_h
+
+#include "DTSTypes.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class DTSShape;
+class DTSScene;
+class DTSSceneMesh;
+class DTSSceneAnimation;
+class DTSOptions;
+
+/*
+ * FBX documents are trees of named nodes, each node holding a list of typed
+ * properties (scalars, strings or arrays) followed by its children. An
+ * emitter turns that tree into one of the FBX encodings, node by node,
+ * without keeping the tree in memory.
+ */
+class FBXEmitter
+{
+public:
+    virtual ~FBXEmitter() {}
+
+    virtual void beginNode(const char* name) = 0;
+    virtual void endNode() = 0;
+
+    virtual void property(int value) = 0;
+    virtual void property(long long value) = 0;
+    virtual void property(double value) = 0;
+    virtual void property(const char* value) = 0;
+
+    // Object names, "Class::name" in text files.
+    virtual void propertyName(const char* className, const char* name) = 0;
+
+    virtual void propertyArray(const int*       values, int count) = 0;
+    virtual void propertyArray(const long long* values, int count) = 0;
+    virtual void propertyArray(const float*     values, int count) = 0;
+    virtual void propertyArray(const double*    values, int count) = 0;
+
+    // Float array given by the bits of its values, text files print the
+    // bits as integers (KeyAttrDataFloat).
+    virtual void propertyFloatBits(const int* bits, int count) = 0;
+
+    // Top level nodes specific to the encoding, written right after
+    // FBXHeaderExtension.
+    virtual void fileHeader() {}
+
+    // FBXVersion of the document.
+    virtual int version() const { return 7400; }
+
+    // Returns false if anything failed to be written.
+    virtual bool close() = 0;
+};
+
+class FBXAsciiEmitter : public FBXEmitter
+{
+protected:
+    class Level
+    {
+    public:
+        int  properties;
+        bool open;
+    };
+
+    FILE*              file;
+    std::vector<Level> levels;
+
+    void indent(int depth);
+    void separator();
+
+public:
+    FBXAsciiEmitter();
+    virtual ~FBXAsciiEmitter();
+
+    bool open(const char* path);
+
+    virtual void beginNode(const char* name);
+    virtual void endNode();
+
+    virtual void property(int value);
+    virtual void property(long long value);
+    virtual void property(double value);
+    virtual void property(const char* value);
+    virtual void propertyName(const char* className, const char* name);
+
+    virtual void propertyArray(const int*       values, int count);
+    virtual void propertyArray(const long long* values, int count);
+    virtual void propertyArray(const float*     values, int count);
+    virtual void propertyArray(const double*    values, int count);
+    virtual void propertyFloatBits(const int* bits, int count);
+
+    virtual bool close();
+};
+
+/*
+ * Binary FBX 7.4 (32 bit offsets) or 7.5 (64 bit offsets). Records are
+ * appended to a large buffer written with few fwrite calls, the offsets of
+ * open nodes are patched once they end. Large arrays are deflated in blocks
+ * by worker threads, while records stay in document order.
+ */
+class FBXBinaryEmitter : public FBXEmitter
+{
+protected:
+    class Level
+    {
+    public:
+        long long header;       // file offset of the record
+        long long properties;   // file offset of the property list
+        long long length;       // of the property list, -1 until known
+        int       count;        // number of properties
+    };
+
+    FILE*              file;
+    int                fileVersion;
+    int                threads;
+    bool               failed;
+    bool               overflowed;  // past the offsets of the version
+    std::vector<char>  buffer;
+    long long          bufferStart; // file offset of buffer[0]
+    std::vector<Level> levels;
+
+    long long position() const { return bufferStart + (long long)buffer.size(); }
+
+    void write(const void* data, size_t size);
+    void checkOffset(long long value);
+    void writeOffset(long long value);
+    void writeNull();
+    void patch(long long offset, long long value);
+    void flush();
+
+    void beginProperty(char type);
+    void writeString(char type, const char* value, size_t size);
+    void writeArray(char type, const void* values, int count, size_t size);
+
+public:
+    FBXBinaryEmitter(int version = 7400, int threads = 0);
+    virtual ~FBXBinaryEmitter();
+
+    bool open(const char* path);
+
+    virtual void beginNode(const char* name);
+    virtual void endNode();
+
+    virtual void property(int value);
+    virtual void property(long long value);
+    virtual void property(double value);
+    virtual void property(const char* value);
+    virtual void propertyName(const char* className, const char* name);
+
+    virtual void propertyArray(const int*       values, int count);
+    virtual void propertyArray(const long long* values, int count);
+    virtual void propertyArray(const float*     values, int count);
+    virtual void propertyArray(const double*    values, int count);
+    virtual void propertyFloatBits(const int* bits, int count);
+
+    virtual void fileHeader();
+    virtual int  version() const { return fileVersion; }
+
+    virtual bool close();
+
+    // zlib stream of data, deflated in blocks on up to threads threads.
+    static bool deflateData(const void* data, size_t size, int threads, std::vector<char>& out);
+};
+
+/*
+ * Writes a FBX 7.4 document without the FBX SDK. The scene only needs to be
+ * listed (DTSScene::list), meshes and sequences are built one at a time
+ * while they are written, so memory stays bounded by the largest of them.
+ * A filled scene is written as is, it is only read.
+ *
+ * The output matches the SDK exporter: y up, centimeters, one skeleton per
+ * skinned mesh, one animation stack per sequence.
+ */
+class FBXSceneWriter
+{
+protected:
+    class Connection
+    {
+    public:
+        long long   child;
+        long long   parent;
+        const char* property;
+    };
+
+    const DTSScene&              scene;
+    const DTSShape&              shape;
+    const std::vector<DTSShape>& files;
+    const DTSOptions&            options;
+    FBXEmitter&                  emitter;
+
+    long long               nextId;
+    std::vector<long long>  materialIds;
+    std::vector<long long>  skeletonIds;
+    std::vector<Connection> connections;
+
+    // Default pose of every node relative to the skeleton root, computed
+    // with the first skin.
+    std::vector<Matrix<4,4> > bindMatrices;
+
+    long long newId() { return nextId++; }
+    void connect(long long child, long long parent, const char* property = NULL);
+
+    void writeHeader();
+    void writeDefinitions();
+    void writeMaterials();
+    void writeMeshes();
+    void writeMesh(const DTSSceneMesh& mesh, long long parentId);
+    void writeSkeleton(const DTSSceneMesh& mesh, long long parentId);
+    void writeSkeleton(const std::vector<bool>& used, long long parentId);
+    void writeSkin(const DTSSceneMesh& mesh, long long geometryId);
+    void computeBindMatrices();
+    void writeAnimation(const DTSSceneAnimation& animation);
+    void writeCurves(long long modelId, const char* channel, const char* property, const std::vector<float>* values, const std::vector<long long>& times, int flags, long long layerId);
+    void writeConnections();
+
+    void beginModel(long long id, const char* name, const char* type);
+    void endModel(const Point& translation, const Point& rotation);
+
+    void property70(const char* name, const char* type, const char* label, const char* flags);
+    void property70(const char* name, const char* type, const char* label, const char* flags, double value);
+    void property70(const char* name, const char* type, const char* label, const char* flags, long long value);
+    void property70(const char* name, const char* type, const char* label, const char* flags, const Point& value);
+
+    void usedNodes(const std::vector<int>& bones, std::vector<bool>& used) const;
+
+public:
+    FBXSceneWriter(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const DTSOptions& options, FBXEmitter& emitter);
+
+    bool write();
+
+    // DTS transform to FBX local translation (centimeters) and euler
+    // rotation (degrees), invertYZ for the nodes directly under the root.
+    static void convertTransform(const Quaternion& rotation, const Point& translation, bool invertYZ, Matrix<4,4>& out);
+    static void convertTransform(const Quaternion& rotation, const Point& translation, bool invertYZ, Point& fbxTranslation, Point& fbxRotation);
+    static void convertPoint(const Point& point, bool invertYZ, Point& out);
+};
+
+// Converts a shape and its sequence files to a FBX file with the given
+// emitter, returns 0 on success and -1 on failure.
+int writeFBX(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const DTSOptions& options, FBXEmitter& emitter);
+
+#endif
@@ -0,0 +1,728 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <vector>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSMath.h"
+#include "DTSOptions.h"
+#include "DTSScene.h"
+#include "DTSGLTF.h"
+#include "DTSStats.h"
+#include "DTSTrace.h"
+#include "DTSThreads.h"
+
+// Component types and buffer view targets.
+#define GLTF_BYTE           5120
+#define GLTF_SHORT          5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT   5125
+#define GLTF_FLOAT          5126
+
+#define GLTF_ARRAY_BUFFER         34962
+#define GLTF_ELEMENT_ARRAY_BUFFER 34963
+
+#define GLB_MAGIC      0x46546c67
+#define GLB_CHUNK_JSON 0x4e4f534a
+#define GLB_CHUNK_BIN  0x004e4942
+
+GLTFWriter::GLTFWriter(const DTSScene& sc, const DTSShape& s, const std::vector<DTSShape>& f, const DTSOptions& options) :
+    scene        (sc),
+    shape        (s),
+    files        (f),
+    normalBits   (options.quantize),
+    bufferSize   (0),
+    accessorCount(0),
+    meshCount    (0),
+    skinCount    (0)
+{
+}
+
+void GLTFWriter::append(std::string& out, const char* format, ...)
+{
+    char    text[256];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+
+    out += text;
+}
+
+void GLTFWriter::appendString(std::string& out, const char* value)
+{
+    out += '"';
+
+    for (; *value; value++)
+    {
+        if ((*value == '"') || (*value == '\\'))
+        {
+            out += '\\';
+            out += *value;
+        }
+        else if ((unsigned char)*value < 0x20)
+        {
+            append(out, "\\u%04x", (unsigned char)*value);
+        }
+        else
+        {
+            out += *value;
+        }
+    }
+
+    out += '"';
+}
+
+void GLTFWriter::item(std::string& section)
+{
+    if (!section.empty())
+    {
+        section += ',';
+    }
+}
+
+int GLTFWriter::addView(const void* data, size_t size, int stride, int target)
+{
+    View view;
+
+    view.data   = data;
+    view.size   = size;
+    view.offset = bufferSize;
+    view.stride = stride;
+    view.target = target;
+    views.push_back(view);
+
+    // Every view starts on 4 bytes, the widest component.
+    bufferSize += (size + 3) & ~(size_t)3;
+
+    item(bufferViews);
+    append(bufferViews, "{\"buffer\":0,\"byteOffset\":%lu,\"byteLength\":%lu", (unsigned long)view.offset, (unsigned long)size);
+
+    if (stride > 0)
+    {
+        append(bufferViews, ",\"byteStride\":%d", stride);
+    }
+
+    if (target > 0)
+    {
+        append(bufferViews, ",\"target\":%d", target);
+    }
+
+    bufferViews += '}';
+    return (int)views.size() - 1;
+}
+
+int GLTFWriter::addAccessor(int view, size_t offset, int componentType, bool normalized, int count, const char* type, const std::string& bounds)
+{
+    item(accessors);
+    append(accessors, "{\"bufferView\":%d,\"byteOffset\":%lu,\"componentType\":%d,\"count\":%d,\"type\":\"%s\"", view, (unsigned long)offset, componentType, count, type);
+
+    if (normalized)
+    {
+        accessors += ",\"normalized\":true";
+    }
+
+    accessors += bounds;
+    accessors += '}';
+    return accessorCount++;
+}
+
+void GLTFWriter::writeMaterials()
+{
+    DTSTraceScope trace("write materials");
+
+    std::vector<DTSSceneMaterial>::const_iterator it, end(scene.materials.end());
+    int                                           texture = 0;
+
+    for (it = scene.materials.begin(); it != end; ++it)
+    {
+        item(materials);
+        materials += "{\"name\":";
+        appendString(materials, (*it).name.c_str());
+        materials += ",\"pbrMetallicRoughness\":{\"metallicFactor\":0.0";
+
+        if (!(*it).path.empty())
+        {
+            std::string uri;
+
+            // Relative references are URIs, only the characters found in
+            // texture paths are escaped.
+            for (const char* c = (*it).path.c_str(); *c; c++)
+            {
+                if (*c == '\\')
+                {
+                    uri += '/';
+                }
+                else if ((*c == ' ') || (*c == '%') || (*c == '#') || (*c == '?'))
+                {
+                    append(uri, "%%%02X", (unsigned char)*c);
+                }
+                else
+                {
+                    uri += *c;
+                }
+            }
+
+            item(images);
+            images += "{\"uri\":";
+            appendString(images, uri.c_str());
+            images += '}';
+
+            item(textures);
+            append(textures, "{\"source\":%d}", texture);
+            append(materials, ",\"baseColorTexture\":{\"index\":%d}", texture++);
+        }
+
+        materials += "}}";
+    }
+}
+
+void GLTFWriter::writeMesh(const DTSSceneMesh& mesh, const DTSQuantizedMesh* q, std::string& primitives, std::string& attributes)
+{
+    DTSTraceScope trace("write mesh", mesh.name.c_str());
+
+    int         count = (int)mesh.positions.size();
+    int         view, index;
+    std::string bounds;
+
+    // POSITION needs its bounds, in quantized units when quantized.
+    if (q)
+    {
+        append(bounds, ",\"min\":[%d,%d,%d],\"max\":[%d,%d,%d]", q->low[0], q->low[1], q->low[2], q->high[0], q->high[1], q->high[2]);
+
+        view = addView(&q->positions[0], q->positions.size() * sizeof(short), 4 * sizeof(short), GLTF_ARRAY_BUFFER);
+        append(attributes, "\"POSITION\":%d", addAccessor(view, 0, GLTF_SHORT, true, count, "VEC3", bounds));
+    }
+    else
+    {
+        Point low(mesh.positions[0]), high(mesh.positions[0]);
+
+        for (index = 1; index < count; index++)
+        {
+            const Point& p(mesh.positions[index]);
+
+            low.x  = (p.x < low.x)  ? p.x : low.x;  low.y  = (p.y < low.y)  ? p.y : low.y;  low.z  = (p.z < low.z)  ? p.z : low.z;
+            high.x = (p.x > high.x) ? p.x : high.x; high.y = (p.y > high.y) ? p.y : high.y; high.z = (p.z > high.z) ? p.z : high.z;
+        }
+
+        append(bounds, ",\"min\":[%.9g,%.9g,%.9g],\"max\":[%.9g,%.9g,%.9g]", low.x, low.y, low.z, high.x, high.y, high.z);
+
+        view = addView(&mesh.positions[0], count * sizeof(Point), 0, GLTF_ARRAY_BUFFER);
+        append(attributes, "\"POSITION\":%d", addAccessor(view, 0, GLTF_FLOAT, false, count, "VEC3", bounds));
+    }
+
+    if (q && !q->normals8.empty())
+    {
+        view = addView(&q->normals8[0], q->normals8.size(), 4, GLTF_ARRAY_BUFFER);
+        append(attributes, ",\"NORMAL\":%d", addAccessor(view, 0, GLTF_BYTE, true, count, "VEC3"));
+    }
+    else if (q && !q->normals16.empty())
+    {
+        view = addView(&q->normals16[0], q->normals16.size() * sizeof(short), 4 * sizeof(short), GLTF_ARRAY_BUFFER);
+        append(attributes, ",\"NORMAL\":%d", addAccessor(view, 0, GLTF_SHORT, true, count, "VEC3"));
+    }
+    else if ((int)mesh.normals.size() == count)
+    {
+        view = addView(&mesh.normals[0], count * sizeof(Point), 0, GLTF_ARRAY_BUFFER);
+        append(attributes, ",\"NORMAL\":%d", addAccessor(view, 0, GLTF_FLOAT, false, count, "VEC3"));
+    }
+
+    // uvs outside [0, 1] stay floats.
+    if (q && !q->uvs.empty())
+    {
+        view = addView(&q->uvs[0], q->uvs.size() * sizeof(unsigned short), 0, GLTF_ARRAY_BUFFER);
+        append(attributes, ",\"TEXCOORD_0\":%d", addAccessor(view, 0, GLTF_UNSIGNED_SHORT, true, count, "VEC2"));
+    }
+    else if ((int)mesh.uvs.size() == count)
+    {
+        view = addView(&mesh.uvs[0], count * sizeof(Point2D), 0, GLTF_ARRAY_BUFFER);
+        append(attributes, ",\"TEXCOORD_0\":%d", addAccessor(view, 0, GLTF_FLOAT, false, count, "VEC2"));
+    }
+
+    const DTSSkin& skin(mesh.skin);
+    int            width = skin.influencesPerVertex;
+
+    // Skin streams hold a multiple of 4 influences per vertex, each set of
+    // 4 is an accessor at its offset in the interleaved view.
+    if (mesh.skinned && (width > 0))
+    {
+        int jointView  = addView(&skin.joints[0],        count * width * sizeof(unsigned short), width * (int)sizeof(unsigned short), GLTF_ARRAY_BUFFER);
+        int weightView = addView(&skin.vertexWeights[0], count * width * sizeof(float),          width * (int)sizeof(float),          GLTF_ARRAY_BUFFER);
+
+        for (index = 0; index < width / 4; index++)
+        {
+            append(attributes, ",\"JOINTS_%d\":%d",  index, addAccessor(jointView,  index * 4 * sizeof(unsigned short), GLTF_UNSIGNED_SHORT, false, count, "VEC4"));
+            append(attributes, ",\"WEIGHTS_%d\":%d", index, addAccessor(weightView, index * 4 * sizeof(float),          GLTF_FLOAT,          false, count, "VEC4"));
+        }
+    }
+
+    if (mesh.indices.empty())
+    {
+        return;
+    }
+
+    // One primitive per material range, all reading the same index view.
+    view = addView(&mesh.indices[0], mesh.indices.size() * sizeof(int), 0, GLTF_ELEMENT_ARRAY_BUFFER);
+
+    std::vector<DTSSceneMaterialRange>::const_iterator it, end(mesh.ranges.end());
+
+    for (it = mesh.ranges.begin(); it != end; ++it)
+    {
+        if ((*it).numTriangles == 0)
+        {
+            continue;
+        }
+
+        item(primitives);
+        primitives += "{\"attributes\":{";
+        primitives += attributes;
+        append(primitives, "},\"indices\":%d", addAccessor(view, (*it).firstTriangle * 3 * sizeof(int), GLTF_UNSIGNED_INT, false, (*it).numTriangles * 3, "SCALAR"));
+
+        if (((*it).material >= 0) && ((*it).material < (int)scene.materials.size()))
+        {
+            append(primitives, ",\"material\":%d", (*it).material);
+        }
+
+        primitives += '}';
+    }
+}
+
+void GLTFWriter::writeSkin(const DTSSceneMesh& mesh, const DTSQuantizedMesh* q)
+{
+    int index, count = (int)mesh.bones.size();
+
+    // Inverse of the default world transform of every bone, column major.
+    bindMatrices.push_back(std::vector<float>(count * 16));
+
+    std::vector<float>& matrices(bindMatrices.back());
+    Matrix<4,4>         dequantize;
+
+    // Skinning ignores the node of the mesh, quantized positions are
+    // scaled back by the inverse bind matrices instead.
+    DTSMatrixIdentity(dequantize);
+
+    if (q)
+    {
+        dequantize.data[0]  = q->extent.x; dequantize.data[3]  = q->center.x;
+        dequantize.data[5]  = q->extent.y; dequantize.data[7]  = q->center.y;
+        dequantize.data[10] = q->extent.z; dequantize.data[11] = q->center.z;
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        Matrix<4,4> inverse, matrix;
+
+        DTSMatrixInverseRigid(scene.nodes[mesh.bones[index]].world, inverse);
+        DTSMatrixMultiply(inverse, dequantize, matrix);
+
+        for (int column = 0; column < 4; column++)
+        {
+            for (int row = 0; row < 4; row++)
+            {
+                matrices[index * 16 + column * 4 + row] = matrix.data[row * 4 + column];
+            }
+        }
+    }
+
+    int view = addView(&matrices[0], matrices.size() * sizeof(float), 0, 0);
+
+    item(skins);
+    append(skins, "{\"inverseBindMatrices\":%d,\"joints\":[", addAccessor(view, 0, GLTF_FLOAT, false, count, "MAT4"));
+
+    for (index = 0; index < count; index++)
+    {
+        append(skins, (index > 0) ? ",%d" : "%d", mesh.bones[index]);
+    }
+
+    skins += "]}";
+    skinCount++;
+}
+
+void GLTFWriter::writeMeshes(std::vector<std::string>& children, std::vector<std::string>& meshNodes)
+{
+    int root = (int)scene.nodes.size();
+
+    std::vector<DTSSceneMesh>::const_iterator it, end(scene.meshes.end());
+
+    bindMatrices.reserve(scene.meshes.size());
+    quantized   .reserve(scene.meshes.size());
+
+    for (it = scene.meshes.begin(); it != end; ++it)
+    {
+        const DTSSceneMesh& mesh(*it);
+        std::string         primitives, attributes;
+
+        if (mesh.positions.empty())
+        {
+            continue;
+        }
+
+        const DTSQuantizedMesh* q = NULL;
+
+        if (normalBits > 0)
+        {
+            quantized.push_back(DTSQuantizedMesh());
+            quantized.back().build(mesh, shape.meshes[mesh.source], normalBits);
+            q = &quantized.back();
+        }
+
+        writeMesh(mesh, q, primitives, attributes);
+
+        if (primitives.empty())
+        {
+            continue;
+        }
+
+        item(meshes);
+        meshes += "{\"name\":";
+        appendString(meshes, mesh.name.c_str());
+        meshes += ",\"primitives\":[";
+        meshes += primitives;
+        meshes += "]}";
+
+        // Rigid meshes follow their node, skinned meshes sit under the root
+        // since glTF ignores the transform of their node.
+        bool        skinned = mesh.skinned && (mesh.skin.influencesPerVertex > 0);
+        int         parent  = (skinned || (mesh.node == -1)) ? root : mesh.node;
+        std::string node("{\"name\":");
+
+        appendString(node, mesh.name.c_str());
+        append(node, ",\"mesh\":%d", meshCount++);
+
+        if (skinned)
+        {
+            append(node, ",\"skin\":%d", skinCount);
+            writeSkin(mesh, q);
+        }
+        else if (q)
+        {
+            append(node, ",\"translation\":[%.9g,%.9g,%.9g]", q->center.x, q->center.y, q->center.z);
+            append(node, ",\"scale\":[%.9g,%.9g,%.9g]", q->extent.x, q->extent.y, q->extent.z);
+        }
+
+        node += '}';
+
+        item(children[parent]);
+        append(children[parent], "%d", root + 1 + (int)meshNodes.size());
+        meshNodes.push_back(node);
+    }
+}
+
+void GLTFWriter::writeNodes(const std::vector<std::string>& children, const std::vector<std::string>& meshNodes)
+{
+    DTSTraceScope trace("write nodes");
+
+    int index, count = (int)scene.nodes.size();
+
+    for (index = 0; index < count; index++)
+    {
+        const DTSSceneNode& node(scene.nodes[index]);
+
+        // DTS quaternions are inverted compared to glTF ones.
+        item(nodes);
+        nodes += "{\"name\":";
+        appendString(nodes, node.name.c_str());
+        append(nodes, ",\"rotation\":[%.9g,%.9g,%.9g,%.9g]", -node.rotation.x, -node.rotation.y, -node.rotation.z, node.rotation.w);
+        append(nodes, ",\"translation\":[%.9g,%.9g,%.9g]", node.translation.x, node.translation.y, node.translation.z);
+
+        if (!children[index].empty())
+        {
+            nodes += ",\"children\":[";
+            nodes += children[index];
+            nodes += ']';
+        }
+
+        nodes += '}';
+    }
+
+    // Half turn around (0, 1, 1), the same axis change as the FBX writers:
+    // (x, y, z) becomes (-x, z, y).
+    item(nodes);
+    nodes += "{\"name\":\"Root\",\"rotation\":[0,0.707106781,0.707106781,0]";
+
+    if (!children[count].empty())
+    {
+        nodes += ",\"children\":[";
+        nodes += children[count];
+        nodes += ']';
+    }
+
+    nodes += '}';
+
+    std::vector<std::string>::const_iterator it, end(meshNodes.end());
+
+    for (it = meshNodes.begin(); it != end; ++it)
+    {
+        item(nodes);
+        nodes += *it;
+    }
+}
+
+void GLTFWriter::writeAnimations()
+{
+    DTSTraceScope trace("write animations");
+
+    std::vector<DTSSceneAnimation>::const_iterator it, end(scene.animations.end());
+    std::vector<DTSSceneTrack>::const_iterator     trackIt, trackEnd;
+    size_t                                         keys = 0;
+
+    // Rotation keys are the only ones converted, into one array sized up
+    // front so the views into it stay valid.
+    for (it = scene.animations.begin(); it != end; ++it)
+    {
+        for (trackIt = (*it).tracks.begin(), trackEnd = (*it).tracks.end(); trackIt != trackEnd; ++trackIt)
+        {
+            keys += ((*trackIt).animatesRotation && ((*trackIt).node != -1)) ? (*it).numKeyFrames : 0;
+        }
+    }
+
+    rotationKeys.resize(keys);
+    keyTimes.reserve(scene.animations.size());
+    keys = 0;
+
+    for (it = scene.animations.begin(); it != end; ++it)
+    {
+        const DTSSceneAnimation& animation(*it);
+        int                count = animation.numKeyFrames;
+        int                frame, samplerCount = 0;
+        std::string        samplers, channels;
+
+        if (count == 0)
+        {
+            continue;
+        }
+
+        // Same key times as the FBX writers.
+        keyTimes.push_back(std::vector<float>(count));
+
+        std::vector<float>& times(keyTimes.back());
+
+        for (frame = 0; frame < count; frame++)
+        {
+            times[frame] = animation.duration / count * frame;
+        }
+
+        std::string bounds;
+
+        append(bounds, ",\"min\":[%.9g],\"max\":[%.9g]", times[0], times[count - 1]);
+
+        int input = addAccessor(addView(&times[0], count * sizeof(float), 0, 0), 0, GLTF_FLOAT, false, count, "SCALAR", bounds);
+
+        for (trackIt = animation.tracks.begin(), trackEnd = animation.tracks.end(); trackIt != trackEnd; ++trackIt)
+        {
+            const DTSSceneTrack& track(*trackIt);
+
+            if (track.node == -1)
+            {
+                continue;
+            }
+
+            if (track.animatesRotation)
+            {
+                // DTS quaternions are inverted compared to glTF ones.
+                Quaternion* rotations = &rotationKeys[keys];
+
+                for (frame = 0; frame < count; frame++)
+                {
+                    rotations[frame].x = -track.rotations[frame].x;
+                    rotations[frame].y = -track.rotations[frame].y;
+                    rotations[frame].z = -track.rotations[frame].z;
+                    rotations[frame].w =  track.rotations[frame].w;
+                }
+
+                keys += count;
+
+                int output = addAccessor(addView(rotations, count * sizeof(Quaternion), 0, 0), 0, GLTF_FLOAT, false, count, "VEC4");
+
+                item(samplers);
+                append(samplers, "{\"input\":%d,\"output\":%d,\"interpolation\":\"LINEAR\"}", input, output);
+                item(channels);
+                append(channels, "{\"sampler\":%d,\"target\":{\"node\":%d,\"path\":\"rotation\"}}", samplerCount++, track.node);
+            }
+
+            if (track.animatesTranslation)
+            {
+                int output = addAccessor(addView(&track.translations[0], count * sizeof(Point), 0, 0), 0, GLTF_FLOAT, false, count, "VEC3");
+
+                item(samplers);
+                append(samplers, "{\"input\":%d,\"output\":%d,\"interpolation\":\"LINEAR\"}", input, output);
+                item(channels);
+                append(channels, "{\"sampler\":%d,\"target\":{\"node\":%d,\"path\":\"translation\"}}", samplerCount++, track.node);
+            }
+        }
+
+        if (samplerCount == 0)
+        {
+            continue;
+        }
+
+        item(animations);
+        animations += "{\"name\":";
+        appendString(animations, animation.name.c_str());
+        animations += ",\"samplers\":[";
+        animations += samplers;
+        animations += "],\"channels\":[";
+        animations += channels;
+        animations += "]}";
+    }
+}
+
+bool GLTFWriter::writeFile(const char* path)
+{
+    DTSTraceScope trace("write file", path);
+
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    static const char zeros[4] = { 0, 0, 0, 0 };
+
+    // Chunks are 4 bytes aligned, JSON is padded with spaces.
+    while (json.size() & 3)
+    {
+        json += ' ';
+    }
+
+    unsigned int header[3], chunk[2];
+
+    header[0] = GLB_MAGIC;
+    header[1] = 2;
+    header[2] = (unsigned int)(sizeof(header) + sizeof(chunk) + json.size() + (bufferSize ? sizeof(chunk) + bufferSize : 0));
+    fwrite(header, sizeof(header), 1, file);
+
+    chunk[0] = (unsigned int)json.size();
+    chunk[1] = GLB_CHUNK_JSON;
+    fwrite(chunk, sizeof(chunk), 1, file);
+    fwrite(json.data(), 1, json.size(), file);
+
+    if (bufferSize > 0)
+    {
+        chunk[0] = (unsigned int)bufferSize;
+        chunk[1] = GLB_CHUNK_BIN;
+        fwrite(chunk, sizeof(chunk), 1, file);
+
+        // Straight from the scene arrays, no staging copy.
+        std::vector<View>::const_iterator it, end(views.end());
+
+        for (it = views.begin(); it != end; ++it)
+        {
+            fwrite((*it).data, 1, (*it).size, file);
+            fwrite(zeros, 1, ((*it).size + 3) / 4 * 4 - (*it).size, file);
+        }
+    }
+
+    bool ok = !ferror(file);
+
+    if (fclose(file) != 0)
+    {
+        ok = false;
+    }
+
+    return ok;
+}
+
+bool GLTFWriter::write(const char* path)
+{
+    std::vector<std::string> children(scene.nodes.size() + 1);
+    std::vector<std::string> meshNodes;
+    int                      index;
+
+    for (index = 0; index < (int)scene.nodes.size(); index++)
+    {
+        int parent = scene.nodes[index].parent;
+
+        parent = (parent == -1) ? (int)scene.nodes.size() : parent;
+        item(children[parent]);
+        append(children[parent], "%d", index);
+    }
+
+    writeMaterials();
+    writeMeshes(children, meshNodes);
+    writeNodes(children, meshNodes);
+    writeAnimations();
+
+    json = "{\"asset\":{\"version\":\"2.0\",\"generator\":\"dts2fbx\"}";
+
+    if (!quantized.empty())
+    {
+        json += ",\"extensionsUsed\":[\"KHR_mesh_quantization\"],\"extensionsRequired\":[\"KHR_mesh_quantization\"]";
+    }
+
+    append(json, ",\"scene\":0,\"scenes\":[{\"nodes\":[%d]}]", (int)scene.nodes.size());
+
+    const char*        names[]    = { "nodes", "meshes", "skins", "animations", "materials", "textures", "images", "accessors", "bufferViews" };
+    const std::string* sections[] = { &nodes, &meshes, &skins, &animations, &materials, &textures, &images, &accessors, &bufferViews };
+
+    for (index = 0; index < 9; index++)
+    {
+        if (!sections[index]->empty())
+        {
+            append(json, ",\"%s\":[", names[index]);
+            json += *sections[index];
+            json += ']';
+        }
+    }
+
+    if (bufferSize > 0)
+    {
+        append(json, ",\"buffers\":[{\"byteLength\":%lu}]", (unsigned long)bufferSize);
+    }
+
+    json += '}';
+    return writeFile(path);
+}
+
+int writeGLTF(const DTSResolver& resolver, const DTSShape& shape, const std::vector<DTSShape>& files, const char* path, const DTSOptions& options)
+{
+    DTSScene   scene;
+    DTSOptions gltfOptions(options);
+
+    gltfOptions.influenceGroup = GLTFWriter::InfluenceGroup;
+    scene.build(resolver, shape, files, gltfOptions);
+    return writeGLTF(scene, shape, files, path, options);
+}
+
+int writeGLTF(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const char* path, const DTSOptions& options)
+{
+    DTSStatsScope scope(DTSStats::P_Write);
+    GLTFWriter    writer(scene, shape, files, options);
+
+    if (!writer.write(path))
+    {
+        fprintf(DTSErrorFile(), "Failed to write %s\n", path);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSGLTF_h
+#define DTSConverter_DTSGLTF_h
+
+#include "DTSTypes.h"
+#include "DTSScene.h"
+#include "DTSQuantize.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class DTSShape;
+class DTSResolver;
+class DTSOptions;
+
+/*
+ * Writes a shape and its sequences as a binary glTF 2.0 file (GLB), without
+ * any SDK.
+ *
+ * Accessors point straight into the arrays of the built scene: positions,
+ * normals (decoded enormals), uvs, triangle indices, skin streams and baked
+ * keys are written from their own storage, each one in its own 4 bytes
+ * aligned buffer view of the single binary buffer. Rotation keys are the
+ * exception, they are conjugated into a copy since the scene may be shared. DTS space is kept in the
+ * buffer, a root node rotates z up to y up.
+ *
+ * With --quantize, vertex streams are normalized integers following
+ * KHR_mesh_quantization, see DTSQuantizedMesh.
+ */
+class GLTFWriter
+{
+protected:
+    class View
+    {
+    public:
+        const void* data;
+        size_t      size;
+        size_t      offset;
+        int         stride;
+        int         target;
+    };
+
+    const DTSScene&              scene;
+    const DTSShape&              shape;
+    const std::vector<DTSShape>& files;
+    int                          normalBits;
+
+    std::vector<View> views;
+    size_t            bufferSize;
+
+    std::vector<DTSQuantizedMesh>    quantized;
+    std::vector<std::vector<float> > keyTimes;
+    std::vector<std::vector<float> > bindMatrices;
+    std::vector<Quaternion>          rotationKeys;
+
+    std::string json;
+    std::string accessors;
+    std::string bufferViews;
+    std::string materials;
+    std::string textures;
+    std::string images;
+    std::string meshes;
+    std::string nodes;
+    std::string skins;
+    std::string animations;
+
+    int accessorCount;
+    int meshCount;
+    int skinCount;
+
+    int addView(const void* data, size_t size, int stride, int target);
+    int addAccessor(int view, size_t offset, int componentType, bool normalized, int count, const char* type, const std::string& bounds = std::string());
+
+    void writeMaterials();
+    void writeMeshes(std::vector<std::string>& children, std::vector<std::string>& meshNodes);
+    void writeMesh(const DTSSceneMesh& mesh, const DTSQuantizedMesh* q, std::string& primitives, std::string& attributes);
+    void writeSkin(const DTSSceneMesh& mesh, const DTSQuantizedMesh* q);
+    void writeNodes(const std::vector<std::string>& children, const std::vector<std::string>& meshNodes);
+    void writeAnimations();
+    bool writeFile(const char* path);
+
+public:
+    // The scene is only read, it must be filled with DTSOptions::influenceGroup
+    // set to InfluenceGroup.
+    GLTFWriter(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const DTSOptions& options);
+
+    bool write(const char* path);
+
+    // JOINTS_n/WEIGHTS_n come in sets of 4.
+    static const int InfluenceGroup = 4;
+
+    static void append(std::string& out, const char* format, ...);
+    static void appendString(std::string& out, const char* value);
+    static void item(std::string& section);
+};
+
+// Converts a shape and its sequence files to a GLB file, returns 0 on
+// success and -1 on failure.
+int writeGLTF(const DTSResolver& resolver, const DTSShape& shape, const std::vector<DTSShape>& files, const char* path, const DTSOptions& options);
+int writeGLTF(const DTSScene& scene, const DTSShape& shape, const std::vector<DTSShape>& files, const char* path, const DTSOptions& options);
+
+#endif
@@ -0,0 +1,200 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSMath_h
+#define DTSConverter_DTSMath_h
+
+#include "DTSTypes.h"
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 1))
+#define DTS_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+/*
+ * Matrices are row major and transform column vectors, like the matrices
+ * stored in DTS files: the translation lives in data[3], data[7], data[11].
+ *
+ * DTS quaternions rotate the other way than the textbook convention, the
+ * rotation matrix is the transpose of the usual one (see FBXExporter::convert
+ * which does the same swap on the FBX side).
+ */
+
+inline void DTSMatrixIdentity(Matrix<4,4>& m)
+{
+    float* d = m.data;
+
+    d[0]  = 1; d[1]  = 0; d[2]  = 0; d[3]  = 0;
+    d[4]  = 0; d[5]  = 1; d[6]  = 0; d[7]  = 0;
+    d[8]  = 0; d[9]  = 0; d[10] = 1; d[11] = 0;
+    d[12] = 0; d[13] = 0; d[14] = 0; d[15] = 1;
+}
+
+inline void DTSMatrixSet(const Quaternion& q, const Point& t, Matrix<4,4>& m)
+{
+    float  xs = q.x * 2.0f, ys = q.y * 2.0f, zs = q.z * 2.0f;
+    float  wx = q.w * xs,   wy = q.w * ys,   wz = q.w * zs;
+    float  xx = q.x * xs,   xy = q.x * ys,   xz = q.x * zs;
+    float  yy = q.y * ys,   yz = q.y * zs,   zz = q.z * zs;
+    float* d  = m.data;
+
+    d[0]  = 1.0f - (yy + zz); d[1]  = xy + wz;          d[2]  = xz - wy;          d[3]  = t.x;
+    d[4]  = xy - wz;          d[5]  = 1.0f - (xx + zz); d[6]  = yz + wx;          d[7]  = t.y;
+    d[8]  = xz + wy;          d[9]  = yz - wx;          d[10] = 1.0f - (xx + yy); d[11] = t.z;
+    d[12] = 0.0f;             d[13] = 0.0f;             d[14] = 0.0f;             d[15] = 1.0f;
+}
+
+// out = a * b, out may not alias a or b.
+inline void DTSMatrixMultiply(const Matrix<4,4>& a, const Matrix<4,4>& b, Matrix<4,4>& out)
+{
+    const float* A = a.data;
+    const float* B = b.data;
+    float*       C = out.data;
+
+#ifdef DTS_USE_SSE
+    __m128 b0 = _mm_loadu_ps(B);
+    __m128 b1 = _mm_loadu_ps(B + 4);
+    __m128 b2 = _mm_loadu_ps(B + 8);
+    __m128 b3 = _mm_loadu_ps(B + 12);
+
+    for (int row = 0; row < 16; row += 4)
+    {
+        __m128 r = _mm_mul_ps(_mm_set1_ps(A[row]), b0);
+
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(A[row + 1]), b1));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(A[row + 2]), b2));
+        r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(A[row + 3]), b3));
+        _mm_storeu_ps(C + row, r);
+    }
+#else
+    for (int row = 0; row < 16; row += 4)
+    {
+        for (int column = 0; column < 4; column++)
+        {
+            C[row + column] = A[row]     * B[column]
+                            + A[row + 1] * B[column + 4]
+                            + A[row + 2] * B[column + 8]
+                            + A[row + 3] * B[column + 12];
+        }
+    }
+#endif
+}
+
+// Inverse of a rotation + translation matrix.
+inline void DTSMatrixInverseRigid(const Matrix<4,4>& m, Matrix<4,4>& out)
+{
+    const float* d = m.data;
+    float*       o = out.data;
+
+    o[0]  = d[0]; o[1]  = d[4]; o[2]  = d[8];
+    o[4]  = d[1]; o[5]  = d[5]; o[6]  = d[9];
+    o[8]  = d[2]; o[9]  = d[6]; o[10] = d[10];
+    o[3]  = -(o[0] * d[3] + o[1] * d[7] + o[2]  * d[11]);
+    o[7]  = -(o[4] * d[3] + o[5] * d[7] + o[6]  * d[11]);
+    o[11] = -(o[8] * d[3] + o[9] * d[7] + o[10] * d[11]);
+    o[12] = 0.0f; o[13] = 0.0f; o[14] = 0.0f; o[15] = 1.0f;
+}
+
+// Rotation part as euler angles in degrees, x applied first, then y, then z.
+inline void DTSMatrixEulerXYZ(const Matrix<4,4>& m, Point& degrees)
+{
+    const float* d     = m.data;
+    const float  scale = 57.2957795f;
+    float        sine  = -d[8];
+
+    if (sine >= 0.99999f)
+    {
+        degrees.x = atan2f(d[1], d[5]) * scale;
+        degrees.y = 90.0f;
+        degrees.z = 0.0f;
+    }
+    else if (sine <= -0.99999f)
+    {
+        degrees.x = atan2f(-d[1], d[5]) * scale;
+        degrees.y = -90.0f;
+        degrees.z = 0.0f;
+    }
+    else
+    {
+        degrees.x = atan2f(d[9], d[10]) * scale;
+        degrees.y = asinf(sine) * scale;
+        degrees.z = atan2f(d[4], d[0]) * scale;
+    }
+}
+
+inline void DTSPointLerp(const Point& a, const Point& b, float t, Point& out)
+{
+    out.x = a.x + (b.x - a.x) * t;
+    out.y = a.y + (b.y - a.y) * t;
+    out.z = a.z + (b.z - a.z) * t;
+}
+
+inline void DTSQuaternionNormalize(Quaternion& q)
+{
+    float length = sqrtf(q.x * q.x + q.y * q.y + q.z * q.z + q.w * q.w);
+
+    if (length > 0.0f)
+    {
+        float scale = 1.0f / length;
+
+        q.x *= scale; q.y *= scale; q.z *= scale; q.w *= scale;
+    }
+}
+
+inline void DTSQuaternionSlerp(const Quaternion& a, const Quaternion& b, float t, Quaternion& out)
+{
+    float cosine = a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+    float sign   = 1.0f;
+
+    if (cosine < 0.0f)
+    {
+        cosine = -cosine;
+        sign   = -1.0f;
+    }
+
+    float scaleA = 1.0f - t;
+    float scaleB = t;
+
+    // Nearly identical keys, a normalized lerp is accurate and stable.
+    if (cosine < 0.9995f)
+    {
+        float angle = acosf(cosine);
+        float scale = 1.0f / sinf(angle);
+
+        scaleA = sinf((1.0f - t) * angle) * scale;
+        scaleB = sinf(t * angle) * scale;
+    }
+
+    scaleB *= sign;
+
+    out.x = a.x * scaleA + b.x * scaleB;
+    out.y = a.y * scaleA + b.y * scaleB;
+    out.z = a.z * scaleA + b.z * scaleB;
+    out.w = a.w * scaleA + b.w * scaleB;
+
+    DTSQuaternionNormalize(out);
+}
+
+#endif
@@ -0,0 +1,463 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+#if defined(__APPLE__)
+#include <malloc/malloc.h>
+#define DTS_BLOCK_SIZE(p) malloc_size(p)
+#elif defined(WIN32)
+#include <malloc.h>
+#define DTS_BLOCK_SIZE(p) _msize(p)
+#else
+#include <malloc.h>
+#define DTS_BLOCK_SIZE(p) malloc_usable_size(p)
+#endif
+
+#if __cplusplus >= 201103L
+#define DTS_THROW_BAD_ALLOC
+#define DTS_NO_THROW noexcept
+#else
+#define DTS_THROW_BAD_ALLOC throw(std::bad_alloc)
+#define DTS_NO_THROW        throw()
+#endif
+
+#include "DTSThreads.h"
+#include "DTSMemory.h"
+
+static DTS_THREAD_LOCAL long long liveBytes = 0;
+static DTS_THREAD_LOCAL long long peakBytes = 0;
+
+// Callers of DTSMemoryAccount(true) not done yet.
+static long long accounting = 0;
+
+static bool      counting        = false;
+static long long allocations     = 0;
+static long long allocationBytes = 0;
+
+// Open addressing table of the blocks allocated while profiling, by
+// address. The profile only allocates with malloc to not recurse.
+class DTSMemoryEntry
+{
+public:
+    void*     block;
+    long long size;
+    int       phase;
+};
+
+static DTS_THREAD_LOCAL int currentPhase = 0;
+
+static bool                 profiling       = false;
+static DTSMemoryEntry*      profileTable    = NULL;
+static size_t               profileCapacity = 0;
+static size_t               profileCount    = 0;
+static DTSMemoryPhaseCounts profilePhases[DTS_MEMORY_PHASES];
+
+#ifndef WIN32
+static pthread_mutex_t profileMutex = PTHREAD_MUTEX_INITIALIZER;
+#define DTS_PROFILE_LOCK()   pthread_mutex_lock  (&profileMutex)
+#define DTS_PROFILE_UNLOCK() pthread_mutex_unlock(&profileMutex)
+#else
+#define DTS_PROFILE_LOCK()
+#define DTS_PROFILE_UNLOCK()
+#endif
+
+long long DTSMemoryLive()
+{
+    return liveBytes;
+}
+
+long long DTSMemoryPeak()
+{
+    return peakBytes;
+}
+
+void DTSMemoryResetPeak()
+{
+    peakBytes = liveBytes;
+}
+
+void DTSMemoryAccount(bool enable)
+{
+    DTSAtomicAdd(accounting, enable ? 1 : -1);
+}
+
+void DTSMemoryCount(bool enable)
+{
+    if (enable && !counting)
+    {
+        allocations     = 0;
+        allocationBytes = 0;
+    }
+
+    counting = enable;
+}
+
+void DTSMemoryAllocations(long long& count, long long& bytes)
+{
+    count = allocations;
+    bytes = allocationBytes;
+}
+
+void DTSMemoryProfile(bool enable)
+{
+    DTS_PROFILE_LOCK();
+
+    if (enable && !profiling)
+    {
+        memset(profilePhases, 0, sizeof(profilePhases));
+    }
+
+    if (!enable)
+    {
+        free(profileTable);
+        profileTable    = NULL;
+        profileCapacity = 0;
+        profileCount    = 0;
+    }
+
+    profiling = enable;
+    DTS_PROFILE_UNLOCK();
+}
+
+bool DTSMemoryProfiling()
+{
+    return profiling;
+}
+
+int DTSMemoryPhase(int phase)
+{
+    int previous = currentPhase;
+
+    currentPhase = ((phase >= 0) && (phase < DTS_MEMORY_PHASES)) ? phase : 0;
+    return previous;
+}
+
+void DTSMemoryPhases(DTSMemoryPhaseCounts phases[DTS_MEMORY_PHASES])
+{
+    DTS_PROFILE_LOCK();
+    memcpy(phases, profilePhases, sizeof(profilePhases));
+    DTS_PROFILE_UNLOCK();
+}
+
+static size_t profileSlot(const void* block)
+{
+    size_t hash = (size_t)block >> 4;
+
+    hash *= 2654435761u;
+    return (hash ^ (hash >> 15)) & (profileCapacity - 1);
+}
+
+static bool profileGrow()
+{
+    size_t          capacity = profileCapacity ? profileCapacity * 2 : 4096;
+    DTSMemoryEntry* table    = (DTSMemoryEntry*)calloc(capacity, sizeof(DTSMemoryEntry));
+    DTSMemoryEntry* previous = profileTable;
+    size_t          index, count = profileCapacity;
+
+    if (!table)
+    {
+        return false;
+    }
+
+    profileTable    = table;
+    profileCapacity = capacity;
+
+    for (index = 0; index < count; index++)
+    {
+        if (previous[index].block)
+        {
+            size_t slot = profileSlot(previous[index].block);
+
+            while (profileTable[slot].block)
+            {
+                slot = (slot + 1) & (profileCapacity - 1);
+            }
+
+            profileTable[slot] = previous[index];
+        }
+    }
+
+    free(previous);
+    return true;
+}
+
+static void profileAllocation(void* block, size_t size)
+{
+    DTS_PROFILE_LOCK();
+
+    // The table is only grown at half full, a failure drops the block.
+    if (profiling && (((profileCount + 1) * 2 <= profileCapacity) || profileGrow()))
+    {
+        DTSMemoryPhaseCounts& phase(profilePhases[currentPhase]);
+        size_t                slot = profileSlot(block);
+
+        while (profileTable[slot].block)
+        {
+            slot = (slot + 1) & (profileCapacity - 1);
+        }
+
+        profileTable[slot].block = block;
+        profileTable[slot].size  = (long long)size;
+        profileTable[slot].phase = currentPhase;
+        profileCount++;
+
+        phase.allocations++;
+        phase.bytes        += (long long)size;
+        phase.liveBytes    += (long long)size;
+        phase.peakLiveBytes = (phase.liveBytes > phase.peakLiveBytes) ? phase.liveBytes : phase.peakLiveBytes;
+    }
+
+    DTS_PROFILE_UNLOCK();
+}
+
+// Before the block is freed, another thread could otherwise get its address.
+static void profileRelease(void* block)
+{
+    DTS_PROFILE_LOCK();
+
+    if (profileTable)
+    {
+        size_t mask = profileCapacity - 1;
+        size_t slot = profileSlot(block);
+
+        while (profileTable[slot].block && (profileTable[slot].block != block))
+        {
+            slot = (slot + 1) & mask;
+        }
+
+        if (profileTable[slot].block)
+        {
+            size_t hole = slot;
+            size_t next;
+
+            profilePhases[profileTable[slot].phase].liveBytes -= profileTable[slot].size;
+
+            // Moves back the entries of the run that can't be found past
+            // the hole anymore.
+            for (next = (hole + 1) & mask; profileTable[next].block; next = (next + 1) & mask)
+            {
+                size_t home = profileSlot(profileTable[next].block);
+
+                if (((next - home) & mask) >= ((next - hole) & mask))
+                {
+                    profileTable[hole] = profileTable[next];
+                    hole               = next;
+                }
+            }
+
+            profileTable[hole].block = NULL;
+            profileCount--;
+        }
+    }
+
+    DTS_PROFILE_UNLOCK();
+}
+
+static int compareEntries(const void* left, const void* right)
+{
+    const DTSMemoryEntry* a = (const DTSMemoryEntry*)left;
+    const DTSMemoryEntry* b = (const DTSMemoryEntry*)right;
+
+    if (a->phase != b->phase)
+    {
+        return (a->phase < b->phase) ? -1 : 1;
+    }
+
+    return (a->size < b->size) ? -1 : ((a->size > b->size) ? 1 : 0);
+}
+
+static int compareBlocks(const void* left, const void* right)
+{
+    long long a = ((const DTSMemoryBlocks*)left) ->size * ((const DTSMemoryBlocks*)left) ->count;
+    long long b = ((const DTSMemoryBlocks*)right)->size * ((const DTSMemoryBlocks*)right)->count;
+
+    return (a > b) ? -1 : ((a < b) ? 1 : 0);
+}
+
+int DTSMemoryUnfreed(DTSMemoryBlocks* blocks, int capacity)
+{
+    DTSMemoryEntry*  entries;
+    DTSMemoryBlocks* groups;
+    size_t           index, count = 0, groupCount = 0;
+
+    DTS_PROFILE_LOCK();
+    entries = (DTSMemoryEntry*)malloc((profileCount + 1) * sizeof(DTSMemoryEntry));
+
+    for (index = 0; entries && (index < profileCapacity); index++)
+    {
+        if (profileTable[index].block)
+        {
+            entries[count++] = profileTable[index];
+        }
+    }
+
+    DTS_PROFILE_UNLOCK();
+    groups = (DTSMemoryBlocks*)malloc((count + 1) * sizeof(DTSMemoryBlocks));
+
+    if (!entries || !groups)
+    {
+        free(entries);
+        free(groups);
+        return 0;
+    }
+
+    qsort(entries, count, sizeof(DTSMemoryEntry), compareEntries);
+
+    for (index = 0; index < count; index++)
+    {
+        if ((groupCount == 0) || (compareEntries(&entries[index], &entries[index - 1]) != 0))
+        {
+            groups[groupCount].phase = entries[index].phase;
+            groups[groupCount].size  = entries[index].size;
+            groups[groupCount].count = 0;
+            groupCount++;
+        }
+
+        groups[groupCount - 1].count++;
+    }
+
+    qsort(groups, groupCount, sizeof(DTSMemoryBlocks), compareBlocks);
+    count = ((size_t)capacity < groupCount) ? (size_t)capacity : groupCount;
+    memcpy(blocks, groups, count * sizeof(DTSMemoryBlocks));
+    free(entries);
+    free(groups);
+    return (int)count;
+}
+
+static void* allocate(size_t size)
+{
+    void* block = malloc(size ? size : 1);
+
+    // The usual case, nothing is measured.
+    if (!block || !(accounting || counting || profiling))
+    {
+        return block;
+    }
+
+    if (accounting)
+    {
+        liveBytes += (long long)DTS_BLOCK_SIZE(block);
+        peakBytes  = (liveBytes > peakBytes) ? liveBytes : peakBytes;
+    }
+
+    if (counting)
+    {
+        DTSAtomicAdd(allocations,     1);
+        DTSAtomicAdd(allocationBytes, (long long)size);
+    }
+
+    if (profiling)
+    {
+        profileAllocation(block, size);
+    }
+
+    return block;
+}
+
+static void release(void* block)
+{
+    if (block && accounting)
+    {
+        liveBytes -= (long long)DTS_BLOCK_SIZE(block);
+    }
+
+    if (block && profiling)
+    {
+        profileRelease(block);
+    }
+
+    free(block);
+}
+
+void* operator new(size_t size) DTS_THROW_BAD_ALLOC
+{
+    void* block = allocate(size);
+
+    if (!block)
+    {
+        throw std::bad_alloc();
+    }
+
+    return block;
+}
+
+void* operator new[](size_t size) DTS_THROW_BAD_ALLOC
+{
+    void* block = allocate(size);
+
+    if (!block)
+    {
+        throw std::bad_alloc();
+    }
+
+    return block;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) DTS_NO_THROW
+{
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) DTS_NO_THROW
+{
+    return allocate(size);
+}
+
+void operator delete(void* block) DTS_NO_THROW
+{
+    release(block);
+}
+
+void operator delete[](void* block) DTS_NO_THROW
+{
+    release(block);
+}
+
+// Sized forms, called instead of the above from C++14 on.
+void operator delete(void* block, size_t) DTS_NO_THROW
+{
+    release(block);
+}
+
+void operator delete[](void* block, size_t) DTS_NO_THROW
+{
+    release(block);
+}
+
+void operator delete(void* block, const std::nothrow_t&) DTS_NO_THROW
+{
+    release(block);
+}
+
+void operator delete[](void* block, const std::nothrow_t&) DTS_NO_THROW
+{
+    release(block);
+}
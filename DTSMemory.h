@@ -0,0 +1,98 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSMemory_h
+#define DTSConverter_DTSMemory_h
+
+/*
+ * Heap accounting per thread. The global operator new and delete are
+ * replaced to add and remove the usable size of every block from counters
+ * of the calling thread. A block freed by another thread than the one that
+ * allocated it moves bytes between their counters, callers only use deltas
+ * of work running on a single thread. Allocations of the FBX SDK don't go
+ * through operator new and aren't counted.
+ *
+ * Nothing is measured until asked for: with accounting, counting and the
+ * profile off, operator new and delete test three globals and call malloc
+ * and free.
+ */
+
+// Bytes allocated by the calling thread and not freed yet.
+long long DTSMemoryLive();
+
+// Highest DTSMemoryLive() since the last DTSMemoryResetPeak().
+long long DTSMemoryPeak();
+void      DTSMemoryResetPeak();
+
+// Live and peak bytes are only kept between DTSMemoryAccount(true) and the
+// matching DTSMemoryAccount(false), calls nest. Blocks allocated before are
+// subtracted when freed, only deltas are meaningful.
+void DTSMemoryAccount(bool enable);
+
+// Process wide count of the allocations made while counting is on, off by
+// default since every thread then updates the same counters.
+void DTSMemoryCount(bool enable);
+void DTSMemoryAllocations(long long& count, long long& bytes);
+
+/*
+ * Allocation profile, off by default. While it is on, every block is
+ * recorded with the phase of the thread that allocated it, in a table
+ * guarded by a lock, so it's for measurements rather than production runs.
+ * Phases are numbers below DTS_MEMORY_PHASES set by scoped markers (see
+ * DTSStatsScope), 0 outside of any marker. Blocks allocated before the
+ * profile started are ignored when they are freed.
+ */
+#define DTS_MEMORY_PHASES 16
+
+class DTSMemoryPhaseCounts
+{
+public:
+    long long allocations;
+    long long bytes;            // requested
+    long long liveBytes;        // allocated in the phase, not freed yet
+    long long peakLiveBytes;
+};
+
+// Blocks of one size allocated in one phase, not freed.
+class DTSMemoryBlocks
+{
+public:
+    int       phase;
+    long long size;
+    long long count;
+};
+
+void DTSMemoryProfile(bool enable);
+bool DTSMemoryProfiling();
+
+// Sets the phase of the calling thread, returns the previous one.
+int DTSMemoryPhase(int phase);
+
+void DTSMemoryPhases(DTSMemoryPhaseCounts phases[DTS_MEMORY_PHASES]);
+
+// Fills blocks with the groups of blocks still live, largest total first,
+// returns how many were filled.
+int DTSMemoryUnfreed(DTSMemoryBlocks* blocks, int capacity);
+
+#endif
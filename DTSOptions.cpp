@@ -0,0 +1,169 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "DTSOptions.h"
+
+DTSOptions::DTSOptions() :
+    maxInfluences (0),
+    weightBits    (0),
+    threads       (0),
+    fbxVersion    (7400),
+    quantize      (0),
+    memBudget     (0),
+    influenceGroup(1),
+    animSplit     ("sequence")
+{
+}
+
+static const char* optionValue(const char* argument, const char* name)
+{
+    size_t length = strlen(name);
+
+    if ((strncmp(argument, name, length) == 0) && (argument[length] == '='))
+    {
+        return argument + length + 1;
+    }
+
+    return NULL;
+}
+
+bool DTSOptions::parse(const char* argument)
+{
+    const char* value;
+
+    if ((value = optionValue(argument, "--max-influences")) != NULL)
+    {
+        maxInfluences = atoi(value);
+        return maxInfluences >= 0;
+    }
+
+    if ((value = optionValue(argument, "--weight-bits")) != NULL)
+    {
+        weightBits = atoi(value);
+        return (weightBits == 0) || (weightBits == 8) || (weightBits == 16);
+    }
+
+    if ((value = optionValue(argument, "--threads")) != NULL)
+    {
+        threads = atoi(value);
+        return threads >= 0;
+    }
+
+    if ((value = optionValue(argument, "--writer")) != NULL)
+    {
+        writer = value;
+        return (writer == "sdk") || (writer == "ascii") || (writer == "binary");
+    }
+
+    if ((value = optionValue(argument, "--fbx-version")) != NULL)
+    {
+        fbxVersion = atoi(value);
+        return (fbxVersion == 7400) || (fbxVersion == 7500);
+    }
+
+    if ((value = optionValue(argument, "--out")) != NULL)
+    {
+        outputs.push_back(value);
+        return *value != '\0';
+    }
+
+    if ((value = optionValue(argument, "--shape-cache")) != NULL)
+    {
+        shapeCache = value;
+        return *value != '\0';
+    }
+
+    if ((value = optionValue(argument, "--cache")) != NULL)
+    {
+        cache = value;
+        return *value != '\0';
+    }
+
+    if ((value = optionValue(argument, "--server")) != NULL)
+    {
+        server = value;
+        return *value != '\0';
+    }
+
+    if ((value = optionValue(argument, "--stats")) != NULL)
+    {
+        const char* colon = strchr(value, ':');
+
+        stats     = colon ? std::string(value, colon - value) : std::string(value);
+        statsFile = colon ? colon + 1 : "";
+        return ((stats == "json") || (stats == "allocations")) && (!colon || !statsFile.empty());
+    }
+
+    if ((value = optionValue(argument, "--trace")) != NULL)
+    {
+        trace = value;
+        return *value != '\0';
+    }
+
+    if ((value = optionValue(argument, "--mem-budget")) != NULL)
+    {
+        memBudget = atoi(value);
+        return memBudget >= 0;
+    }
+
+    if ((value = optionValue(argument, "--anim-split")) != NULL)
+    {
+        animSplit = value;
+        return (animSplit == "sequence") || (animSplit == "file");
+    }
+
+    if ((value = optionValue(argument, "--quantize")) != NULL)
+    {
+        quantize = atoi(value);
+        return (quantize == 0) || (quantize == 8) || (quantize == 16);
+    }
+
+    return false;
+}
+
+void DTSOptions::usage(FILE* fileOut)
+{
+    fprintf(fileOut, "Options:\n");
+    fprintf(fileOut, "  --max-influences=K  keep the K largest skin weights per vertex\n");
+    fprintf(fileOut, "  --weight-bits=N     snap skin weights to 8 or 16 bits\n");
+    fprintf(fileOut, "  --threads=N         worker threads, 0 uses every core\n");
+    fprintf(fileOut, "  --writer=NAME       FBX writer: sdk (FBX SDK), ascii or binary (built-in)\n");
+    fprintf(fileOut, "  --fbx-version=N     binary writer version, 7400 or 7500 (64 bit offsets)\n");
+    fprintf(fileOut, "  --out=PATH          convert: also write PATH (.fbx, .glb, .clip directory)\n");
+    fprintf(fileOut, "  --server=SOCKET     run the command in the serve process listening on SOCKET\n");
+    fprintf(fileOut, "  --stats=json[:FILE] write timings, sizes and memory use of the command as JSON\n");
+    fprintf(fileOut, "                      to FILE, or to stderr\n");
+    fprintf(fileOut, "  --stats=allocations[:FILE]\n");
+    fprintf(fileOut, "                      same, with allocations per phase and blocks never freed\n");
+    fprintf(fileOut, "  --trace=FILE        write a timeline of the command to FILE (Chrome trace events)\n");
+    fprintf(fileOut, "  --mem-budget=MB     batch: only start jobs while their predicted peaks fit in MB\n");
+    fprintf(fileOut, "  --anim-split=MODE   anim: one file per sequence (default) or per source file\n");
+    fprintf(fileOut, "  --quantize=N        glTF: 16 bit positions and uvs, N (8 or 16) bit normals\n");
+    fprintf(fileOut, "  --shape-cache=DIR   keep decoded shapes in DIR, reused while the source is unchanged\n");
+    fprintf(fileOut, "  --cache=DIR         convert, gltf: reuse outputs in DIR converted from the same inputs\n");
+}
@@ -0,0 +1,83 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSOptions_h
+#define DTSConverter_DTSOptions_h
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*
+ * Command line switches (--name=value), shared by every command.
+ */
+class DTSOptions
+{
+public:
+    int maxInfluences;
+    int weightBits;
+    int threads;
+    int fbxVersion;
+    int quantize;
+    int memBudget;      // megabytes, 0 for no limit
+
+    // Not a switch, set by writers needing skin streams padded to a
+    // multiple of this many influences.
+    int influenceGroup;
+
+    std::string writer;
+
+    // Directory of decoded shape images (--shape-cache=dir), see DTSLoadShape.
+    std::string shapeCache;
+
+    // Directory of converted outputs (--cache=dir), see DTSConversionCache.
+    std::string cache;
+
+    // anim: one file per "sequence" or per source "file".
+    std::string animSplit;
+
+    // Socket of a running server (--server=path), see DTSServe.h.
+    std::string server;
+
+    // Statistics written after the command (--stats=json[:file]), to
+    // statsFile or stderr, see DTSStats.h.
+    std::string stats;
+    std::string statsFile;
+
+    // Timeline written after the command (--trace=file.json), see DTSTrace.h.
+    std::string trace;
+
+    // Extra outputs of convert (--out=path, repeatable), see exportOutputs.
+    std::vector<std::string> outputs;
+
+public:
+    DTSOptions();
+
+    // Returns false when the switch is unknown or its value is invalid.
+    bool parse(const char* argument);
+
+    static void usage(FILE* fileOut);
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <vector>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSMath.h"
+#include "DTSPose.h"
+
+DTSPose::DTSPose(const DTSShape& s) :
+    shape       (&s),
+    sequenceFile(NULL),
+    sequence    (NULL)
+{
+    const DTSHierarchy& hierarchy(s.hierarchy);
+    int                 index, count = (int)hierarchy.breadthFirst.size();
+
+    order = hierarchy.breadthFirst;
+    slots = hierarchy.breadthFirstIndex;
+    parentSlots.resize(count);
+
+    for (index = 0; index < count; index++)
+    {
+        int parent = hierarchy.parents[order[index]];
+
+        parentSlots[index] = (parent >= 0) ? slots[parent] : -1;
+    }
+
+    rotations        .resize(count);
+    translations     .resize(count);
+    localTransforms  .resize(count);
+    worldTransforms  .resize(count);
+    firstRotations   .resize(count, -1);
+    firstTranslations.resize(count, -1);
+
+    evaluateDefault();
+}
+
+void DTSPose::setSequence(const DTSShape& file, const DTSSequence& seq)
+{
+    std::vector<DTSNodeTrack> tracks;
+
+    clearSequence();
+    file.sequenceTracks(*shape, seq, tracks);
+
+    std::vector<DTSNodeTrack>::const_iterator it, end(tracks.end());
+
+    for (it = tracks.begin(); it != end; ++it)
+    {
+        if ((*it).node >= 0)
+        {
+            firstRotations   [slots[(*it).node]] = (*it).firstRotation;
+            firstTranslations[slots[(*it).node]] = (*it).firstTranslation;
+        }
+    }
+
+    sequenceFile = &file;
+    sequence     = &seq;
+}
+
+void DTSPose::clearSequence()
+{
+    firstRotations   .assign(firstRotations   .size(), -1);
+    firstTranslations.assign(firstTranslations.size(), -1);
+    sequenceFile = NULL;
+    sequence     = NULL;
+}
+
+void DTSPose::evaluateDefault()
+{
+    int index, count = (int)order.size();
+
+    for (index = 0; index < count; index++)
+    {
+        rotations   [index] = shape->nodeDefRotations   [order[index]];
+        translations[index] = shape->nodeDefTranslations[order[index]];
+    }
+
+    update();
+}
+
+void DTSPose::evaluate(float time)
+{
+    if (sequence == NULL)
+    {
+        evaluateDefault();
+        return;
+    }
+
+    int   index, count = (int)order.size();
+    int   key0, key1;
+    float t;
+
+    sequence->keyFrames(time, key0, key1, t);
+
+    for (index = 0; index < count; index++)
+    {
+        int first;
+
+        if ((first = firstRotations[index]) >= 0)
+        {
+            DTSQuaternionSlerp(sequenceFile->nodeRotations[first + key0],
+                               sequenceFile->nodeRotations[first + key1], t, rotations[index]);
+        }
+        else
+        {
+            rotations[index] = shape->nodeDefRotations[order[index]];
+        }
+
+        if ((first = firstTranslations[index]) >= 0)
+        {
+            DTSPointLerp(sequenceFile->nodeTranslations[first + key0],
+                         sequenceFile->nodeTranslations[first + key1], t, translations[index]);
+        }
+        else
+        {
+            translations[index] = shape->nodeDefTranslations[order[index]];
+        }
+    }
+
+    update();
+}
+
+void DTSPose::update()
+{
+    int index, count = (int)order.size();
+
+    for (index = 0; index < count; index++)
+    {
+        DTSMatrixSet(rotations[index], translations[index], localTransforms[index]);
+    }
+
+    // Parents come first, their world transform is always ready.
+    for (index = 0; index < count; index++)
+    {
+        int parent = parentSlots[index];
+
+        if (parent < 0)
+        {
+            worldTransforms[index] = localTransforms[index];
+        }
+        else
+        {
+            DTSMatrixMultiply(worldTransforms[parent], localTransforms[index], worldTransforms[index]);
+        }
+    }
+}
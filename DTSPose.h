@@ -0,0 +1,79 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSPose_h
+#define DTSConverter_DTSPose_h
+
+#include "DTSTypes.h"
+#include <vector>
+
+class DTSShape;
+class DTSSequence;
+
+/*
+ * Local and world transforms of every node of a shape, evaluated without
+ * the FBX SDK. Transforms are kept in DTS space (z up, shape units).
+ *
+ * Nodes are stored in a flat order where a parent always comes before its
+ * children, so the world transforms are computed in one linear pass. Use
+ * slot() to go from a node index to its position in the flat arrays.
+ */
+class DTSPose
+{
+public:
+    const DTSShape* shape;
+
+    std::vector<int> order;
+    std::vector<int> slots;
+    std::vector<int> parentSlots;
+
+    std::vector<Quaternion>   rotations;
+    std::vector<Point>        translations;
+    std::vector<Matrix<4,4> > localTransforms;
+    std::vector<Matrix<4,4> > worldTransforms;
+
+protected:
+    const DTSShape*    sequenceFile;
+    const DTSSequence* sequence;
+    std::vector<int>   firstRotations;
+    std::vector<int>   firstTranslations;
+
+public:
+    DTSPose(const DTSShape& shape);
+
+    void setSequence(const DTSShape& file, const DTSSequence& sequence);
+    void clearSequence();
+
+    void evaluateDefault();
+    void evaluate(float time);
+    void update();
+
+public:
+    int slot(int node) const { return slots[node]; }
+
+    const Matrix<4,4>& localTransform(int node) const { return localTransforms[slots[node]]; }
+    const Matrix<4,4>& worldTransform(int node) const { return worldTransforms[slots[node]]; }
+};
+
+#endif
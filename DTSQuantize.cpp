@@ -0,0 +1,173 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSScene.h"
+#include "DTSQuantize.h"
+
+DTSQuantizedMesh::DTSQuantizedMesh() :
+    normalBits(0)
+{
+    center.x = center.y = center.z = 0.0f;
+    extent.x = extent.y = extent.z = 1.0f;
+    low [0] = low [1] = low [2] = 0;
+    high[0] = high[1] = high[2] = 0;
+}
+
+int DTSQuantizedMesh::snorm(float value, int bits)
+{
+    float scale = (float)((1 << (bits - 1)) - 1);
+
+    value = (value < -1.0f) ? -1.0f : ((value > 1.0f) ? 1.0f : value);
+    return (int)floorf(value * scale + 0.5f);
+}
+
+void DTSQuantizedMesh::build(const DTSSceneMesh& mesh, const DTSMesh& source, int bits)
+{
+    int   index, count = (int)mesh.positions.size();
+    Point min(source.bounds.min), max(source.bounds.max);
+
+    normalBits = bits;
+
+    for (index = 0; index < count; index++)
+    {
+        const Point& p(mesh.positions[index]);
+
+        min.x = (p.x < min.x) ? p.x : min.x; min.y = (p.y < min.y) ? p.y : min.y; min.z = (p.z < min.z) ? p.z : min.z;
+        max.x = (p.x > max.x) ? p.x : max.x; max.y = (p.y > max.y) ? p.y : max.y; max.z = (p.z > max.z) ? p.z : max.z;
+    }
+
+    center.x = (min.x + max.x) * 0.5f;
+    center.y = (min.y + max.y) * 0.5f;
+    center.z = (min.z + max.z) * 0.5f;
+
+    // One extent for the 3 axes, a uniform scale keeps the normals valid.
+    float size = max.x - min.x;
+
+    size = ((max.y - min.y) > size) ? (max.y - min.y) : size;
+    size = ((max.z - min.z) > size) ? (max.z - min.z) : size;
+
+    extent.x = extent.y = extent.z = (size > 0.0f) ? size * 0.5f : 1.0f;
+
+    positions.assign(count * 4, 0);
+    low [0] = low [1] = low [2] =  32767;
+    high[0] = high[1] = high[2] = -32767;
+
+    for (index = 0; index < count; index++)
+    {
+        const Point& p(mesh.positions[index]);
+        short*       q = &positions[index * 4];
+
+        q[0] = (short)snorm((p.x - center.x) / extent.x, 16);
+        q[1] = (short)snorm((p.y - center.y) / extent.y, 16);
+        q[2] = (short)snorm((p.z - center.z) / extent.z, 16);
+
+        for (int axis = 0; axis < 3; axis++)
+        {
+            low [axis] = (q[axis] < low [axis]) ? q[axis] : low [axis];
+            high[axis] = (q[axis] > high[axis]) ? q[axis] : high[axis];
+        }
+    }
+
+    uvs.clear();
+
+    if ((int)mesh.uvs.size() == count)
+    {
+        uvs.resize(count * 2);
+
+        for (index = 0; index < count; index++)
+        {
+            const Point2D& uv(mesh.uvs[index]);
+
+            if ((uv.x < 0.0f) || (uv.x > 1.0f) || (uv.y < 0.0f) || (uv.y > 1.0f))
+            {
+                uvs.clear();
+                break;
+            }
+
+            uvs[index * 2 + 0] = (unsigned short)floorf(uv.x * 65535.0f + 0.5f);
+            uvs[index * 2 + 1] = (unsigned short)floorf(uv.y * 65535.0f + 0.5f);
+        }
+    }
+
+    normals8 .clear();
+    normals16.clear();
+
+    if ((int)mesh.normals.size() != count)
+    {
+        return;
+    }
+
+    if (bits == 8)
+    {
+        normals8.assign(count * 4, 0);
+
+        // Encoded normals go through a quantized copy of the table.
+        if ((int)source.enormals.size() >= count)
+        {
+            signed char table[256 * 4];
+
+            for (index = 0; index < 256; index++)
+            {
+                table[index * 4 + 0] = (signed char)snorm(DTSScene::NormalTable[index].x, 8);
+                table[index * 4 + 1] = (signed char)snorm(DTSScene::NormalTable[index].y, 8);
+                table[index * 4 + 2] = (signed char)snorm(DTSScene::NormalTable[index].z, 8);
+                table[index * 4 + 3] = 0;
+            }
+
+            for (index = 0; index < count; index++)
+            {
+                memcpy(&normals8[index * 4], &table[source.enormals[index] * 4], 4);
+            }
+
+            return;
+        }
+
+        for (index = 0; index < count; index++)
+        {
+            normals8[index * 4 + 0] = (signed char)snorm(mesh.normals[index].x, 8);
+            normals8[index * 4 + 1] = (signed char)snorm(mesh.normals[index].y, 8);
+            normals8[index * 4 + 2] = (signed char)snorm(mesh.normals[index].z, 8);
+        }
+    }
+    else
+    {
+        normals16.assign(count * 4, 0);
+
+        for (index = 0; index < count; index++)
+        {
+            normals16[index * 4 + 0] = (short)snorm(mesh.normals[index].x, 16);
+            normals16[index * 4 + 1] = (short)snorm(mesh.normals[index].y, 16);
+            normals16[index * 4 + 2] = (short)snorm(mesh.normals[index].z, 16);
+        }
+    }
+}
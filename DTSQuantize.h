@@ -0,0 +1,71 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSQuantize_h
+#define DTSConverter_DTSQuantize_h
+
+#include "DTSTypes.h"
+#include <vector>
+
+class DTSMesh;
+class DTSSceneMesh;
+
+/*
+ * Vertex streams of a mesh as normalized integers, KHR_mesh_quantization
+ * style. Every vertex takes a multiple of 4 bytes, the padding components
+ * are 0.
+ *
+ *   position = center + positions / 32767 * extent   4 x int16
+ *   uv       = uvs / 65535                           2 x uint16
+ *   normal   = normals / 127 or / 32767              4 x int8 or 4 x int16
+ *
+ * Positions are relative to DTSMesh::bounds (grown to the vertices if they
+ * fall outside), with the same extent on every axis so the dequantization
+ * is a uniform scale. uvs stay empty when a coordinate is outside [0, 1].
+ */
+class DTSQuantizedMesh
+{
+public:
+    int   normalBits;
+    Point center;
+    Point extent;
+    short low [3];  // bounds of the quantized positions
+    short high[3];
+
+    std::vector<short>          positions;
+    std::vector<unsigned short> uvs;
+    std::vector<signed char>    normals8;
+    std::vector<short>          normals16;
+
+public:
+    DTSQuantizedMesh();
+
+    // normalBits is 8 or 16.
+    void build(const DTSSceneMesh& mesh, const DTSMesh& source, int normalBits);
+
+    // Same rounding as build(), -1 to 1 into -(2^(bits-1) - 1) to 2^(bits-1) - 1.
+    static int snorm(float value, int bits);
+};
+
+#endif
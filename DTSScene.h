@@ -0,0 +1,173 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSScene_h
+#define DTSConverter_DTSScene_h
+
+#include "DTSTypes.h"
+#include "DTSSkin.h"
+#include <string>
+#include <vector>
+
+class DTSShape;
+class DTSMesh;
+class DTSSequence;
+class DTSResolver;
+class DTSOptions;
+
+/*
+ * Writer independent copy of everything an output format needs, built from
+ * a shape and its sequence files without any SDK. Values stay in DTS space
+ * (z up, shape units, DTS quaternions); writers apply their own axis and
+ * unit conversions.
+ *
+ * Meshes and animations are independent items stored in flat arrays, each
+ * one is built by its own task.
+ */
+
+class DTSSceneNode
+{
+public:
+    std::string name;
+    int         parent;
+    Quaternion  rotation;
+    Point       translation;
+    Matrix<4,4> world;
+};
+
+class DTSSceneMaterial
+{
+public:
+    std::string name;   // without extension
+    std::string path;   // resolved texture path
+};
+
+// Triangles [firstTriangle, firstTriangle + numTriangles) use one material.
+class DTSSceneMaterialRange
+{
+public:
+    int material;
+    int firstTriangle;
+    int numTriangles;
+};
+
+class DTSSceneMesh
+{
+public:
+    std::string name;
+    int         subshape;
+    int         object;
+    int         node;   // node of the object, -1 if none
+    int         source; // index in DTSShape::meshes
+    bool        skinned;
+
+    std::vector<Point>   positions;
+    std::vector<Point2D> uvs;
+    std::vector<Point>   normals;
+    std::vector<int>     indices;   // 3 per triangle
+    std::vector<DTSSceneMaterialRange> ranges;
+
+    std::vector<int> bones;         // node of every skin bone
+    DTSSkin          skin;
+};
+
+// Keys of one node, numKeyFrames of each. Channels the sequence does not
+// animate repeat the default transform of the node.
+class DTSSceneTrack
+{
+public:
+    std::string name;
+    int         node;     // node in the base shape, -1 if unknown
+    int         fileNode; // node in the file the sequence comes from
+    bool        animatesRotation;
+    bool        animatesTranslation;
+
+    std::vector<Quaternion> rotations;
+    std::vector<Point>      translations;
+};
+
+class DTSSceneAnimation
+{
+public:
+    std::string name;
+    int         file;     // index in the sequence files, -1 for the shape
+    int         sequence;
+    int         flags;
+    int         numKeyFrames;
+    float       duration;
+
+    unsigned long long fingerprint; // of the source, see DTSScene::fingerprint
+
+    std::vector<DTSSceneTrack> tracks;
+};
+
+class DTSScene
+{
+public:
+    int  numSubshapes;
+    bool filled;    // every listed item is built
+
+    std::vector<DTSSceneNode>      nodes;
+    std::vector<int>               order;   // parents before children
+    std::vector<DTSSceneMaterial>  materials;
+    std::vector<DTSSceneMesh>      meshes;
+    std::vector<DTSSceneAnimation> animations;
+
+public:
+    DTSScene();
+
+    // list() + fill(). geometry false only keeps the animations of the
+    // sequence files, for adding animations to an existing file.
+    void build(const DTSResolver& resolver, const DTSShape& shape, const std::vector<DTSShape>& files, const DTSOptions& options, bool geometry = true);
+
+    // Nodes, materials, and one empty entry per mesh and animation, cheap.
+    // Streaming writers stop here and build one item at a time.
+    void list(const DTSResolver& resolver, const DTSShape& shape, const std::vector<DTSShape>& files, bool geometry = true);
+
+    // Builds every listed mesh and animation, in parallel.
+    void fill(const DTSShape& shape, const std::vector<DTSShape>& files, const DTSOptions& options);
+
+    void buildNodes    (const DTSShape& shape);
+    void buildMaterials(const DTSResolver& resolver, const DTSShape& shape);
+    void listMeshes    (const DTSShape& shape);
+    void listAnimations(const DTSShape& shape, const std::vector<DTSShape>& files, bool shapeSequences);
+
+    // Builds listed item index into out, out may be the listed entry itself.
+    void buildMesh     (const DTSShape& shape, const DTSOptions& options, int index, DTSSceneMesh& out) const;
+    void buildAnimation(const DTSShape& shape, const std::vector<DTSShape>& files, int index, DTSSceneAnimation& out) const;
+
+    static void buildMesh     (const DTSMesh& mesh, const DTSOptions& options, DTSSceneMesh& out);
+    static void buildAnimation(const DTSShape& shape, const DTSShape& file, const DTSSequence& sequence, DTSSceneAnimation& out);
+
+    // Hash of everything the baked animation depends on: the sequence, its
+    // keys and the default transforms of the nodes it does not animate.
+    // Cheap next to baking, it tells whether a written animation is stale.
+    unsigned long long fingerprint(const DTSShape& shape, const std::vector<DTSShape>& files, int index) const;
+
+    static unsigned long long fingerprint(const DTSShape& shape, const DTSShape& file, const DTSSequence& sequence);
+
+    static const Point NormalTable[256];
+};
+
+#endif
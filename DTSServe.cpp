@@ -0,0 +1,549 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSOptions.h"
+#include "DTSThreads.h"
+#include "DTSCache.h"
+#include "DTSServe.h"
+
+// DTS2FBX.cpp
+std::string fbxWriterName(const DTSOptions& options);
+
+// Decoded shapes kept between jobs.
+#define DTS_SERVE_SHAPES 64
+
+#ifndef WIN32
+
+static bool sendAll(int fd, const void* data, size_t size)
+{
+    const char* bytes = (const char*)data;
+
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, bytes, size, 0);
+
+        if (sent <= 0)
+        {
+            if ((sent < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        bytes += sent;
+        size  -= (size_t)sent;
+    }
+
+    return true;
+}
+
+static bool receiveAll(int fd, void* data, size_t size)
+{
+    char* bytes = (char*)data;
+
+    while (size > 0)
+    {
+        ssize_t received = recv(fd, bytes, size, 0);
+
+        if (received <= 0)
+        {
+            if ((received < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            return false;
+        }
+
+        bytes += received;
+        size  -= (size_t)received;
+    }
+
+    return true;
+}
+
+static bool sendMessage(int fd, const std::string& message)
+{
+    unsigned int  size = (unsigned int)message.size();
+    unsigned char length[4] = { (unsigned char)size, (unsigned char)(size >> 8), (unsigned char)(size >> 16), (unsigned char)(size >> 24) };
+
+    return sendAll(fd, length, 4) && sendAll(fd, message.data(), message.size());
+}
+
+// Messages are small, longer ones are refused.
+static bool receiveMessage(int fd, std::string& message)
+{
+    unsigned char length[4];
+
+    if (!receiveAll(fd, length, 4))
+    {
+        return false;
+    }
+
+    unsigned int size = length[0] | (length[1] << 8) | (length[2] << 16) | ((unsigned int)length[3] << 24);
+
+    if (size > (1 << 24))
+    {
+        return false;
+    }
+
+    message.resize(size);
+    return (size == 0) || receiveAll(fd, &message[0], size);
+}
+
+static int connectTo(const char* socketPath)
+{
+    struct sockaddr_un address;
+    int                fd;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0)
+    {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Server
+ */
+
+static pthread_mutex_t sdkMutex     = PTHREAD_MUTEX_INITIALIZER;
+static DTSCommand      serveCommand = NULL;
+
+// Anything readable once the request is in, a message or the end of the
+// connection, cancels the job.
+static bool clientGone(void* context)
+{
+    struct pollfd p;
+
+    p.fd      = (int)(size_t)context;
+    p.events  = POLLIN;
+    p.revents = 0;
+
+    return (poll(&p, 1, 0) > 0) && (p.revents != 0);
+}
+
+static std::string absolutePath(const std::string& directory, const std::string& path)
+{
+    if (path.empty() || (path[0] == '/') || directory.empty())
+    {
+        return path;
+    }
+
+    return directory + "/" + path;
+}
+
+// Whether the positional argument at position (0 is the first after the
+// command) of command is a path, first is the first positional argument.
+static bool pathArgument(const std::string& command, const std::string& first, int position)
+{
+    // Output, shape and sequence patterns, or files.
+    if ((command == "convert") || (command == "addanim") || (command == "gltf") || (command == "clip") ||
+        (command == "anim") || (command == "roundtrip"))
+    {
+        return true;
+    }
+
+    // bench compare baseline.json directory [name=value ...]
+    if ((command == "bench") && (first == "compare"))
+    {
+        return (position == 1) || (position == 2);
+    }
+
+    // A shape, manifest or directory, then sequence names, times or
+    // name=value parameters.
+    return (position == 0) &&
+           ((command == "info") || (command == "pose") || (command == "batch") || (command == "watch") ||
+            (command == "cache") || (command == "generate") || (command == "bench"));
+}
+
+// Path arguments of the command and the path valued switches are relative
+// to the client.
+static void resolveArguments(const std::string& directory, std::vector<std::string>& arguments)
+{
+    static const char* pathOptions[] = { "--out=", "--cache=", "--shape-cache=", "--trace=", "--stats=json:", "--stats=allocations:" };
+
+    std::string first;
+    int         position = 0;
+    size_t      index;
+
+    for (index = 2; (index < arguments.size()) && first.empty(); index++)
+    {
+        if (arguments[index].compare(0, 2, "--") != 0)
+        {
+            first = arguments[index];
+        }
+    }
+
+    for (index = 2; index < arguments.size(); index++)
+    {
+        std::string& argument(arguments[index]);
+
+        if (argument.compare(0, 2, "--") != 0)
+        {
+            if (pathArgument(arguments[1], first, position++))
+            {
+                argument = absolutePath(directory, argument);
+            }
+
+            continue;
+        }
+
+        for (size_t option = 0; option < sizeof(pathOptions) / sizeof(pathOptions[0]); option++)
+        {
+            size_t length = strlen(pathOptions[option]);
+
+            if (argument.compare(0, length, pathOptions[option]) == 0)
+            {
+                argument = pathOptions[option] + absolutePath(directory, argument.substr(length));
+            }
+        }
+    }
+}
+
+// Everything written to a temporary file, which is closed.
+static void readBack(FILE* file, std::string& text)
+{
+    long size = ftell(file);
+
+    if (size > 0)
+    {
+        text.resize(size);
+        rewind(file);
+        text.resize(fread(&text[0], 1, size, file));
+    }
+
+    fclose(file);
+}
+
+static int runJob(int fd, std::vector<std::string>& arguments, std::string& output)
+{
+    std::vector<const char*> argv;
+    DTSOptions               options;
+
+    for (size_t index = 0; index < arguments.size(); index++)
+    {
+        argv.push_back(arguments[index].c_str());
+
+        if ((index > 0) && (arguments[index].compare(0, 2, "--") == 0))
+        {
+            options.parse(arguments[index].c_str());
+        }
+    }
+
+    if ((arguments.size() < 2) || (arguments[1] == "serve"))
+    {
+        fprintf(DTSErrorFile(), "Invalid job\n");
+        return -1;
+    }
+
+    // It would hold the FBX SDK lock, or a thread, forever.
+    if (arguments[1] == "watch")
+    {
+        fprintf(DTSErrorFile(), "watch can't run in a server, run it without --server\n");
+        return -1;
+    }
+
+    FILE* fileOut = tmpfile();
+
+    if (!fileOut)
+    {
+        fprintf(DTSErrorFile(), "Failed to create a temporary file: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // The FBX SDK is not thread safe.
+    bool sdk = (fbxWriterName(options) == "sdk") && (arguments[1] != "info") && (arguments[1] != "pose") && (arguments[1] != "cache");
+    int  result;
+
+    if (sdk)
+    {
+        pthread_mutex_lock(&sdkMutex);
+    }
+
+    DTSSetCancelCheck(clientGone, (void*)(size_t)fd);
+    result = DTSCancelled() ? -1 : serveCommand((int)argv.size(), &argv[0], fileOut);
+    DTSSetCancelCheck(NULL, NULL);
+
+    if (sdk)
+    {
+        pthread_mutex_unlock(&sdkMutex);
+    }
+
+    readBack(fileOut, output);
+    return result;
+}
+
+static void* serveConnection(void* context)
+{
+    int         fd = (int)(size_t)context;
+    std::string request;
+
+    if (receiveMessage(fd, request))
+    {
+        std::vector<std::string> arguments(1, "dts2fbx");
+        std::string              directory, output, errors;
+        size_t                   start = request.find('\0');
+
+        directory = request.substr(0, start);
+
+        while ((start != std::string::npos) && (start + 1 < request.size()))
+        {
+            size_t end = request.find('\0', start + 1);
+
+            arguments.push_back(request.substr(start + 1, (end == std::string::npos) ? end : end - start - 1));
+            start = end;
+        }
+
+        resolveArguments(directory, arguments);
+
+        // Diagnostics of the job go to its client, or to the standard
+        // error of the server when they can't be kept.
+        FILE* errorFile = tmpfile();
+
+        DTSSetErrorFile(errorFile);
+
+        int  result = runJob(fd, arguments, output);
+        char text[16];
+
+        DTSSetErrorFile(NULL);
+
+        if (errorFile)
+        {
+            readBack(errorFile, errors);
+        }
+
+        snprintf(text, sizeof(text), "r%d", result);
+
+        if (!output.empty())
+        {
+            sendMessage(fd, "o" + output);
+        }
+
+        if (!errors.empty())
+        {
+            sendMessage(fd, "e" + errors);
+        }
+
+        sendMessage(fd, text);
+    }
+
+    close(fd);
+    return NULL;
+}
+
+int DTSServe(const char* socketPath, DTSCommand command)
+{
+    struct sockaddr_un address;
+    int                fd;
+
+    if (strlen(socketPath) >= sizeof(address.sun_path))
+    {
+        fprintf(stderr, "Socket path too long: %s\n", socketPath);
+        return -1;
+    }
+
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socketPath);
+
+    // A socket nobody answers on is left by a previous server.
+    int running = connectTo(socketPath);
+
+    if (running >= 0)
+    {
+        close(running);
+        fprintf(stderr, "A server already listens on %s\n", socketPath);
+        return -1;
+    }
+
+    unlink(socketPath);
+
+    if (((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) ||
+        (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0) ||
+        (listen(fd, 16) != 0))
+    {
+        fprintf(stderr, "Failed to listen on %s: %s\n", socketPath, strerror(errno));
+
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        return -1;
+    }
+
+    // Clients going away must not kill the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    serveCommand = command;
+    DTSShapeMemoryCache::enable(DTS_SERVE_SHAPES);
+
+    for (;;)
+    {
+        int client = accept(fd, NULL, NULL);
+
+        if (client < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            fprintf(stderr, "Failed to accept a connection: %s\n", strerror(errno));
+            break;
+        }
+
+        pthread_t thread;
+
+        if (pthread_create(&thread, NULL, serveConnection, (void*)(size_t)client) != 0)
+        {
+            close(client);
+            continue;
+        }
+
+        pthread_detach(thread);
+    }
+
+    close(fd);
+    unlink(socketPath);
+    return -1;
+}
+
+/*
+ * Client
+ */
+
+int DTSForward(const char* socketPath, int argc, const char* argv[], FILE* fileOut)
+{
+    int fd = connectTo(socketPath);
+
+    if (fd < 0)
+    {
+        return DTS_NO_SERVER;
+    }
+
+    std::string request;
+    char        directory[4096];
+
+    if (getcwd(directory, sizeof(directory)))
+    {
+        request = directory;
+    }
+
+    request += '\0';
+
+    for (int index = 1; index < argc; index++)
+    {
+        if (strncmp(argv[index], "--server=", 9) != 0)
+        {
+            request += argv[index];
+            request += '\0';
+        }
+    }
+
+    std::string reply;
+    int         result = -1;
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if (!sendMessage(fd, request))
+    {
+        close(fd);
+        return DTS_NO_SERVER;
+    }
+
+    while (receiveMessage(fd, reply) && !reply.empty())
+    {
+        if (reply[0] == 'o')
+        {
+            fwrite(reply.data() + 1, 1, reply.size() - 1, fileOut);
+        }
+        else if (reply[0] == 'e')
+        {
+            fwrite(reply.data() + 1, 1, reply.size() - 1, stderr);
+        }
+        else if (reply[0] == 'r')
+        {
+            result = atoi(reply.c_str() + 1);
+            break;
+        }
+    }
+
+    close(fd);
+    return result;
+}
+
+#else
+
+int DTSServe(const char* socketPath, DTSCommand command)
+{
+    fprintf(stderr, "serve is not supported on this platform\n");
+    return -1;
+}
+
+int DTSForward(const char* socketPath, int argc, const char* argv[], FILE* fileOut)
+{
+    return DTS_NO_SERVER;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSServe_h
+#define DTSConverter_DTSServe_h
+
+#include <stdio.h>
+
+class DTSOptions;
+
+/*
+ * Conversion service over a Unix domain socket. "serve socket" keeps one
+ * process running: shapes decoded by a job stay in memory for the next ones
+ * (see DTSShapeMemoryCache) and the FBX SDK manager is created once. Any
+ * command line given --server=socket is forwarded to it instead of being
+ * run locally, and runs locally when no server answers.
+ *
+ * Every message is a 32 bit little endian length followed by that many
+ * bytes. A connection carries one job:
+ *
+ *   client  working directory and arguments (command first, without the
+ *           program name), each one NUL terminated
+ *   server  'o' followed by the output of the command (info, pose, ...)
+ *   server  'e' followed by the diagnostics of the command, the client
+ *           writes them to its standard error
+ *   server  'r' followed by the result of the command in decimal
+ *
+ * Relative paths are resolved against the working directory of the client.
+ * Jobs run concurrently, each on its own thread, except the ones using the
+ * FBX SDK which run one at a time; watch, which never ends, is refused.
+ * Closing the connection, or sending any message after the request,
+ * cancels the job at its next stage boundary; an output already being
+ * written is finished.
+ */
+
+// Runs a command line in the server, argv[0] is the program name.
+typedef int (*DTSCommand)(int argc, const char* argv[], FILE* fileOut);
+
+// Returned by DTSForward when no server listens on the socket.
+#define DTS_NO_SERVER (-1000)
+
+// Serves until killed, returns -1 when the socket can't be opened.
+int DTSServe(const char* socketPath, DTSCommand command);
+
+// Sends a command line to the server, copies its output to fileOut and
+// returns its result. Arguments starting with --server= are not sent.
+int DTSForward(const char* socketPath, int argc, const char* argv[], FILE* fileOut);
+
+#endif
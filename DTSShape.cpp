@@ -24,6 +24,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <math.h>
 #include <assert.h>
 #include <vector>
 #include <sys/stat.h>
@@ -31,6 +32,7 @@
 #include "DTSTypes.h"
 #include "DTSBase.h"
 #include "DTSShape.h"
+#include "DTSStats.h"
 
 DTSShape::DTSShape() :
     numNodes              (0),
@@ -56,12 +58,19 @@ DTSShape::DTSShape() :
     smallestDetailLevel(0),
 
     radius    (0),
-    tubeRadius(0)
+    tubeRadius(0),
+
+    materialListVersion    (1),
+    numExportedObjects     (0),
+    numExportedObjectStates(0)
 {
 }
 
 void DTSShape::loadShapeFile(FILE* file)
 {
+    DTSStatsScope scope(DTSStats::P_LoadShapeFile);
+    long          start = scope.enabled ? ftell(file) : 0;
+
     DTSBase::load(file);
     Read(numNodes);
     Read(numObjects);
@@ -126,6 +135,7 @@ void DTSShape::loadShapeFile(FILE* file)
     nodes.resize(numNodes);
     Read(nodes);
     ReadCheck(2);
+    hierarchy.build(nodes);
     
     // Objects 
     
@@ -168,9 +178,10 @@ void DTSShape::loadShapeFile(FILE* file)
     
     if (dtsVersion < 16)
     {
-        int size, temp ;
+        int size ;
         Read(size);
-        while (size--) Read(temp);
+        meshIndexList.resize(size);
+        Read(meshIndexList);
     }
     
     // Default translations and rotations
@@ -197,6 +208,7 @@ void DTSShape::loadShapeFile(FILE* file)
     nodeScalesUniform  .resize(numNodeScalesUniform);
     nodeScalesAligned  .resize(numNodeScalesAligned);
     nodeScalesArbitrary.resize(numNodeScalesArbitrary);
+    nodeScaleRotsArbitrary.resize(numNodeScalesArbitrary);
     
     if (dtsVersion > 21)
     {
@@ -223,25 +235,25 @@ void DTSShape::loadShapeFile(FILE* file)
     
     objectStates.resize(numObjectStates) ;
     Read(objectStates);
-    ReadCheck(11);
+    ReadCheck();
     
     // Decal states
     
     decalStates.resize(numDecalStates);
     Read(decalStates);
-    ReadCheck(12);
+    ReadCheck();
     
     // Triggers
     
     triggers.resize(numTriggers);
     Read(triggers);
-    ReadCheck(13);
+    ReadCheck();
     
     // Detail Levels
     
     detailLevels.resize(numDetailLevels);
     Read(detailLevels);
-    ReadCheck(14);
+    ReadCheck();
     
     // Meshes
     
@@ -260,8 +272,8 @@ void DTSShape::loadShapeFile(FILE* file)
 
     // Materials
 
-    /*char materialListVersion =*/ ReadRawTyped<char>(file);
-    int  materialCount       = ReadRawTyped<int> (file);
+    materialListVersion = ReadRawTyped<char>(file);
+    int materialCount   = ReadRawTyped<int> (file);
 
     materials.resize(materialCount);
 
@@ -287,6 +299,12 @@ void DTSShape::loadShapeFile(FILE* file)
         (*mat).detailScale = ReadRawTyped<int>(file);
     for (mat = materials.begin() ; mat != materials.end() ; mat++)
         (*mat).reflection = ReadRawTyped<int>(file);
+
+    // Everything after the header and the streams.
+    if (scope.enabled)
+    {
+        DTSStats::addCounter(DTSStats::C_BytesRaw, ftell(file) - start - 4 * (long long)sizeof(int) - (long long)allocated32 * sizeof(int) - (long long)allocated16 * sizeof(short) - allocated8);
+    }
 }
 
 void DTSShape::loadSequences(FILE* file, bool dsq)
@@ -338,7 +356,9 @@ void DTSShape::loadSequences(FILE* file, bool dsq)
 
 void DTSShape::loadSequenceFile(FILE* file, const DTSShape* baseShape)
 {
-    size_t index;
+    DTSStatsScope scope(DTSStats::P_LoadSequenceFile);
+    long          start = scope.enabled ? ftell(file) : 0;
+    size_t        index;
     
     dtsVersion = ReadRawTyped<int>(file);
     
@@ -348,8 +368,8 @@ void DTSShape::loadSequenceFile(FILE* file, const DTSShape* baseShape)
         ReadRawTyped(file, names[index]);
     }
     
-    // Objects Export ?
-    ReadRawTyped<int>(file);
+    // Legacy object export, then the object count of the exporting shape
+    numExportedObjects = ReadRawTyped<int>(file);
     
     numObjects = ReadRawTyped<int>(file);
     
@@ -382,7 +402,7 @@ void DTSShape::loadSequenceFile(FILE* file, const DTSShape* baseShape)
     
     for (index = 0; index < nodeScalesUniform.size(); index++)
     {
-        nodeScalesUniform.push_back(ReadRawTyped<float>(file));
+        nodeScalesUniform[index] = ReadRawTyped<float>(file);
     }
     
     nodeScalesAligned.resize(numNodeScalesAligned = ReadRawTyped<int>(file));
@@ -445,7 +465,7 @@ void DTSShape::loadSequenceFile(FILE* file, const DTSShape* baseShape)
         groundRotations[index] = q;
     }
     
-    ReadRawTyped<int>(file);
+    numExportedObjectStates = ReadRawTyped<int>(file);
     
     loadSequences(file, true);
     
@@ -458,6 +478,11 @@ void DTSShape::loadSequenceFile(FILE* file, const DTSShape* baseShape)
         trigger.state = ReadRawTyped<int>(file);
         trigger.pos   = ReadRawTyped<float>(file);
     }
+
+    if (scope.enabled)
+    {
+        DTSStats::addCounter(DTSStats::C_BytesRaw, ftell(file) - start);
+    }
 }
 
 int DTSShape::findNode(const char* nodeName) const
@@ -480,6 +505,188 @@ int DTSShape::findNode(const char* nodeName) const
     return -1;
 }
 
+void DTSShape::sequenceTracks(const DTSShape& baseShape, const DTSSequence& sequence, std::vector<DTSNodeTrack>& tracks) const
+{
+    // Sequences coming from a DSQ only know their nodes by name.
+    int fileNode, fileNodeCount = (this == &baseShape) ? (int)nodes.size() : (int)names.size();
+    int rotation    = sequence.baseRotation;
+    int translation = sequence.baseTranslation;
+
+    tracks.resize(fileNodeCount);
+
+    for (fileNode = 0; fileNode < fileNodeCount; fileNode++)
+    {
+        DTSNodeTrack& track = tracks[fileNode];
+
+        track.fileNode         = fileNode;
+        track.node             = (this == &baseShape) ? fileNode : baseShape.findNode(names[fileNode].c_str());
+        track.firstRotation    = -1;
+        track.firstTranslation = -1;
+
+        if (DTSSequence::matter(sequence.matters.rotation, fileNode))
+        {
+            track.firstRotation = rotation;
+            rotation += sequence.numKeyFrames;
+        }
+
+        if (DTSSequence::matter(sequence.matters.translation, fileNode))
+        {
+            track.firstTranslation = translation;
+            translation += sequence.numKeyFrames;
+        }
+    }
+}
+
+void DTSSequence::keyFrames(float time, float duration, int numKeyFrames, bool cyclic, int& key0, int& key1, float& t)
+{
+    if ((numKeyFrames <= 1) || (duration <= 0.0f))
+    {
+        key0 = 0;
+        key1 = 0;
+        t    = 0.0f;
+        return;
+    }
+
+    float position = time * numKeyFrames / duration;
+    float base     = floorf(position);
+
+    t    = position - base;
+    key0 = (int)base;
+
+    if (cyclic)
+    {
+        key0 = ((key0 % numKeyFrames) + numKeyFrames) % numKeyFrames;
+        key1 = (key0 + 1) % numKeyFrames;
+    }
+    else if (key0 < 0)
+    {
+        key0 = 0;
+        key1 = 0;
+        t    = 0.0f;
+    }
+    else if (key0 >= numKeyFrames - 1)
+    {
+        key0 = numKeyFrames - 1;
+        key1 = numKeyFrames - 1;
+        t    = 0.0f;
+    }
+    else
+    {
+        key1 = key0 + 1;
+    }
+}
+
+void DTSHierarchy::build(const std::vector<DTSNode>& nodes)
+{
+    int index, count = (int)nodes.size();
+
+    parents          .resize(count);
+    depths           .assign(count, -1);
+    preorder         .clear();
+    preorderIndex    .assign(count, -1);
+    subtreeEnds      .assign(count, -1);
+    breadthFirst     .clear();
+    breadthFirstIndex.assign(count, -1);
+
+    preorder    .reserve(count);
+    breadthFirst.reserve(count);
+
+    // Children of every node, grouped by parent with a counting sort. Roots
+    // are grouped under the extra slot at the end.
+    std::vector<int> childStarts(count + 3, 0);
+    std::vector<int> children(count);
+
+    for (index = 0; index < count; index++)
+    {
+        int parent = nodes[index].parent;
+
+        parents[index] = ((parent >= 0) && (parent < count)) ? parent : -1;
+        childStarts[(parents[index] >= 0 ? parents[index] : count) + 2]++;
+    }
+
+    for (index = 2; index < count + 3; index++)
+    {
+        childStarts[index] += childStarts[index - 1];
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        children[childStarts[(parents[index] >= 0 ? parents[index] : count) + 1]++] = index;
+    }
+
+    // childStarts[p] .. childStarts[p + 1] now hold the children of p.
+    const int roots = count;
+
+    // Breadth first: the order itself is the queue.
+    for (index = childStarts[roots]; index < childStarts[roots + 1]; index++)
+    {
+        depths[children[index]] = 0;
+        breadthFirst.push_back(children[index]);
+    }
+
+    for (size_t head = 0; head < breadthFirst.size(); head++)
+    {
+        int node = breadthFirst[head];
+
+        for (index = childStarts[node]; index < childStarts[node + 1]; index++)
+        {
+            depths[children[index]] = depths[node] + 1;
+            breadthFirst.push_back(children[index]);
+        }
+    }
+
+    // Depth first with an explicit stack, children pushed in reverse so
+    // they come out in index order.
+    std::vector<int> stack;
+
+    for (index = childStarts[roots + 1] - 1; index >= childStarts[roots]; index--)
+    {
+        stack.push_back(children[index]);
+    }
+
+    while (!stack.empty())
+    {
+        int node = stack.back();
+
+        stack.pop_back();
+
+        if (node < 0)
+        {
+            subtreeEnds[-node - 1] = (int)preorder.size();
+            continue;
+        }
+
+        preorderIndex[node] = (int)preorder.size();
+        preorder.push_back(node);
+        stack.push_back(-node - 1);
+
+        for (index = childStarts[node + 1] - 1; index >= childStarts[node]; index--)
+        {
+            stack.push_back(children[index]);
+        }
+    }
+
+    // Nodes caught in a parent loop are unreachable from the roots, keep
+    // them as roots rather than losing them.
+    for (index = 0; index < count; index++)
+    {
+        if (preorderIndex[index] < 0)
+        {
+            parents[index]       = -1;
+            depths[index]        = 0;
+            preorderIndex[index] = (int)preorder.size();
+            preorder.push_back(index);
+            subtreeEnds[index]   = (int)preorder.size();
+            breadthFirst.push_back(index);
+        }
+    }
+
+    for (index = 0; index < count; index++)
+    {
+        breadthFirstIndex[breadthFirst[index]] = index;
+    }
+}
+
 std::string DTSShape::nodeNameAtIndex(int index) const
 {
     if (index < 0)
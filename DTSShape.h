@@ -174,16 +174,37 @@ public:
     std::vector<int>          nodeIndex;
     std::vector<Matrix<4,4> > nodeTransform;
 
+    // Vertices of the mesh section of a skin, only kept (for DTSWriter) when
+    // they differ from the ones of the skin section, in verts.
+    bool                       baseVertsDiffer;
+    std::vector<Point>         baseVerts;
+    std::vector<Point>         baseNormals;
+    std::vector<unsigned char> baseEnormals;
+
     // Decal data
     std::vector<DTSCluster> clusters;
     std::vector<int>        startCluster;
     std::vector<int>        firstVerts;
     std::vector<int>        numVerts;
     std::vector<int>        firstTVerts;
+    int                     alwaysWriteDepth;
 };
 
 class DTSSequence
 {
+public:
+    enum
+    {
+        F_UniformScale    = 1 << 0,
+        F_AlignedScale    = 1 << 1,
+        F_ArbitraryScale  = 1 << 2,
+        F_Blend           = 1 << 3,
+        F_Cyclic          = 1 << 4,
+        F_MakePath        = 1 << 5,
+        F_IFLInit         = 1 << 6,
+        F_HasTranslucency = 1 << 7
+    };
+
 public:
     std::string name;
     int   nameIndex;
@@ -212,6 +233,31 @@ public:
         std::vector<bool> frame;
         std::vector<bool> matframe;
     } matters;
+
+    static bool matter(const std::vector<bool>& matters, int index)
+    {
+        return (index < (int)matters.size()) && matters[index];
+    }
+
+    // Keys surrounding a time in seconds, keys being duration / numKeyFrames apart.
+    static void keyFrames(float time, float duration, int numKeyFrames, bool cyclic, int& key0, int& key1, float& t);
+
+    void keyFrames(float time, int& key0, int& key1, float& t) const
+    {
+        keyFrames(time, duration, numKeyFrames, (flags & F_Cyclic) != 0, key0, key1, t);
+    }
+};
+
+// Location of the keys of one node for a given sequence. Rotation and
+// translation keys are numKeyFrames consecutive entries starting at the
+// first index, or -1 when the sequence does not animate that channel.
+class DTSNodeTrack
+{
+public:
+    int node;
+    int fileNode;
+    int firstRotation;
+    int firstTranslation;
 };
 
 class DTSMaterial
@@ -226,6 +272,37 @@ public:
     int         reflection;
 };
 
+// Flat view of the node tree, computed once when the shape is loaded so
+// that walking the skeleton is a sweep over contiguous arrays.
+//
+// preorder lists the nodes depth first: the subtree of node n is
+// preorder[preorderIndex[n]] up to preorder[subtreeEnds[n] - 1].
+// breadthFirst lists the nodes by increasing depth, parents first.
+class DTSHierarchy
+{
+public:
+    std::vector<int> parents;
+    std::vector<int> depths;
+    std::vector<int> preorder;
+    std::vector<int> preorderIndex;
+    std::vector<int> subtreeEnds;
+    std::vector<int> breadthFirst;
+    std::vector<int> breadthFirstIndex;
+
+public:
+    void build(const std::vector<DTSNode>& nodes);
+
+    bool isInSubtree(int node, int root) const
+    {
+        return (preorderIndex[node] >= preorderIndex[root]) && (preorderIndex[node] < subtreeEnds[root]);
+    }
+
+    int subtreeSize(int node) const
+    {
+        return subtreeEnds[node] - preorderIndex[node];
+    }
+};
+
 class DTSResolver
 {
 public:
@@ -292,6 +369,14 @@ public:
     std::vector<DTSSequence>    sequences;
     std::vector<std::string>    names;
     std::vector<DTSMaterial>    materials;
+
+    // Unused by conversions, kept so that DTSWriter gives back the file.
+    int              materialListVersion;
+    int              numExportedObjects;        // .dsq, legacy, 0 in recent files
+    int              numExportedObjectStates;   // .dsq, legacy, 0 in recent files
+    std::vector<int> meshIndexList;             // version < 16, obsolete
+
+    DTSHierarchy hierarchy;
     
 public:
     DTSShape();
@@ -306,6 +391,8 @@ public:
     
     int findNode(const char* nodeName) const;
 
+    void sequenceTracks(const DTSShape& baseShape, const DTSSequence& sequence, std::vector<DTSNodeTrack>& tracks) const;
+
     bool nodeIsLinkedToObject(int node) const;
 };
 
@@ -0,0 +1,206 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSSkin.h"
+
+DTSSkin::DTSSkin() :
+    vertexCount        (0),
+    boneCount          (0),
+    influencesPerVertex(0),
+    weightBits         (0)
+{
+}
+
+void DTSSkin::build(const DTSMesh& mesh, int count, int maxInfluences, int bits, int group)
+{
+    int index, total = (int)mesh.vindex.size();
+
+    vertexCount = count;
+    boneCount   = (int)mesh.nodeIndex.size();
+    weightBits  = bits;
+
+    // Group the influences by vertex with a counting sort, skipping the
+    // ones pointing outside the mesh.
+    std::vector<int> vertexStarts(count + 2, 0);
+    std::vector<int> influences;
+
+    for (index = 0; index < total; index++)
+    {
+        int vertex = mesh.vindex[index];
+        int bone   = mesh.vbone [index];
+
+        if ((vertex >= 0) && (vertex < count) && (bone >= 0) && (bone < boneCount) && (mesh.vweight[index] > 0.0f))
+        {
+            vertexStarts[vertex + 2]++;
+        }
+    }
+
+    for (index = 2; index < count + 2; index++)
+    {
+        vertexStarts[index] += vertexStarts[index - 1];
+    }
+
+    influences.resize(vertexStarts[count + 1]);
+
+    for (index = 0; index < total; index++)
+    {
+        int vertex = mesh.vindex[index];
+        int bone   = mesh.vbone [index];
+
+        if ((vertex >= 0) && (vertex < count) && (bone >= 0) && (bone < boneCount) && (mesh.vweight[index] > 0.0f))
+        {
+            influences[vertexStarts[vertex + 1]++] = index;
+        }
+    }
+
+    int vertex, widest = 0;
+
+    for (vertex = 0; vertex < count; vertex++)
+    {
+        int n = vertexStarts[vertex + 1] - vertexStarts[vertex];
+
+        widest = (n > widest) ? n : widest;
+    }
+
+    int limit = ((maxInfluences > 0) && (maxInfluences < widest)) ? maxInfluences : widest;
+
+    group               = (group > 1) ? group : 1;
+    influencesPerVertex = ((limit + group - 1) / group) * group;
+
+    int   width     = influencesPerVertex;
+    bool  normalize = (maxInfluences > 0) || (bits > 0);
+    float scale     = (bits > 0) ? (float)((1 << bits) - 1) : 0.0f;
+
+    joints          .assign(count * width, 0);
+    vertexWeights   .assign(count * width, 0.0f);
+    quantizedWeights.assign((bits > 0) ? count * width : 0, 0);
+
+    std::vector<int> boneCursors(boneCount + 1, 0);
+
+    for (vertex = 0; vertex < count; vertex++)
+    {
+        int*            list = influences.empty() ? NULL : &influences[vertexStarts[vertex]];
+        int             n    = vertexStarts[vertex + 1] - vertexStarts[vertex];
+        int             kept = (n < limit) ? n : limit;
+        unsigned short* j    = joints.empty() ? NULL : &joints[vertex * width];
+        float*          w    = vertexWeights.empty() ? NULL : &vertexWeights[vertex * width];
+        int             i;
+
+        // Insertion sort by decreasing weight, vertices only have a few.
+        for (i = 1; i < n; i++)
+        {
+            int entry = list[i], k = i;
+
+            while ((k > 0) && (mesh.vweight[list[k - 1]] < mesh.vweight[entry]))
+            {
+                list[k] = list[k - 1];
+                k--;
+            }
+
+            list[k] = entry;
+        }
+
+        float sum = 0.0f;
+
+        for (i = 0; i < kept; i++)
+        {
+            j[i] = (unsigned short)mesh.vbone[list[i]];
+            w[i] = mesh.vweight[list[i]];
+            sum += w[i];
+        }
+
+        if (normalize && (sum > 0.0f))
+        {
+            for (i = 0; i < kept; i++)
+            {
+                w[i] /= sum;
+            }
+        }
+
+        if ((bits > 0) && (kept > 0))
+        {
+            unsigned short* q      = &quantizedWeights[vertex * width];
+            int             qtotal = 0;
+
+            for (i = 0; i < kept; i++)
+            {
+                q[i]    = (unsigned short)floorf(w[i] * scale + 0.5f);
+                qtotal += q[i];
+            }
+
+            // Rounding error goes to the largest weight so the sum is exact.
+            q[0] = (unsigned short)(q[0] + ((int)scale - qtotal));
+
+            for (i = 0; i < kept; i++)
+            {
+                w[i] = q[i] / scale;
+            }
+        }
+
+        for (i = 0; i < kept; i++)
+        {
+            if (w[i] > 0.0f)
+            {
+                boneCursors[j[i] + 1]++;
+            }
+        }
+    }
+
+    // Bucket the surviving influences by bone.
+    for (index = 1; index <= boneCount; index++)
+    {
+        boneCursors[index] += boneCursors[index - 1];
+    }
+
+    boneStarts = boneCursors;
+    vertices.resize(boneStarts[boneCount]);
+    weights .resize(boneStarts[boneCount]);
+
+    for (vertex = 0; vertex < count; vertex++)
+    {
+        int i;
+
+        for (i = 0; i < width; i++)
+        {
+            float w = vertexWeights[vertex * width + i];
+
+            if (w > 0.0f)
+            {
+                int position = boneCursors[joints[vertex * width + i]]++;
+
+                vertices[position] = vertex;
+                weights [position] = w;
+            }
+        }
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSSkin_h
+#define DTSConverter_DTSSkin_h
+
+#include <vector>
+
+class DTSMesh;
+
+/*
+ * Skin weights of a mesh, reorganized for writers.
+ *
+ * Bones are the entries of DTSMesh::nodeIndex. The influences of bone b are
+ * vertices/weights[boneStarts[b]] up to boneStarts[b + 1], ready to be copied
+ * in bulk into one cluster.
+ *
+ * joints/vertexWeights hold influencesPerVertex entries per vertex, sorted by
+ * decreasing weight, unused slots have a zero weight (JOINTS_0/WEIGHTS_0
+ * style streams).
+ */
+class DTSSkin
+{
+public:
+    int vertexCount;
+    int boneCount;
+    int influencesPerVertex;
+    int weightBits;
+
+    std::vector<int>   boneStarts;
+    std::vector<int>   vertices;
+    std::vector<float> weights;
+
+    std::vector<unsigned short> joints;
+    std::vector<float>          vertexWeights;
+    std::vector<unsigned short> quantizedWeights;
+
+public:
+    DTSSkin();
+
+    // maxInfluences of 0 keeps every influence. weightBits of 8 or 16 snaps
+    // the weights to that many bits, keeping their sum exact; 0 keeps floats.
+    // influencesPerVertex is padded to a multiple of group (glTF sets of 4).
+    void build(const DTSMesh& mesh, int vertexCount, int maxInfluences = 0, int weightBits = 0, int group = 1);
+};
+
+#endif
@@ -0,0 +1,248 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifndef WIN32
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "DTSMemory.h"
+#include "DTSThreads.h"
+#include "DTSStats.h"
+
+static const char* phaseNames[DTSStats::P_Count] =
+{
+    "loadShapeFile", "loadSequenceFile", "buildMesh", "buildAnimation", "convertMesh", "convertAnimation", "write"
+};
+
+static const char* counterNames[DTSStats::C_Count] =
+{
+    "bytes32", "bytes16", "bytes8", "bytesRaw", "meshes", "vertices", "triangles", "keys"
+};
+
+int DTSStats::active = 0;
+
+// Times in microseconds, to be added atomically.
+static long long phaseCounts[DTSStats::P_Count];
+static long long phaseWall  [DTSStats::P_Count];
+static long long phaseCPU   [DTSStats::P_Count];
+static long long counters   [DTSStats::C_Count];
+static double    startWall = 0.0;
+static double    startCPU  = 0.0;
+
+#ifndef WIN32
+static pthread_mutex_t statsMutex = PTHREAD_MUTEX_INITIALIZER;
+#define DTS_STATS_LOCK()   pthread_mutex_lock  (&statsMutex)
+#define DTS_STATS_UNLOCK() pthread_mutex_unlock(&statsMutex)
+#else
+#define DTS_STATS_LOCK()
+#define DTS_STATS_UNLOCK()
+#endif
+
+// CPU time of every thread of the process.
+static double processSeconds()
+{
+#ifndef WIN32
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+    return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) + (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Highest resident size of the process so far, 0 when unknown.
+static long long peakResidentBytes()
+{
+#ifndef WIN32
+    struct rusage usage;
+
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (long long)usage.ru_maxrss;
+#else
+    return (long long)usage.ru_maxrss * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+static void printString(FILE* fileOut, const char* value)
+{
+    fputc('"', fileOut);
+
+    for (; *value; value++)
+    {
+        if ((*value == '"') || (*value == '\\'))
+        {
+            fputc('\\', fileOut);
+            fputc(*value, fileOut);
+        }
+        else if ((unsigned char)*value < 0x20)
+        {
+            fprintf(fileOut, "\\u%04x", (unsigned char)*value);
+        }
+        else
+        {
+            fputc(*value, fileOut);
+        }
+    }
+
+    fputc('"', fileOut);
+}
+
+// Largest groups of blocks never freed listed by end().
+#define DTS_STATS_UNFREED 10
+
+static void printAllocations(FILE* fileOut, const DTSMemoryPhaseCounts& counts)
+{
+    fprintf(fileOut, "\"allocations\": %lld, \"allocatedBytes\": %lld, \"peakLiveBytes\": %lld, \"unfreedBytes\": %lld",
+            counts.allocations, counts.bytes, counts.peakLiveBytes, counts.liveBytes);
+}
+
+void DTSStats::begin(bool allocations)
+{
+    DTS_STATS_LOCK();
+
+    if (active == 0)
+    {
+        memset(phaseCounts, 0, sizeof(phaseCounts));
+        memset(phaseWall,   0, sizeof(phaseWall));
+        memset(phaseCPU,    0, sizeof(phaseCPU));
+        memset(counters,    0, sizeof(counters));
+        startWall = DTSSeconds();
+        startCPU  = processSeconds();
+        DTSMemoryCount(true);
+        DTSMemoryProfile(allocations);
+    }
+
+    active++;
+    DTS_STATS_UNLOCK();
+}
+
+void DTSStats::end(FILE* fileOut, int argc, const char* argv[], int result)
+{
+    long long            allocations, allocationBytes;
+    DTSMemoryPhaseCounts memoryPhases[DTS_MEMORY_PHASES];
+    DTSMemoryBlocks      unfreed[DTS_STATS_UNFREED];
+    bool                 profiled = DTSMemoryProfiling();
+    int                  index, unfreedCount = 0;
+
+    DTS_STATS_LOCK();
+    DTSMemoryAllocations(allocations, allocationBytes);
+
+    if (profiled)
+    {
+        DTSMemoryPhases(memoryPhases);
+        unfreedCount = DTSMemoryUnfreed(unfreed, DTS_STATS_UNFREED);
+    }
+
+    fprintf(fileOut, "{\n  \"arguments\": [");
+
+    for (index = 1; index < argc; index++)
+    {
+        fputs((index > 1) ? ", " : "", fileOut);
+        printString(fileOut, argv[index]);
+    }
+
+    fprintf(fileOut, "],\n");
+    fprintf(fileOut, "  \"result\": %d,\n", result);
+    fprintf(fileOut, "  \"wall\": %.6f,\n", DTSSeconds() - startWall);
+    fprintf(fileOut, "  \"cpu\": %.6f,\n", processSeconds() - startCPU);
+    fprintf(fileOut, "  \"peakRSS\": %lld,\n", peakResidentBytes());
+    fprintf(fileOut, "  \"allocations\": %lld,\n", allocations);
+    fprintf(fileOut, "  \"allocatedBytes\": %lld,\n", allocationBytes);
+    fprintf(fileOut, "  \"phases\": {\n");
+
+    for (index = 0; index < P_Count; index++)
+    {
+        fprintf(fileOut, "    \"%s\": { \"count\": %lld, \"wall\": %.6f, \"cpu\": %.6f",
+                phaseNames[index], phaseCounts[index], (double)phaseWall[index] * 1e-6, (double)phaseCPU[index] * 1e-6);
+
+        if (profiled)
+        {
+            fputs(", ", fileOut);
+            printAllocations(fileOut, memoryPhases[index + 1]);
+        }
+
+        fprintf(fileOut, " }%s\n", (index + 1 < P_Count) ? "," : "");
+    }
+
+    fprintf(fileOut, "  },\n");
+
+    // Allocations outside of any phase, and the largest groups of blocks
+    // still live once the command returned: leaks, or caches kept for
+    // later commands.
+    if (profiled)
+    {
+        fprintf(fileOut, "  \"outsidePhases\": { ");
+        printAllocations(fileOut, memoryPhases[0]);
+        fprintf(fileOut, " },\n  \"unfreed\": [");
+
+        for (index = 0; index < unfreedCount; index++)
+        {
+            fprintf(fileOut, "%s\n    { \"phase\": \"%s\", \"size\": %lld, \"blocks\": %lld }", (index > 0) ? "," : "",
+                    ((unfreed[index].phase > 0) && (unfreed[index].phase <= P_Count)) ? phaseNames[unfreed[index].phase - 1] : "none", unfreed[index].size, unfreed[index].count);
+        }
+
+        fprintf(fileOut, "%s],\n", (unfreedCount > 0) ? "\n  " : "");
+    }
+
+    fprintf(fileOut, "  \"counters\": {\n");
+
+    for (index = 0; index < C_Count; index++)
+    {
+        fprintf(fileOut, "    \"%s\": %lld%s\n", counterNames[index], counters[index], (index + 1 < C_Count) ? "," : "");
+    }
+
+    fprintf(fileOut, "  }\n}\n");
+
+    if (--active == 0)
+    {
+        DTSMemoryCount(false);
+        DTSMemoryProfile(false);
+    }
+
+    DTS_STATS_UNLOCK();
+}
+
+void DTSStats::addCounter(Counter counter, long long value)
+{
+    DTSAtomicAdd(counters[counter], value);
+}
+
+void DTSStats::addPhase(Phase phase, double wall, double cpu)
+{
+    DTSAtomicAdd(phaseCounts[phase], 1);
+    DTSAtomicAdd(phaseWall  [phase], (long long)(wall * 1e6));
+    DTSAtomicAdd(phaseCPU   [phase], (long long)(cpu  * 1e6));
+}
@@ -0,0 +1,130 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSStats_h
+#define DTSConverter_DTSStats_h
+
+#include <stdio.h>
+
+#include "DTSMemory.h"
+#include "DTSThreads.h"
+
+/*
+ * Instrumentation of a command line, enabled with --stats=json: time spent
+ * in the phases of a conversion, sizes read and built, allocations and peak
+ * resident memory, written as one JSON object to stderr once the command
+ * is done, or to the file of --stats=json:file. Under serve, stderr is the
+ * client's. --stats=allocations adds the allocations of every phase and the
+ * blocks never freed, see DTSMemoryProfile.
+ *
+ * Phases add the wall and CPU time of every scope they run in, a phase
+ * running on several threads at once adds the time of each thread, and
+ * nested phases count in both. Allocations only count in the innermost
+ * phase of the thread that makes them. Figures are process wide: in a
+ * server, jobs running at the same time add to each other's statistics.
+ * Disabled, a scope or a counter costs a test of a global.
+ */
+class DTSStats
+{
+public:
+    enum Phase
+    {
+        P_LoadShapeFile,    // parse of a .dts
+        P_LoadSequenceFile, // parse of a .dsq
+        P_BuildMesh,        // triangles and skin of one mesh
+        P_BuildAnimation,   // keys of one sequence
+        P_ConvertMesh,      // FBX SDK objects of one mesh
+        P_ConvertAnimation, // FBX SDK curves of one sequence
+        P_Write,            // one output file, building included when streamed
+        P_Count
+    };
+
+    enum Counter
+    {
+        C_Bytes32,          // 32, 16 and 8 bit streams of shape files
+        C_Bytes16,
+        C_Bytes8,
+        C_BytesRaw,         // the rest of shape files, sequence files
+        C_Meshes,
+        C_Vertices,
+        C_Triangles,
+        C_Keys,             // keys of every track of every sequence
+        C_Count
+    };
+
+    static int active;
+
+public:
+    static bool enabled() { return active > 0; }
+
+    // begin() starts collecting, from zero unless another command already
+    // collects, with the allocation profile of DTSMemory when allocations
+    // is set. end() prints the figures, collecting stops after the last.
+    static void begin(bool allocations = false);
+    static void end(FILE* fileOut, int argc, const char* argv[], int result);
+
+    static void add(Counter counter, long long value)
+    {
+        if (enabled())
+        {
+            addCounter(counter, value);
+        }
+    }
+
+    static void addCounter(Counter counter, long long value);
+    static void addPhase  (Phase phase, double wall, double cpu);
+};
+
+// Times its lifetime as a phase, and marks it as the allocation phase of
+// the thread (phase + 1, DTSMemory phase 0 is outside of any).
+class DTSStatsScope
+{
+public:
+    DTSStats::Phase phase;
+    bool            enabled;
+    double          wall;
+    double          cpu;
+    int             memoryPhase;    // previous one
+
+    DTSStatsScope(DTSStats::Phase p) : phase(p), enabled(DTSStats::enabled()), wall(0.0), cpu(0.0), memoryPhase(0)
+    {
+        if (enabled)
+        {
+            wall        = DTSSeconds();
+            cpu         = DTSThreadSeconds();
+            memoryPhase = DTSMemoryPhase(phase + 1);
+        }
+    }
+
+    ~DTSStatsScope()
+    {
+        if (enabled)
+        {
+            DTSMemoryPhase(memoryPhase);
+            DTSStats::addPhase(phase, DTSSeconds() - wall, DTSThreadSeconds() - cpu);
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,472 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSWriter.h"
+#include "DTSSynthetic.h"
+#include "DTSThreads.h"
+
+// Version written, the one the loader reads every section of.
+#define DTS_SYNTHETIC_VERSION 24
+
+// Elements of a fan around a grid vertex: the center, its eight neighbours
+// and the first neighbour again.
+#define DTS_FAN_ELEMENTS 10
+
+static const struct { const char* name; int DTSSynthetic::* value; int minimum; int maximum; } parameters[] =
+{
+    { "nodes",      &DTSSynthetic::nodes,      1, 65535 },
+    { "meshes",     &DTSSynthetic::meshes,     0, 65535 },
+    { "vertices",   &DTSSynthetic::vertices,   9, 65536 },
+    { "strips",     &DTSSynthetic::strips,     0, 32767 },
+    { "fans",       &DTSSynthetic::fans,       0, 32767 },
+    { "influences", &DTSSynthetic::influences, 0, 64    },
+    { "sequences",  &DTSSynthetic::sequences,  0, 65535 },
+    { "keyframes",  &DTSSynthetic::keyFrames,  1, 65535 },
+    { "materials",  &DTSSynthetic::materials,  1, 65535 },
+    { "seed",       &DTSSynthetic::seed,       0, 0x7fffffff },
+};
+
+#define DTS_PARAMETER_COUNT (int)(sizeof(parameters) / sizeof(parameters[0]))
+
+DTSSynthetic::DTSSynthetic() :
+    nodes     (32),
+    meshes    (4),
+    vertices  (4096),
+    strips    (16),
+    fans      (16),
+    influences(4),
+    sequences (8),
+    keyFrames (60),
+    materials (2),
+    seed      (1)
+{
+}
+
+bool DTSSynthetic::parse(const char* argument)
+{
+    for (int index = 0; index < DTS_PARAMETER_COUNT; index++)
+    {
+        size_t length = strlen(parameters[index].name);
+
+        if ((strncmp(argument, parameters[index].name, length) == 0) && (argument[length] == '='))
+        {
+            char* end;
+            long  value = strtol(argument + length + 1, &end, 10);
+
+            this->*parameters[index].value = (int)value;
+            return (*end == '\0') && (value >= parameters[index].minimum) && (value <= parameters[index].maximum);
+        }
+    }
+
+    return false;
+}
+
+void DTSSynthetic::usage(FILE* fileOut)
+{
+    DTSSynthetic defaults;
+
+    fprintf(fileOut, "Synthetic shape (name=value):\n");
+
+    for (int index = 0; index < DTS_PARAMETER_COUNT; index++)
+    {
+        fprintf(fileOut, "  %-12s default %d\n", parameters[index].name, defaults.*parameters[index].value);
+    }
+}
+
+std::string DTSSynthetic::json() const
+{
+    std::string out;
+    char        field[64];
+
+    for (int index = 0; index < DTS_PARAMETER_COUNT; index++)
+    {
+        snprintf(field, sizeof(field), "%s\"%s\": %d", (index > 0) ? ", " : "", parameters[index].name, this->*parameters[index].value);
+        out += field;
+    }
+
+    return out;
+}
+
+// Small LCG, the same on every platform.
+static float nextRandom(unsigned int& state)
+{
+    state = state * 1103515245u + 12345u;
+    return (float)((state >> 8) & 0xffff) / 65536.0f;
+}
+
+static Quaternion rotationZ(float angle)
+{
+    Quaternion q = { 0.0f, 0.0f, sinf(angle * 0.5f), cosf(angle * 0.5f) };
+
+    return q;
+}
+
+static void extend(Box& bounds, const Point& p, bool first)
+{
+    if (first)
+    {
+        bounds.min = p;
+        bounds.max = p;
+        return;
+    }
+
+    bounds.min.x = (p.x < bounds.min.x) ? p.x : bounds.min.x;
+    bounds.min.y = (p.y < bounds.min.y) ? p.y : bounds.min.y;
+    bounds.min.z = (p.z < bounds.min.z) ? p.z : bounds.min.z;
+    bounds.max.x = (p.x > bounds.max.x) ? p.x : bounds.max.x;
+    bounds.max.y = (p.y > bounds.max.y) ? p.y : bounds.max.y;
+    bounds.max.z = (p.z > bounds.max.z) ? p.z : bounds.max.z;
+}
+
+static void addPrimitive(DTSMesh& mesh, int kind, int material, const std::vector<unsigned short>& elements)
+{
+    DTSPrimitive primitive;
+
+    primitive.firstElement = (short)mesh.indices.size();
+    primitive.numElements  = (short)elements.size();
+    primitive.type         = (int)(((unsigned int)kind << 30) | (unsigned int)material);
+
+    mesh.primitives.push_back(primitive);
+    mesh.indices.insert(mesh.indices.end(), elements.begin(), elements.end());
+}
+
+bool DTSSynthetic::generate(DTSShape& shape, DTSShape& sequenceFile) const
+{
+    int columns  = (int)ceilf(sqrtf((float)vertices));
+    int rows     = vertices / columns;  // complete rows
+    int elements = strips * 2 * columns + fans * DTS_FAN_ELEMENTS;
+    int index, mesh;
+
+    if ((rows < 3) || (columns < 3))
+    {
+        fprintf(DTSErrorFile(), "Synthetic meshes need at least 3 complete rows of vertices\n");
+        return false;
+    }
+
+    // Primitives start at 16 bit offsets.
+    if (elements - ((fans > 0) ? DTS_FAN_ELEMENTS : 2 * columns) > 32767)
+    {
+        fprintf(DTSErrorFile(), "Too many strips and fans for one mesh: %d indices\n", elements);
+        return false;
+    }
+
+    if (influences > nodes)
+    {
+        fprintf(DTSErrorFile(), "More influences than nodes\n");
+        return false;
+    }
+
+    unsigned int state = (unsigned int)seed;
+
+    shape = DTSShape();
+    shape.dtsVersion = DTS_SYNTHETIC_VERSION;
+
+    // Nodes, a binary tree.
+    shape.nodes.resize(nodes);
+    shape.nodeDefRotations   .resize(nodes);
+    shape.nodeDefTranslations.resize(nodes);
+
+    for (index = 0; index < nodes; index++)
+    {
+        DTSNode& node(shape.nodes[index]);
+        char     name[32];
+
+        node.name        = (int)shape.names.size();
+        node.parent      = (index > 0) ? (index - 1) / 2 : -1;
+        node.firstObject = -1;
+        node.child       = (2 * index + 1 < nodes) ? 2 * index + 1 : -1;
+        node.sibling     = ((index % 2 == 1) && (index + 1 < nodes)) ? index + 1 : -1;
+
+        Point translation = { (index % 2) ? 0.5f : -0.5f, 0.0f, (index > 0) ? 1.0f : 0.0f };
+
+        shape.nodeDefRotations   [index] = rotationZ(0.0f);
+        shape.nodeDefTranslations[index] = translation;
+
+        snprintf(name, sizeof(name), "node%d", index);
+        shape.names.push_back(name);
+    }
+
+    // Meshes, one object each.
+    std::vector<unsigned short> primitive;
+    int                         triangles = 0;
+    bool                        first     = true;
+
+    shape.objects.resize(meshes);
+    shape.meshes .resize(meshes);
+
+    for (mesh = 0; mesh < meshes; mesh++)
+    {
+        DTSObject& object(shape.objects[mesh]);
+        DTSMesh&   out(shape.meshes[mesh]);
+        char       name[32];
+
+        snprintf(name, sizeof(name), "mesh%d", mesh);
+        object.name       = (int)shape.names.size();
+        object.numMeshes  = 1;
+        object.firstMesh  = mesh;
+        object.node       = mesh % nodes;
+        object.sibling    = -1;
+        object.firstDecal = -1;
+        shape.names.push_back(name);
+
+        out.type          = (influences > 0) ? DTSMesh::T_Skin : DTSMesh::T_Standard;
+        out.numFrames     = 1;
+        out.matFrames     = 1;
+        out.parent        = -1;
+        out.vertsPerFrame = vertices;
+        out.flags         = 0;
+
+        out.baseVertsDiffer  = false;
+        out.alwaysWriteDepth = 0;
+
+        out.verts   .resize(vertices);
+        out.tverts  .resize(vertices);
+        out.normals .resize(vertices);
+        out.enormals.resize(vertices);
+
+        for (index = 0; index < vertices; index++)
+        {
+            Point   p  = { (float)(index % columns), (float)(index / columns), nextRandom(state) };
+            Point   n  = { 0.0f, 0.0f, 1.0f };
+            Point2D uv = { (float)(index % columns) / columns, (float)(index / columns) / columns };
+
+            out.verts   [index] = p;
+            out.tverts  [index] = uv;
+            out.normals [index] = n;
+            out.enormals[index] = (unsigned char)(nextRandom(state) * 256.0f);
+
+            extend(out.bounds, p, index == 0);
+            extend(shape.bounds, p, first);
+            first = false;
+        }
+
+        out.center.x = (out.bounds.min.x + out.bounds.max.x) * 0.5f;
+        out.center.y = (out.bounds.min.y + out.bounds.max.y) * 0.5f;
+        out.center.z = (out.bounds.min.z + out.bounds.max.z) * 0.5f;
+        out.radius   = (float)columns;
+
+        // Strips over pairs of rows, then fans around interior vertices.
+        for (index = 0; index < strips; index++)
+        {
+            int row = index % (rows - 1);
+
+            primitive.clear();
+
+            for (int column = 0; column < columns; column++)
+            {
+                primitive.push_back((unsigned short)(row * columns + column));
+                primitive.push_back((unsigned short)((row + 1) * columns + column));
+            }
+
+            addPrimitive(out, 1, index % materials, primitive);
+            triangles += 2 * columns - 2;
+        }
+
+        for (index = 0; index < fans; index++)
+        {
+            static const int ring[9][2] = { { -1, -1 }, { 0, -1 }, { 1, -1 }, { 1, 0 }, { 1, 1 }, { 0, 1 }, { -1, 1 }, { -1, 0 }, { -1, -1 } };
+
+            int column = 1 + (int)(nextRandom(state) * (columns - 2));
+            int row    = 1 + (int)(nextRandom(state) * (rows    - 2));
+
+            primitive.clear();
+            primitive.push_back((unsigned short)(row * columns + column));
+
+            for (int neighbour = 0; neighbour < 9; neighbour++)
+            {
+                primitive.push_back((unsigned short)((row + ring[neighbour][1]) * columns + column + ring[neighbour][0]));
+            }
+
+            addPrimitive(out, 2, (strips + index) % materials, primitive);
+            triangles += DTS_FAN_ELEMENTS - 2;
+        }
+
+        if (out.type != DTSMesh::T_Skin)
+        {
+            continue;
+        }
+
+        // Every node is a bone, a vertex is bound to consecutive bones with
+        // decreasing weights.
+        float total = 0.0f;
+        int   influence;
+
+        for (influence = 0; influence < influences; influence++)
+        {
+            total += (float)(influences - influence);
+        }
+
+        out.nodeIndex    .resize(nodes);
+        out.nodeTransform.resize(nodes);
+
+        for (index = 0; index < nodes; index++)
+        {
+            Matrix<4,4>& m(out.nodeTransform[index]);
+
+            memset(m.data, 0, sizeof(m.data));
+            m.data[0] = m.data[5] = m.data[10] = m.data[15] = 1.0f;
+            out.nodeIndex[index] = index;
+        }
+
+        for (index = 0; index < vertices; index++)
+        {
+            int bone = (int)((long long)index * nodes / vertices);
+
+            for (influence = 0; influence < influences; influence++)
+            {
+                out.vindex .push_back(index);
+                out.vbone  .push_back((bone + influence) % nodes);
+                out.vweight.push_back((float)(influences - influence) / total);
+            }
+        }
+    }
+
+    shape.subshapes.resize(1);
+    shape.subshapes[0].firstNode        = 0;
+    shape.subshapes[0].firstObject      = 0;
+    shape.subshapes[0].firstDecal       = 0;
+    shape.subshapes[0].numNodes         = nodes;
+    shape.subshapes[0].numObjects       = meshes;
+    shape.subshapes[0].numDecals        = 0;
+    shape.subshapes[0].firstTranslucent = meshes;
+
+    DTSObjectState state0 = { 1.0f, 0, 0 };
+
+    shape.objectStates.assign(meshes, state0);
+
+    DTSDetailLevel detail;
+
+    detail.name         = (int)shape.names.size();
+    detail.subshape     = 0;
+    detail.objectDetail = 0;
+    detail.size         = 2.0f;
+    detail.avgError     = -1.0f;
+    detail.maxError     = -1.0f;
+    detail.polyCount    = triangles;
+    shape.detailLevels.push_back(detail);
+    shape.names.push_back("detail2");
+
+    shape.smallestSize        = 2.0f;
+    shape.smallestDetailLevel = 0;
+    shape.center.x            = (shape.bounds.min.x + shape.bounds.max.x) * 0.5f;
+    shape.center.y            = (shape.bounds.min.y + shape.bounds.max.y) * 0.5f;
+    shape.center.z            = (shape.bounds.min.z + shape.bounds.max.z) * 0.5f;
+    shape.radius              = (float)sqrt((double)vertices);
+    shape.tubeRadius          = shape.radius;
+
+    for (index = 0; index < materials; index++)
+    {
+        DTSMaterial material;
+        char        name[32];
+
+        snprintf(name, sizeof(name), "synthetic%d", index);
+        material.name        = name;
+        material.flags       = 0;
+        material.reflectance = -1;
+        material.bump        = -1;
+        material.detail      = -1;
+        material.detailScale = 0;
+        material.reflection  = 0;
+        shape.materials.push_back(material);
+    }
+
+    // Sequence file, nodes known by name, keys of a node consecutive.
+    sequenceFile = DTSShape();
+    sequenceFile.dtsVersion = DTS_SYNTHETIC_VERSION;
+    sequenceFile.names.assign(shape.names.begin(), shape.names.begin() + nodes);
+
+    for (int sequence = 0; sequence < sequences; sequence++)
+    {
+        DTSSequence s;
+        char        name[32];
+
+        snprintf(name, sizeof(name), "sequence%d", sequence);
+        s.name             = name;
+        s.nameIndex        = -1;
+        s.flags            = DTSSequence::F_Cyclic;
+        s.numKeyFrames     = keyFrames;
+        s.duration         = keyFrames / 30.0f;
+        s.priority         = 0;
+        s.firstGroundFrame = 0;
+        s.numGroundFrames  = 0;
+        s.baseRotation     = (int)sequenceFile.nodeRotations.size();
+        s.baseTranslation  = (int)sequenceFile.nodeTranslations.size();
+        s.baseScale        = 0;
+        s.baseObjectState  = 0;
+        s.baseDecalState   = 0;
+        s.firstTrigger     = 0;
+        s.numTriggers      = 0;
+        s.toolBegin        = 0.0f;
+
+        s.matters.rotation   .assign((nodes + 31) & ~31, false);
+        s.matters.translation.assign((nodes + 31) & ~31, false);
+
+        for (index = 0; index < nodes; index++)
+        {
+            float phase = nextRandom(state) * 6.2831853f;
+
+            s.matters.rotation   [index] = true;
+            s.matters.translation[index] = true;
+
+            for (int key = 0; key < keyFrames; key++)
+            {
+                float angle       = 0.5f * sinf(phase + 6.2831853f * key / keyFrames);
+                Point translation = shape.nodeDefTranslations[index];
+
+                translation.z += 0.1f * angle;
+                sequenceFile.nodeRotations   .push_back(rotationZ(angle));
+                sequenceFile.nodeTranslations.push_back(translation);
+            }
+        }
+
+        sequenceFile.sequences.push_back(s);
+    }
+
+    return true;
+}
+
+bool DTSSynthetic::write(const char* shapePath, const char* sequencePath) const
+{
+    DTSShape  shape, sequenceFile;
+    DTSWriter shapeWriter, sequenceWriter;
+
+    if (!generate(shape, sequenceFile))
+    {
+        return false;
+    }
+
+    shapeWriter.writeShapeFile(shape);
+    sequenceWriter.writeSequenceFile(sequenceFile);
+
+    return shapeWriter.save(shapePath) && sequenceWriter.save(sequencePath);
+}
@@ -0,0 +1,72 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSSynthetic_h
+#define DTSConverter_DTSSynthetic_h
+
+#include <stdio.h>
+#include <string>
+
+class DTSShape;
+
+/*
+ * Synthetic shape and sequence files, for benchmarks and tests without
+ * assets. The shape is a binary tree of nodes and meshes of vertices laid
+ * out on a grid, covered by triangle strips (one pair of grid rows each) and
+ * fans (the eight neighbours of a vertex). Meshes are skinned to every node
+ * unless influences is 0. The sequence file animates the rotation and the
+ * translation of every node. Contents only depend on the parameters.
+ */
+class DTSSynthetic
+{
+public:
+    int nodes;
+    int meshes;
+    int vertices;       // per mesh
+    int strips;         // per mesh
+    int fans;           // per mesh
+    int influences;     // per vertex, 0 for rigid meshes
+    int sequences;
+    int keyFrames;      // per sequence
+    int materials;
+    int seed;
+
+public:
+    DTSSynthetic();
+
+    // name=value, returns false when the name is unknown or the value invalid.
+    bool parse(const char* argument);
+
+    static void usage(FILE* fileOut);
+
+    // Returns false, with a message, when the format can't hold the meshes.
+    bool generate(DTSShape& shape, DTSShape& sequenceFile) const;
+
+    bool write(const char* shapePath, const char* sequencePath) const;
+
+    // Parameters as the fields of a JSON object, without braces.
+    std::string json() const;
+};
+
+#endif
@@ -0,0 +1,205 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+
+#include <time.h>
+
+#ifndef WIN32
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/time.h>
+#endif
+
+#include "DTSThreads.h"
+
+int DTSThreadCount()
+{
+#if !defined(WIN32) && defined(_SC_NPROCESSORS_ONLN)
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return (count > 1) ? (int)count : 1;
+#else
+    return 1;
+#endif
+}
+
+double DTSSeconds()
+{
+#ifndef WIN32
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (double)now.tv_sec + (double)now.tv_usec * 1e-6;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+double DTSThreadSeconds()
+{
+#if !defined(WIN32) && defined(CLOCK_THREAD_CPUTIME_ID)
+    struct timespec now;
+
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+#else
+    return (double)clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+static DTS_THREAD_LOCAL DTSCancelCheck cancelCheck   = NULL;
+static DTS_THREAD_LOCAL void*          cancelContext = NULL;
+
+void DTSSetCancelCheck(DTSCancelCheck check, void* context)
+{
+    cancelCheck   = check;
+    cancelContext = context;
+}
+
+void DTSGetCancelCheck(DTSCancelCheck& check, void*& context)
+{
+    check   = cancelCheck;
+    context = cancelContext;
+}
+
+bool DTSCancelled()
+{
+    return cancelCheck && cancelCheck(cancelContext);
+}
+
+static DTS_THREAD_LOCAL FILE* errorFile = NULL;
+
+void DTSSetErrorFile(FILE* file)
+{
+    errorFile = file;
+}
+
+FILE* DTSErrorFile()
+{
+    return errorFile ? errorFile : stderr;
+}
+
+#ifndef WIN32
+
+class DTSParallelLoop
+{
+public:
+    DTSTask*        task;
+    DTSCancelCheck  check;
+    void*           context;
+    FILE*           errors;
+    int             count;
+    int             next;
+    pthread_mutex_t mutex;
+
+    // Hands out indexes one at a time, items are coarse (a mesh, a sequence).
+    int take()
+    {
+        int index;
+
+        pthread_mutex_lock(&mutex);
+        index = (next < count) ? next++ : -1;
+        pthread_mutex_unlock(&mutex);
+        return index;
+    }
+
+    void work()
+    {
+        int index;
+
+        while ((index = take()) >= 0)
+        {
+            task->run(index);
+        }
+    }
+
+    static void* entry(void* loop)
+    {
+        DTSSetCancelCheck(((DTSParallelLoop*)loop)->check, ((DTSParallelLoop*)loop)->context);
+        DTSSetErrorFile(((DTSParallelLoop*)loop)->errors);
+        ((DTSParallelLoop*)loop)->work();
+        return NULL;
+    }
+};
+
+#endif
+
+void DTSParallelFor(int count, DTSTask& task, int threads)
+{
+    int index;
+
+    if (threads <= 0)
+    {
+        threads = DTSThreadCount();
+    }
+
+    if (threads > count)
+    {
+        threads = count;
+    }
+
+#ifndef WIN32
+    if (threads > 1)
+    {
+        DTSParallelLoop        loop;
+        std::vector<pthread_t> workers(threads - 1);
+        int                    started = 0;
+
+        loop.task  = &task;
+        loop.count = count;
+        loop.next  = 0;
+        DTSGetCancelCheck(loop.check, loop.context);
+        loop.errors = DTSErrorFile();
+        pthread_mutex_init(&loop.mutex, NULL);
+
+        for (index = 0; index < threads - 1; index++)
+        {
+            if (pthread_create(&workers[started], NULL, DTSParallelLoop::entry, &loop) == 0)
+            {
+                started++;
+            }
+        }
+
+        // The calling thread works too, and finishes the loop alone if no
+        // worker could be started.
+        loop.work();
+
+        for (index = 0; index < started; index++)
+        {
+            pthread_join(workers[index], NULL);
+        }
+
+        pthread_mutex_destroy(&loop.mutex);
+        return;
+    }
+#endif
+
+    for (index = 0; index < count; index++)
+    {
+        task.run(index);
+    }
+}
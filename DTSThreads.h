@@ -0,0 +1,86 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSThreads_h
+#define DTSConverter_DTSThreads_h
+
+#include <stdio.h>
+
+/*
+ * Minimal thread pool for embarrassingly parallel loops. Subclass DTSTask,
+ * run() is called once for every index in [0, count), from any thread and
+ * in no particular order. Builds without pthreads run the loop serially.
+ */
+class DTSTask
+{
+public:
+    virtual ~DTSTask() {}
+    virtual void run(int index) = 0;
+};
+
+// Number of hardware threads, at least 1.
+int DTSThreadCount();
+
+#ifdef _MSC_VER
+#define DTS_THREAD_LOCAL __declspec(thread)
+#else
+#define DTS_THREAD_LOCAL __thread
+#endif
+
+// Cooperative cancellation of the work of the calling thread: long running
+// commands poll DTSCancelled() between stages, check returning true stops
+// them. Workers inherit the check of the thread that starts them.
+typedef bool (*DTSCancelCheck)(void* context);
+
+void DTSSetCancelCheck(DTSCancelCheck check, void* context);
+void DTSGetCancelCheck(DTSCancelCheck& check, void*& context);
+bool DTSCancelled();
+
+// Where the calling thread writes its diagnostics, stderr unless set: a
+// server sends those of a job to its client. Workers inherit the file of
+// the thread that starts them. NULL goes back to stderr.
+void  DTSSetErrorFile(FILE* file);
+FILE* DTSErrorFile();
+
+// Wall clock in seconds, for durations.
+double DTSSeconds();
+
+// CPU time used by the calling thread, in seconds.
+double DTSThreadSeconds();
+
+// Adds delta to a counter updated by several threads.
+inline void DTSAtomicAdd(long long& value, long long delta)
+{
+#ifndef WIN32
+    __sync_fetch_and_add(&value, delta);
+#else
+    // Loops run serially.
+    value += delta;
+#endif
+}
+
+// threads <= 0 uses DTSThreadCount(). Returns once every index has run.
+void DTSParallelFor(int count, DTSTask& task, int threads = 0);
+
+#endif
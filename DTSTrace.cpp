@@ -0,0 +1,260 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <pthread.h>
+#endif
+
+#include "DTSThreads.h"
+#include "DTSTrace.h"
+
+class DTSTraceEvent
+{
+public:
+    const char* name;
+    std::string asset;
+    double      start;
+    double      end;
+};
+
+// Events are appended by their thread and read by end() in another one,
+// both under the lock of the buffer.
+class DTSTraceBuffer
+{
+public:
+    int                        thread;  // in order of the first span
+    bool                       exited;
+    std::vector<DTSTraceEvent> events;
+#ifndef WIN32
+    pthread_mutex_t            mutex;
+#endif
+};
+
+int DTSTrace::active = 0;
+
+static std::vector<DTSTraceBuffer*>     buffers;
+static int                              threadCount  = 0;
+static double                           startTime    = 0.0;
+static DTS_THREAD_LOCAL DTSTraceBuffer* threadBuffer = NULL;
+
+#ifndef WIN32
+static pthread_mutex_t traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t   exitKey;
+static pthread_once_t  exitOnce   = PTHREAD_ONCE_INIT;
+#define DTS_TRACE_LOCK()   pthread_mutex_lock  (&traceMutex)
+#define DTS_TRACE_UNLOCK() pthread_mutex_unlock(&traceMutex)
+#define DTS_BUFFER_LOCK(buffer)   pthread_mutex_lock  (&(buffer)->mutex)
+#define DTS_BUFFER_UNLOCK(buffer) pthread_mutex_unlock(&(buffer)->mutex)
+
+// The buffer of a finished thread is written and deleted by end().
+static void threadExited(void* buffer)
+{
+    DTS_TRACE_LOCK();
+    ((DTSTraceBuffer*)buffer)->exited = true;
+    DTS_TRACE_UNLOCK();
+}
+
+static void createExitKey()
+{
+    pthread_key_create(&exitKey, threadExited);
+}
+#else
+#define DTS_TRACE_LOCK()
+#define DTS_TRACE_UNLOCK()
+#define DTS_BUFFER_LOCK(buffer)
+#define DTS_BUFFER_UNLOCK(buffer)
+#endif
+
+static DTSTraceBuffer* registerThread()
+{
+    DTSTraceBuffer* buffer = new DTSTraceBuffer;
+
+    buffer->exited = false;
+
+#ifndef WIN32
+    pthread_mutex_init(&buffer->mutex, NULL);
+    pthread_once(&exitOnce, createExitKey);
+    pthread_setspecific(exitKey, buffer);
+#endif
+
+    DTS_TRACE_LOCK();
+    buffer->thread = ++threadCount;
+    buffers.push_back(buffer);
+    DTS_TRACE_UNLOCK();
+    return buffer;
+}
+
+static void printString(FILE* file, const char* value)
+{
+    fputc('"', file);
+
+    for (; *value; value++)
+    {
+        if ((*value == '"') || (*value == '\\'))
+        {
+            fputc('\\', file);
+            fputc(*value, file);
+        }
+        else if ((unsigned char)*value < 0x20)
+        {
+            fprintf(file, "\\u%04x", (unsigned char)*value);
+        }
+        else
+        {
+            fputc(*value, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+void DTSTrace::begin()
+{
+    DTS_TRACE_LOCK();
+
+    if (active++ == 0)
+    {
+        startTime = DTSSeconds();
+    }
+
+    DTS_TRACE_UNLOCK();
+}
+
+bool DTSTrace::end(const char* path)
+{
+    FILE* file = fopen(path, "w");
+    bool  first = true;
+
+    DTS_TRACE_LOCK();
+
+    if (file)
+    {
+        std::vector<DTSTraceBuffer*>::const_iterator it, end(buffers.end());
+
+        fprintf(file, "{\"traceEvents\":[\n");
+
+        for (it = buffers.begin(); it != end; ++it)
+        {
+            DTSTraceBuffer& buffer(**it);
+
+            DTS_BUFFER_LOCK(&buffer);
+
+            if (buffer.events.empty())
+            {
+                DTS_BUFFER_UNLOCK(&buffer);
+                continue;
+            }
+
+            fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                    first ? "" : ",\n", buffer.thread, buffer.thread);
+            first = false;
+
+            std::vector<DTSTraceEvent>::const_iterator eventIt, eventEnd(buffer.events.end());
+
+            for (eventIt = buffer.events.begin(); eventIt != eventEnd; ++eventIt)
+            {
+                const DTSTraceEvent& event(*eventIt);
+
+                fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"dts2fbx\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.1f,\"dur\":%.1f",
+                        event.name, buffer.thread, (event.start - startTime) * 1e6, (event.end - event.start) * 1e6);
+
+                if (!event.asset.empty())
+                {
+                    fprintf(file, ",\"args\":{\"asset\":");
+                    printString(file, event.asset.c_str());
+                    fputc('}', file);
+                }
+
+                fputc('}', file);
+            }
+
+            DTS_BUFFER_UNLOCK(&buffer);
+        }
+
+        fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    }
+
+    // The threads still running keep their buffer.
+    if (--active == 0)
+    {
+        std::vector<DTSTraceBuffer*> running;
+
+        for (size_t index = 0; index < buffers.size(); index++)
+        {
+            DTSTraceBuffer* buffer = buffers[index];
+
+            if (buffer->exited)
+            {
+#ifndef WIN32
+                pthread_mutex_destroy(&buffer->mutex);
+#endif
+                delete buffer;
+            }
+            else
+            {
+                DTS_BUFFER_LOCK(buffer);
+                buffer->events.clear();
+                DTS_BUFFER_UNLOCK(buffer);
+                running.push_back(buffer);
+            }
+        }
+
+        buffers.swap(running);
+    }
+
+    DTS_TRACE_UNLOCK();
+
+    return file && (fclose(file) == 0);
+}
+
+void DTSTrace::add(const char* name, const char* asset, double start, double end)
+{
+    DTSTraceBuffer* buffer = threadBuffer;
+
+    if (!buffer)
+    {
+        buffer = threadBuffer = registerThread();
+    }
+
+    DTS_BUFFER_LOCK(buffer);
+    buffer->events.push_back(DTSTraceEvent());
+
+    DTSTraceEvent& event(buffer->events.back());
+
+    event.name  = name;
+    event.start = start;
+    event.end   = end;
+
+    if (asset)
+    {
+        event.asset = asset;
+    }
+
+    DTS_BUFFER_UNLOCK(buffer);
+}
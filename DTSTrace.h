@@ -0,0 +1,86 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSTrace_h
+#define DTSConverter_DTSTrace_h
+
+#include "DTSThreads.h"
+
+/*
+ * Timeline of a command line, enabled with --trace=file.json: spans of the
+ * loads, mesh decoding and building, sequence baking and writer sections,
+ * written in the Chrome trace event format (chrome://tracing, Perfetto).
+ *
+ * Every thread appends to a buffer of its own under a lock of the buffer,
+ * only contended while end() reads it, and its first span takes the global
+ * lock to register the buffer. Buffers are written when the command ends.
+ * Like the statistics the timeline is process wide, in a server it shows
+ * every job running at the same time.
+ * Disabled, a span costs a test of a global.
+ */
+class DTSTrace
+{
+public:
+    static int active;
+
+public:
+    static bool enabled() { return active > 0; }
+
+    // begin() starts recording, end() writes every span recorded so far,
+    // they are dropped after the last command recording ends.
+    static void begin();
+    static bool end(const char* path);
+
+    // name is kept, a literal, asset is copied and may be NULL.
+    static void add(const char* name, const char* asset, double start, double end);
+};
+
+// Records its lifetime as a span. asset (a file, a mesh or a sequence name)
+// must outlive the scope.
+class DTSTraceScope
+{
+public:
+    const char* name;
+    const char* asset;
+    double      start;
+
+    DTSTraceScope(const char* n, const char* a = 0) : name(n), asset(a), start(DTSTrace::enabled() ? DTSSeconds() : 0.0) {}
+
+    ~DTSTraceScope()
+    {
+        end();
+    }
+
+    // Ends the span before the scope does.
+    void end()
+    {
+        if (start != 0.0)
+        {
+            DTSTrace::add(name, asset, start, DTSSeconds());
+            start = 0.0;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,532 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <dirent.h>
+#include <fnmatch.h>
+#include <glob.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "DTSOptions.h"
+#include "DTSThreads.h"
+#include "DTSBatch.h"
+#include "DTSWatch.h"
+
+// Changes closer than this are rebuilt together.
+#define DTS_WATCH_QUIET_MS 250
+
+#ifndef WIN32
+
+static std::string normalizePath(const std::string& path)
+{
+    size_t start = 0;
+
+    while (path.compare(start, 2, "./") == 0)
+    {
+        start += 2;
+    }
+
+    return path.substr(start);
+}
+
+static std::string directoryOf(const std::string& path)
+{
+    size_t slash = path.rfind('/');
+
+    if (slash == std::string::npos)
+    {
+        return ".";
+    }
+
+    return (slash == 0) ? "/" : path.substr(0, slash);
+}
+
+// In nanoseconds where the system keeps them.
+static long long modificationTime(const struct stat& s)
+{
+#if defined(__APPLE__)
+    return (long long)s.st_mtimespec.tv_sec * 1000000000 + s.st_mtimespec.tv_nsec;
+#elif defined(__linux__)
+    return (long long)s.st_mtim.tv_sec * 1000000000 + s.st_mtim.tv_nsec;
+#else
+    return (long long)s.st_mtime * 1000000000;
+#endif
+}
+
+static long long modificationTime(const std::string& path)
+{
+    struct stat s;
+
+    return (stat(path.c_str(), &s) == 0) ? modificationTime(s) : 0;
+}
+
+static bool outdated(const DTSBatchJob& job)
+{
+    long long output = modificationTime(job.output);
+    long long source = modificationTime(job.shapeFile);
+
+    for (size_t index = 0; index < job.sequenceFiles.size(); index++)
+    {
+        long long time = modificationTime(job.sequenceFiles[index]);
+
+        source = (time > source) ? time : source;
+    }
+
+    for (size_t index = 0; index < job.textures.size(); index++)
+    {
+        long long time = modificationTime(job.textures[index]);
+
+        source = (time > source) ? time : source;
+    }
+
+    // File systems stamp at a clock tick: an output of the same tick may
+    // predate the source, and is rebuilt rather than trusted.
+    return (output == 0) || (output <= source);
+}
+
+static bool affected(const DTSBatchJob& job, const std::set<std::string>& changed)
+{
+    std::set<std::string>::const_iterator it, end(changed.end());
+
+    for (it = changed.begin(); it != end; ++it)
+    {
+        const std::string& path(*it);
+
+        if (normalizePath(job.shapeFile) == path)
+        {
+            return true;
+        }
+
+        for (size_t index = 0; index < job.patterns.size(); index++)
+        {
+            if (fnmatch(normalizePath(job.patterns[index]).c_str(), path.c_str(), FNM_PATHNAME) == 0)
+            {
+                return true;
+            }
+        }
+
+        for (size_t index = 0; index < job.textures.size(); index++)
+        {
+            if (normalizePath(job.textures[index]) == path)
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+class DTSScanTask : public DTSTask
+{
+public:
+    std::vector<DTSBatchJob>& jobs;
+    const DTSOptions&         options;
+
+    DTSScanTask(std::vector<DTSBatchJob>& j, const DTSOptions& o) : jobs(j), options(o) {}
+
+    void run(int index)
+    {
+        DTSBatch::scan(jobs[index], options);
+    }
+};
+
+static bool isDirectory(const std::string& path)
+{
+    struct stat s;
+
+    return (stat(path.c_str(), &s) == 0) && S_ISDIR(s.st_mode);
+}
+
+/*
+ * Directories of the dependencies. With inotify on Linux, elsewhere by
+ * listing them every second and comparing the modification times and
+ * sizes of their files.
+ */
+class DTSWatcher
+{
+public:
+    std::set<std::string> watched;
+
+#ifdef __linux__
+    int                        fd;
+    std::map<int, std::string> directories;
+
+    DTSWatcher() : fd(inotify_init()) {}
+    ~DTSWatcher() { if (fd >= 0) close(fd); }
+
+    bool started() const { return fd >= 0; }
+#else
+    class FileState
+    {
+    public:
+        long long time;
+        long long size;
+
+        bool operator!=(const FileState& other) const { return (time != other.time) || (size != other.size); }
+    };
+
+    typedef std::map<std::string, FileState> Listing;
+
+    std::map<std::string, Listing> listings;
+
+    bool started() const { return true; }
+#endif
+
+    // Directories of the files path may match: its own, or those matched
+    // by a directory with wildcards. Directories created later are only
+    // seen when the jobs are watched again, after a rebuild.
+    void watch(const std::string& path)
+    {
+        std::string directory(directoryOf(normalizePath(path)));
+
+        if (directory.find_first_of("*?[") == std::string::npos)
+        {
+            add(directory);
+            return;
+        }
+
+        glob_t g;
+
+        if (glob(directory.c_str(), 0, NULL, &g) == 0)
+        {
+            for (size_t index = 0; index < g.gl_pathc; index++)
+            {
+                add(g.gl_pathv[index]);
+            }
+        }
+
+        globfree(&g);
+    }
+
+    void watch(const std::vector<DTSBatchJob>& jobs)
+    {
+        std::vector<DTSBatchJob>::const_iterator it, end(jobs.end());
+
+        for (it = jobs.begin(); it != end; ++it)
+        {
+            watch((*it).shapeFile);
+
+            for (size_t index = 0; index < (*it).patterns.size(); index++)
+            {
+                watch((*it).patterns[index]);
+            }
+
+            for (size_t index = 0; index < (*it).textures.size(); index++)
+            {
+                watch((*it).textures[index]);
+            }
+        }
+    }
+
+#ifdef __linux__
+    void add(const std::string& directory)
+    {
+        if ((watched.find(directory) != watched.end()) || !isDirectory(directory))
+        {
+            return;
+        }
+
+        int wd = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE);
+
+        if (wd >= 0)
+        {
+            watched.insert(directory);
+            directories[wd] = directory;
+        }
+    }
+
+    // Waits up to a second for a change, so that cancellation is seen, then
+    // collects until quiet.
+    void wait(std::set<std::string>& changed)
+    {
+        char buffer[16384] __attribute__((aligned(__alignof__(struct inotify_event))));
+        int  timeout = 1000;
+
+        for (;;)
+        {
+            struct pollfd p;
+
+            p.fd      = fd;
+            p.events  = POLLIN;
+            p.revents = 0;
+
+            int ready = poll(&p, 1, timeout);
+
+            if ((ready < 0) && (errno == EINTR))
+            {
+                continue;
+            }
+
+            if (ready <= 0)
+            {
+                return;
+            }
+
+            ssize_t length = read(fd, buffer, sizeof(buffer));
+
+            if (length <= 0)
+            {
+                return;
+            }
+
+            for (char* at = buffer; at < buffer + length; )
+            {
+                const struct inotify_event* event = (const struct inotify_event*)at;
+
+                if ((event->len > 0) && (directories.find(event->wd) != directories.end()))
+                {
+                    const std::string& directory(directories[event->wd]);
+
+                    changed.insert((directory == ".") ? std::string(event->name) : directory + "/" + event->name);
+                }
+
+                at += sizeof(struct inotify_event) + event->len;
+            }
+
+            timeout = DTS_WATCH_QUIET_MS;
+        }
+    }
+#else
+    static void list(const std::string& directory, Listing& listing)
+    {
+        DIR*           d = opendir(directory.c_str());
+        struct dirent* entry;
+
+        listing.clear();
+
+        while (d && ((entry = readdir(d)) != NULL))
+        {
+            std::string path((directory == ".") ? std::string(entry->d_name) : directory + "/" + entry->d_name);
+            struct stat s;
+
+            if ((stat(path.c_str(), &s) == 0) && S_ISREG(s.st_mode))
+            {
+                FileState& state(listing[path]);
+
+                state.time = modificationTime(s);
+                state.size = (long long)s.st_size;
+            }
+        }
+
+        if (d)
+        {
+            closedir(d);
+        }
+    }
+
+    void add(const std::string& directory)
+    {
+        if ((watched.find(directory) != watched.end()) || !isDirectory(directory))
+        {
+            return;
+        }
+
+        watched.insert(directory);
+        list(directory, listings[directory]);
+    }
+
+    // Files added, removed or changed since the previous listing, returns
+    // whether there was any.
+    bool compare(std::set<std::string>& changed)
+    {
+        bool any = false;
+
+        std::map<std::string, Listing>::iterator it, end(listings.end());
+
+        for (it = listings.begin(); it != end; ++it)
+        {
+            Listing current;
+
+            list((*it).first, current);
+
+            Listing::const_iterator file, fileEnd(current.end());
+
+            for (file = current.begin(); file != fileEnd; ++file)
+            {
+                Listing::const_iterator previous((*it).second.find((*file).first));
+
+                if ((previous == (*it).second.end()) || ((*previous).second != (*file).second))
+                {
+                    changed.insert((*file).first);
+                    any = true;
+                }
+            }
+
+            for (file = (*it).second.begin(), fileEnd = (*it).second.end(); file != fileEnd; ++file)
+            {
+                if (current.find((*file).first) == current.end())
+                {
+                    changed.insert((*file).first);
+                    any = true;
+                }
+            }
+
+            (*it).second.swap(current);
+        }
+
+        return any;
+    }
+
+    // Lists again after a second, so that cancellation is seen, then until
+    // nothing changed for a moment.
+    void wait(std::set<std::string>& changed)
+    {
+        usleep(1000 * 1000);
+
+        if (!compare(changed))
+        {
+            return;
+        }
+
+        do
+        {
+            usleep(DTS_WATCH_QUIET_MS * 1000);
+        }
+        while (compare(changed));
+    }
+#endif
+};
+
+// Converts jobs[indexes] in parallel, their state is updated in place.
+static void rebuild(std::vector<DTSBatchJob>& jobs, const std::vector<int>& indexes, const DTSOptions& options, FILE* fileOut)
+{
+    DTSBatch batch;
+
+    for (size_t index = 0; index < indexes.size(); index++)
+    {
+        DTSBatch::expand(jobs[indexes[index]]);
+        batch.jobs.push_back(jobs[indexes[index]]);
+    }
+
+    // Run sorts the jobs.
+    batch.run(options, fileOut);
+
+    for (size_t index = 0; index < batch.jobs.size(); index++)
+    {
+        for (size_t job = 0; job < indexes.size(); job++)
+        {
+            if (jobs[indexes[job]].line == batch.jobs[index].line)
+            {
+                jobs[indexes[job]] = batch.jobs[index];
+            }
+        }
+    }
+}
+
+int DTSWatch(const char* manifest, const DTSOptions& options, FILE* fileOut)
+{
+    DTSBatch   batch;
+    DTSWatcher watcher;
+
+    if (!batch.load(manifest))
+    {
+        return -1;
+    }
+
+    if (!watcher.started())
+    {
+        fprintf(DTSErrorFile(), "Failed to start watching: %s\n", strerror(errno));
+        return -1;
+    }
+
+    std::vector<DTSBatchJob>& jobs(batch.jobs);
+    std::vector<int>          indexes;
+    DTSScanTask               scanTask(jobs, options);
+    int                       index;
+
+    DTSParallelFor((int)jobs.size(), scanTask, options.threads);
+
+    for (index = 0; index < (int)jobs.size(); index++)
+    {
+        if (outdated(jobs[index]))
+        {
+            indexes.push_back(index);
+        }
+    }
+
+    if (!indexes.empty())
+    {
+        rebuild(jobs, indexes, options, fileOut);
+    }
+
+    watcher.watch(jobs);
+    fprintf(fileOut, "Watching %i directories for %i outputs\n", (int)watcher.watched.size(), (int)jobs.size());
+    fflush(fileOut);
+
+    while (!DTSCancelled())
+    {
+        std::set<std::string> changed;
+
+        watcher.wait(changed);
+        indexes.clear();
+
+        for (index = 0; index < (int)jobs.size(); index++)
+        {
+            if (affected(jobs[index], changed))
+            {
+                indexes.push_back(index);
+            }
+        }
+
+        if (indexes.empty())
+        {
+            continue;
+        }
+
+        fprintf(fileOut, "%i changed files, rebuilding %i outputs\n", (int)changed.size(), (int)indexes.size());
+        rebuild(jobs, indexes, options, fileOut);
+
+        // Textures may now be searched in other directories.
+        watcher.watch(jobs);
+    }
+
+    return -1;
+}
+
+#else
+
+int DTSWatch(const char* manifest, const DTSOptions& options, FILE* fileOut)
+{
+    fprintf(DTSErrorFile(), "watch is not supported on this platform\n");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSWatch_h
+#define DTSConverter_DTSWatch_h
+
+#include <stdio.h>
+
+class DTSOptions;
+
+/*
+ * "watch manifest" keeps the outputs of a batch manifest up to date. Every
+ * job depends on its shape, on the files its sequence patterns match
+ * (patterns are matched again, new .dsq files count) and on every path the
+ * resolver tries for its materials. Outputs older than their sources are
+ * converted first, then the directories of those dependencies are watched,
+ * with inotify on Linux and by listing them every second elsewhere (not on
+ * Windows). A pattern with wildcards in its directory part watches the
+ * directories it matches.
+ *
+ * Changes are collected until the directories stay quiet for a moment, so a
+ * burst of files (a source control sync) gives one rebuild: the affected
+ * jobs run in parallel through DTSBatch. Directories created later are only
+ * watched after the next rebuild, edits of the manifest need a restart.
+ */
+int DTSWatch(const char* manifest, const DTSOptions& options, FILE* fileOut);
+
+#endif
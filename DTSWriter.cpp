@@ -0,0 +1,737 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+
+#include "DTSTypes.h"
+#include "DTSBase.h"
+#include "DTSShape.h"
+#include "DTSCache.h"
+#include "DTSWriter.h"
+#include "DTSThreads.h"
+
+DTSWriter::DTSWriter() :
+    dtsVersion(24),
+    streams   (false),
+    checkCount(0)
+{
+}
+
+void DTSWriter::Write(float value)
+{
+    Write((const int*)&value, 1);
+}
+
+void DTSWriter::Write(int value)
+{
+    Write(&value, 1);
+}
+
+void DTSWriter::Write(unsigned int value)
+{
+    Write((const int*)&value, 1);
+}
+
+void DTSWriter::Write(short value)
+{
+    Write(&value, 1);
+}
+
+void DTSWriter::Write(unsigned short value)
+{
+    Write((const short*)&value, 1);
+}
+
+void DTSWriter::Write(char value)
+{
+    Write(&value, 1);
+}
+
+void DTSWriter::Write(unsigned char value)
+{
+    Write((const char*)&value, 1);
+}
+
+void DTSWriter::Write(const int* data, int count)
+{
+    buffer32.insert(buffer32.end(), data, data + count);
+}
+
+void DTSWriter::Write(const short* data, int count)
+{
+    buffer16.insert(buffer16.end(), data, data + count);
+}
+
+void DTSWriter::Write(const char* data, int count)
+{
+    buffer8.insert(buffer8.end(), data, data + count);
+}
+
+void DTSWriter::WriteCheck()
+{
+    Write((int)  checkCount);
+    Write((short)checkCount);
+    Write((char) checkCount);
+
+    checkCount++;
+}
+
+void DTSWriter::Write(const Point& value)
+{
+    Write(value.x);
+    Write(value.y);
+    Write(value.z);
+}
+
+void DTSWriter::Write(const Point2D& value)
+{
+    Write(value.x);
+    Write(value.y);
+}
+
+void DTSWriter::Write(const Box& value)
+{
+    Write(value.min);
+    Write(value.max);
+}
+
+// Components are stored as shorts, rounding gives back the read value.
+static short quaternionComponent(float value)
+{
+    float scaled = value * 32767.0f;
+
+    return (short)((scaled >= 0.0f) ? (scaled + 0.5f) : (scaled - 0.5f));
+}
+
+void DTSWriter::Write(const Quaternion& value)
+{
+    Write(quaternionComponent(value.x));
+    Write(quaternionComponent(value.y));
+    Write(quaternionComponent(value.z));
+    Write(quaternionComponent(value.w));
+}
+
+void DTSWriter::Write(const Matrix<4,4>& matrix)
+{
+    Write((const int*)matrix.data, 16);
+}
+
+void DTSWriter::Write(const std::string& value)
+{
+    Write(value.c_str(), (int)value.size() + 1);
+}
+
+void DTSWriter::Write(const DTSNode& value)
+{
+    Write(value.name);
+    Write(value.parent);
+    Write(value.firstObject);
+    Write(value.child);
+    Write(value.sibling);
+}
+
+void DTSWriter::Write(const DTSObject& value)
+{
+    Write(value.name);
+    Write(value.numMeshes);
+    Write(value.firstMesh);
+    Write(value.node);
+    Write(value.sibling);
+    Write(value.firstDecal);
+}
+
+void DTSWriter::Write(const DTSDecal& value)
+{
+    Write(value.name);
+    Write(value.numMeshes);
+    Write(value.firstMesh);
+    Write(value.object);
+    Write(value.sibling);
+}
+
+void DTSWriter::Write(const DTSIFLMaterial& value)
+{
+    Write(value.name);
+    Write(value.slot);
+    Write(value.firstFrame);
+    Write(value.time);
+    Write(value.numFrames);
+}
+
+void DTSWriter::Write(const DTSObjectState& value)
+{
+    Write(value.vis);
+    Write(value.frame);
+    Write(value.matFrame);
+}
+
+void DTSWriter::Write(const DTSDetailLevel& value)
+{
+    Write(value.name);
+    Write(value.subshape);
+    Write(value.objectDetail);
+    Write(value.size);
+    Write(value.avgError);
+    Write(value.maxError);
+    Write(value.polyCount);
+}
+
+void DTSWriter::Write(const DTSTrigger& value)
+{
+    Write(value.state);
+    Write(value.pos);
+}
+
+void DTSWriter::Write(const DTSDecalState& value)
+{
+    Write(value.frame);
+}
+
+void DTSWriter::Write(const DTSPrimitive& value)
+{
+    Write(value.firstElement);
+    Write(value.numElements);
+    Write(value.type);
+}
+
+void DTSWriter::Write(const DTSCluster& value)
+{
+    Write(value.startPrimitive);
+    Write(value.endPrimitive);
+    Write(value.normal);
+    Write(value.k);
+    Write(value.frontCluster);
+    Write(value.backCluster);
+}
+
+void DTSWriter::Write(const DTSMesh& value)
+{
+    Write(value.type);
+
+    if (value.type == DTSMesh::T_Null) return ;
+
+    WriteCheck();
+
+    // Header & Bounds
+
+    Write(value.numFrames);
+    Write(value.matFrames);
+    Write(value.parent);
+    Write(value.bounds);
+    Write(value.center);
+    Write((int)value.radius);
+
+    // Vertexes, texture coordinates and normals
+
+    bool base = (value.type == DTSMesh::T_Skin) && value.baseVertsDiffer;
+
+    Write((int)(base ? value.baseVerts : value.verts).size());
+    Write(base ? value.baseVerts : value.verts);
+    Write((int)value.tverts.size());
+    Write(value.tverts);
+    Write(base ? value.baseNormals  : value.normals);
+    Write(base ? value.baseEnormals : value.enormals);
+
+    // Primitives and other stuff
+
+    Write((int)value.primitives.size());
+    Write(value.primitives);
+    Write((int)value.indices.size());
+    Write(value.indices);
+    Write((int)value.mindices.size());
+    Write(value.mindices);
+
+    Write(value.vertsPerFrame);
+    Write(value.flags);
+    WriteCheck();
+
+    if (value.type == DTSMesh::T_Skin)
+    {
+        Write((int)value.verts.size());
+        Write(value.verts);
+        Write(value.normals);
+        Write(value.enormals);
+
+        Write((int)value.nodeTransform.size());
+        Write(value.nodeTransform);
+
+        Write((int)value.vindex.size());
+        Write(value.vindex);
+        Write(value.vbone);
+        Write(value.vweight);
+
+        Write((int)value.nodeIndex.size());
+        Write(value.nodeIndex);
+        WriteCheck();
+    }
+
+    if (value.type == DTSMesh::T_Sorted)
+    {
+        Write((int)value.clusters.size());
+        Write(value.clusters);
+        Write((int)value.startCluster.size());
+        Write(value.startCluster);
+        Write((int)value.firstVerts.size());
+        Write(value.firstVerts);
+        Write((int)value.numVerts.size());
+        Write(value.numVerts);
+        Write((int)value.firstTVerts.size());
+        Write(value.firstTVerts);
+
+        Write(value.alwaysWriteDepth);
+        WriteCheck();
+    }
+}
+
+void DTSWriter::WriteRawTyped(const std::string& string)
+{
+    WriteRawTyped((int)string.size());
+    raw.insert(raw.end(), string.begin(), string.end());
+}
+
+void DTSWriter::WriteRawTyped(const std::vector<bool>& booleanVector)
+{
+    int index, use = (int)(booleanVector.size() + 31) / 32;
+
+    WriteRawTyped((int)0);
+    WriteRawTyped(use);
+
+    for (int word = 0; word < use; word++)
+    {
+        int bits = 0;
+
+        for (index = 0; (index < 32) && (word * 32 + index < (int)booleanVector.size()); index++)
+        {
+            if (booleanVector[word * 32 + index])
+            {
+                bits |= 1 << index;
+            }
+        }
+
+        WriteRawTyped(bits);
+    }
+}
+
+void DTSWriter::writeShapeFile(const DTSShape& shape)
+{
+    dtsVersion = shape.dtsVersion;
+    streams    = true;
+
+    Write((int)shape.nodes.size());
+    Write((int)shape.objects.size());
+    Write((int)shape.decals.size());
+    Write((int)shape.subshapes.size());
+    Write((int)shape.IFLmaterials.size());
+
+    if (dtsVersion < 22)
+    {
+        Write((int)(shape.nodeRotations.size() + shape.nodes.size()));
+    }
+    else
+    {
+        Write((int)shape.nodeRotations.size());
+        Write((int)shape.nodeTranslations.size());
+        Write((int)shape.nodeScalesUniform.size());
+        Write((int)shape.nodeScalesAligned.size());
+        Write((int)shape.nodeScalesArbitrary.size());
+
+        if (dtsVersion > 23)
+        {
+            Write((int)shape.groundTranslations.size());
+        }
+    }
+
+    Write((int)shape.objectStates.size());
+    Write((int)shape.decalStates.size());
+    Write((int)shape.triggers.size());
+    Write((int)shape.detailLevels.size());
+    Write((int)shape.meshes.size());
+
+    if (dtsVersion < 23)
+    {
+        Write(shape.numSkins);
+    }
+
+    Write((int)shape.names.size());
+    Write((int)shape.smallestSize);
+    Write(shape.smallestDetailLevel);
+    WriteCheck();
+
+    // Bounds
+    Write(shape.radius);
+    Write(shape.tubeRadius);
+    Write(shape.center);
+    Write(shape.bounds);
+    WriteCheck();
+
+    Write(shape.nodes);
+    WriteCheck();
+    Write(shape.objects);
+    WriteCheck();
+    Write(shape.decals);
+    WriteCheck();
+    Write(shape.IFLmaterials);
+    WriteCheck();
+
+    // Subshapes
+    std::vector<DTSSubshape>::const_iterator it, end(shape.subshapes.end());
+
+    for (it = shape.subshapes.begin(); it != end; ++it)
+        Write((*it).firstNode);
+    for (it = shape.subshapes.begin(); it != end; ++it)
+        Write((*it).firstObject);
+    for (it = shape.subshapes.begin(); it != end; ++it)
+        Write((*it).firstDecal);
+    WriteCheck();
+    for (it = shape.subshapes.begin(); it != end; ++it)
+        Write((*it).numNodes);
+    for (it = shape.subshapes.begin(); it != end; ++it)
+        Write((*it).numObjects);
+    for (it = shape.subshapes.begin(); it != end; ++it)
+        Write((*it).numDecals);
+    WriteCheck();
+
+    // MeshIndexList (obsolete data)
+    if (dtsVersion < 16)
+    {
+        Write((int)shape.meshIndexList.size());
+        Write(shape.meshIndexList);
+    }
+
+    // Default, then animation translations and rotations
+    for (size_t n = 0; n < shape.nodes.size(); n++)
+    {
+        Write(shape.nodeDefRotations[n]);
+        Write(shape.nodeDefTranslations[n]);
+    }
+
+    Write(shape.nodeTranslations);
+    Write(shape.nodeRotations);
+    WriteCheck();
+
+    if (dtsVersion > 21)
+    {
+        Write(shape.nodeScalesUniform);
+        Write(shape.nodeScalesAligned);
+        Write(shape.nodeScalesArbitrary);
+        Write(shape.nodeScaleRotsArbitrary);
+        WriteCheck();
+    }
+
+    if (dtsVersion > 23)
+    {
+        Write(shape.groundTranslations);
+        Write(shape.groundRotations);
+        WriteCheck();
+    }
+
+    Write(shape.objectStates);
+    WriteCheck();
+    Write(shape.decalStates);
+    WriteCheck();
+    Write(shape.triggers);
+    WriteCheck();
+    Write(shape.detailLevels);
+    WriteCheck();
+    Write(shape.meshes);
+    WriteCheck();
+    Write(shape.names);
+    WriteCheck();
+
+    writeSequences(shape, false);
+
+    // Materials
+    std::vector<DTSMaterial>::const_iterator mat, matEnd(shape.materials.end());
+
+    WriteRawTyped((char)shape.materialListVersion);
+    WriteRawTyped((int)shape.materials.size());
+
+    for (mat = shape.materials.begin(); mat != matEnd; ++mat)
+    {
+        WriteRawTyped((unsigned char)(*mat).name.size());
+        raw.insert(raw.end(), (*mat).name.begin(), (*mat).name.end());
+    }
+
+    for (mat = shape.materials.begin(); mat != matEnd; ++mat)
+        WriteRawTyped((*mat).flags);
+    for (mat = shape.materials.begin(); mat != matEnd; ++mat)
+        WriteRawTyped((*mat).reflectance);
+    for (mat = shape.materials.begin(); mat != matEnd; ++mat)
+        WriteRawTyped((*mat).bump);
+    for (mat = shape.materials.begin(); mat != matEnd; ++mat)
+        WriteRawTyped((*mat).detail);
+    for (mat = shape.materials.begin(); mat != matEnd; ++mat)
+        WriteRawTyped((*mat).detailScale);
+    for (mat = shape.materials.begin(); mat != matEnd; ++mat)
+        WriteRawTyped((*mat).reflection);
+}
+
+void DTSWriter::writeSequences(const DTSShape& shape, bool dsq)
+{
+    std::vector<DTSSequence>::const_iterator it, end(shape.sequences.end());
+
+    WriteRawTyped((int)shape.sequences.size());
+
+    for (it = shape.sequences.begin(); it != end; ++it)
+    {
+        const DTSSequence& p(*it);
+
+        if (dsq)
+        {
+            WriteRawTyped(p.name);
+        }
+        else
+        {
+            WriteRawTyped(p.nameIndex);
+        }
+
+        WriteRawTyped(p.flags);
+        WriteRawTyped(p.numKeyFrames);
+        WriteRawTyped(p.duration);
+        WriteRawTyped(p.priority);
+        WriteRawTyped(p.firstGroundFrame);
+        WriteRawTyped(p.numGroundFrames);
+        WriteRawTyped(p.baseRotation);
+        WriteRawTyped(p.baseTranslation);
+        WriteRawTyped(p.baseScale);
+        WriteRawTyped(p.baseObjectState);
+        WriteRawTyped(p.baseDecalState);
+        WriteRawTyped(p.firstTrigger);
+        WriteRawTyped(p.numTriggers);
+        WriteRawTyped(p.toolBegin);
+
+        WriteRawTyped(p.matters.rotation);
+        WriteRawTyped(p.matters.translation);
+        WriteRawTyped(p.matters.scale);
+        WriteRawTyped(p.matters.decal);
+        WriteRawTyped(p.matters.ifl);
+        WriteRawTyped(p.matters.vis);
+        WriteRawTyped(p.matters.frame);
+        WriteRawTyped(p.matters.matframe);
+    }
+}
+
+static void writeRawPoint(DTSWriter& writer, const Point& p)
+{
+    writer.WriteRawTyped(p.x);
+    writer.WriteRawTyped(p.y);
+    writer.WriteRawTyped(p.z);
+}
+
+static void writeRawQuaternion(DTSWriter& writer, const Quaternion& q)
+{
+    writer.WriteRawTyped(quaternionComponent(q.x));
+    writer.WriteRawTyped(quaternionComponent(q.y));
+    writer.WriteRawTyped(quaternionComponent(q.z));
+    writer.WriteRawTyped(quaternionComponent(q.w));
+}
+
+void DTSWriter::writeSequenceFile(const DTSShape& shape)
+{
+    size_t index;
+
+    dtsVersion = shape.dtsVersion;
+    streams    = false;
+
+    WriteRawTyped(dtsVersion);
+    WriteRawTyped((int)shape.names.size());
+
+    for (index = 0; index < shape.names.size(); index++)
+    {
+        WriteRawTyped(shape.names[index]);
+    }
+
+    WriteRawTyped(shape.numExportedObjects);
+    WriteRawTyped(shape.numObjects);
+
+    WriteRawTyped((int)shape.nodeRotations.size());
+
+    for (index = 0; index < shape.nodeRotations.size(); index++)
+    {
+        writeRawQuaternion(*this, shape.nodeRotations[index]);
+    }
+
+    WriteRawTyped((int)shape.nodeTranslations.size());
+
+    for (index = 0; index < shape.nodeTranslations.size(); index++)
+    {
+        writeRawPoint(*this, shape.nodeTranslations[index]);
+    }
+
+    WriteRawTyped((int)shape.nodeScalesUniform.size());
+
+    for (index = 0; index < shape.nodeScalesUniform.size(); index++)
+    {
+        WriteRawTyped(shape.nodeScalesUniform[index]);
+    }
+
+    WriteRawTyped((int)shape.nodeScalesAligned.size());
+
+    for (index = 0; index < shape.nodeScalesAligned.size(); index++)
+    {
+        writeRawPoint(*this, shape.nodeScalesAligned[index]);
+    }
+
+    WriteRawTyped((int)shape.nodeScaleRotsArbitrary.size());
+
+    for (index = 0; index < shape.nodeScaleRotsArbitrary.size(); index++)
+    {
+        writeRawQuaternion(*this, shape.nodeScaleRotsArbitrary[index]);
+    }
+
+    for (index = 0; index < shape.nodeScalesArbitrary.size(); index++)
+    {
+        writeRawPoint(*this, shape.nodeScalesArbitrary[index]);
+    }
+
+    WriteRawTyped((int)shape.groundTranslations.size());
+
+    for (index = 0; index < shape.groundTranslations.size(); index++)
+    {
+        writeRawPoint(*this, shape.groundTranslations[index]);
+    }
+
+    for (index = 0; index < shape.groundRotations.size(); index++)
+    {
+        writeRawQuaternion(*this, shape.groundRotations[index]);
+    }
+
+    WriteRawTyped(shape.numExportedObjectStates);
+
+    writeSequences(shape, true);
+
+    WriteRawTyped((int)shape.triggers.size());
+
+    for (index = 0; index < shape.triggers.size(); index++)
+    {
+        WriteRawTyped(shape.triggers[index].state);
+        WriteRawTyped(shape.triggers[index].pos);
+    }
+}
+
+void DTSWriter::file(std::vector<char>& out) const
+{
+    out.clear();
+
+    if (streams)
+    {
+        // Offsets count 32 bit words, the 16 and 8 bit streams are padded
+        // to whole words.
+        size_t size16 = (buffer16.size() + 1) & ~(size_t)1;
+        size_t size8  = (buffer8 .size() + 3) & ~(size_t)3;
+        int    header[4];
+
+        header[0] = dtsVersion;
+        header[2] = (int)buffer32.size();
+        header[3] = header[2] + (int)size16 / 2;
+        header[1] = header[3] + (int)size8  / 4;
+
+        out.reserve(sizeof(header) + buffer32.size() * sizeof(int) + size16 * sizeof(short) + size8 + raw.size());
+        out.insert(out.end(), (const char*)header, (const char*)(header + 4));
+
+        if (!buffer32.empty())
+        {
+            out.insert(out.end(), (const char*)&buffer32[0], (const char*)(&buffer32[0] + buffer32.size()));
+        }
+
+        if (!buffer16.empty())
+        {
+            out.insert(out.end(), (const char*)&buffer16[0], (const char*)(&buffer16[0] + buffer16.size()));
+        }
+
+        out.resize(out.size() + (size16 - buffer16.size()) * sizeof(short), 0);
+        out.insert(out.end(), buffer8.begin(), buffer8.end());
+        out.resize(out.size() + (size8 - buffer8.size()), 0);
+    }
+
+    out.insert(out.end(), raw.begin(), raw.end());
+}
+
+bool DTSWriter::save(FILE* file) const
+{
+    std::vector<char> data;
+
+    this->file(data);
+    return data.empty() || (fwrite(&data[0], 1, data.size(), file) == data.size());
+}
+
+bool DTSWriter::save(const char* path) const
+{
+    FILE* file = fopen(path, "wb");
+
+    if (file == NULL)
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool written = save(file);
+
+    if ((fclose(file) != 0) || !written)
+    {
+        fprintf(DTSErrorFile(), "Failed to write %s\n", path);
+        return false;
+    }
+
+    return true;
+}
+
+bool DTSWriter::roundTrip(const char* path, bool sequenceFile, const std::string& shapeCache, long long& offset)
+{
+    DTSShape      shape;
+    DTSWriter     writer;
+    DTSMappedFile source;
+
+    if (!source.load(path) || !DTSLoadShape(path, sequenceFile, NULL, shapeCache, shape))
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    if (sequenceFile)
+    {
+        writer.writeSequenceFile(shape);
+    }
+    else
+    {
+        writer.writeShapeFile(shape);
+    }
+
+    std::vector<char> data;
+    size_t            index, size;
+
+    writer.file(data);
+    size = (data.size() < source.size) ? data.size() : source.size;
+
+    for (index = 0; (index < size) && (data[index] == source.data[index]); index++)
+    {
+    }
+
+    offset = ((index == size) && (data.size() == source.size)) ? -1 : (long long)index;
+    return true;
+}
@@ -0,0 +1,146 @@
+/*
+ * dts2fbx
+ * Copyright (c) 2011 Charlie Duhor. All rights reserved.
+ *
+ * @DTS2FBX_LICENSE_HEADER_START@
+ * 
+ * This is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this software; if not, write to the Free
+ * Software Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA, or see the FSF site: http://www.fsf.org.
+ * 
+ * @DTS2FBX_LICENSE_HEADER_START@
+ */
+
+#ifndef DTSConverter_DTSWriter_h
+#define DTSConverter_DTSWriter_h
+
+#include "DTSTypes.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+class DTSNode;
+class DTSObject;
+class DTSDecal;
+class DTSIFLMaterial;
+class DTSObjectState;
+class DTSDecalState;
+class DTSTrigger;
+class DTSDetailLevel;
+class DTSMesh;
+class DTSPrimitive;
+class DTSCluster;
+class DTSShape;
+
+/*
+ * Serializer of shape (.dts) and sequence (.dsq) files, the mirror of
+ * DTSBase and of DTSShape::loadShapeFile / loadSequenceFile: every Write
+ * appends to the stream its Read takes from, checkpoints included, and
+ * WriteRawTyped appends to the part read straight from the file. Each
+ * stream grows in memory, file() lays out the header with the stream
+ * offsets and the streams, save() writes that at once.
+ *
+ * Every field the loader reads is kept by the shape, so that writing a
+ * loaded shape gives back the bytes of its file, see roundTrip().
+ */
+class DTSWriter
+{
+public:
+    int dtsVersion;
+
+    std::vector<int>   buffer32;
+    std::vector<short> buffer16;
+    std::vector<char>  buffer8;
+    std::vector<char>  raw;
+
+    bool streams;       // false for sequence files, only made of raw data
+    int  checkCount;
+
+public:
+    template <typename DataType>
+    void WriteRawTyped(const DataType& value)
+    {
+        raw.insert(raw.end(), (const char*)&value, (const char*)&value + sizeof(value));
+    }
+
+    void WriteRawTyped(const std::vector<bool>& booleanVector);
+    void WriteRawTyped(const std::string& string);
+
+    void Write(int);
+    void Write(unsigned int);
+    void Write(const int*, int count);
+
+    void Write(short);
+    void Write(unsigned short);
+    void Write(const short*, int count);
+
+    void Write(char);
+    void Write(unsigned char);
+    void Write(const char*, int count);
+
+    void Write(float);
+
+    void Write(const std::string&);
+
+    void Write(const Point&);
+    void Write(const Point2D&);
+    void Write(const Box&);
+    void Write(const Quaternion&);
+    void Write(const Matrix<4,4>&);
+
+    void Write(const DTSNode&);
+    void Write(const DTSObject&);
+    void Write(const DTSDecal&);
+    void Write(const DTSIFLMaterial&);
+    void Write(const DTSObjectState&);
+    void Write(const DTSDecalState&);
+    void Write(const DTSTrigger&);
+    void Write(const DTSDetailLevel&);
+    void Write(const DTSMesh&);
+    void Write(const DTSPrimitive&);
+    void Write(const DTSCluster&);
+
+    void WriteCheck();
+
+    template <typename DataType> void Write(const std::vector<DataType>& vectorType)
+    {
+        size_t index, count = vectorType.size();
+
+        for (index = 0; index < count; index++)
+        {
+            Write(vectorType[index]);
+        }
+    }
+
+public:
+    DTSWriter();
+
+    // Fill the writer, one file each.
+    void writeShapeFile   (const DTSShape& shape);
+    void writeSequenceFile(const DTSShape& shape);
+    void writeSequences   (const DTSShape& shape, bool dsq);
+
+    void file(std::vector<char>& out) const;
+
+    bool save(FILE* file) const;
+    bool save(const char* path) const;
+
+    // Loads path (a .dsq when sequenceFile) and writes it back in memory,
+    // offset is the first byte that differs or -1 for an identical file.
+    static bool roundTrip(const char* path, bool sequenceFile, const std::string& shapeCache, long long& offset);
+};
+
+#endif
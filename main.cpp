@@ -28,13 +28,30 @@
 #include <vector>
 #include <errno.h>
 
-#ifndef WIN32
-#include <glob.h>
-#endif
-
 #include "DTSTypes.h"
 #include "DTSBase.h"
 #include "DTSShape.h"
+#include "DTSClip.h"
+#include "DTSPose.h"
+#include "DTSOptions.h"
+#include "DTSGLTF.h"
+#include "DTSExport.h"
+#include "DTSCache.h"
+#include "DTSBatch.h"
+#include "DTSThreads.h"
+#include "DTSServe.h"
+#include "DTSWatch.h"
+#include "DTSStats.h"
+#include "DTSTrace.h"
+#include "DTSSynthetic.h"
+#include "DTSBench.h"
+#include "DTSWriter.h"
+
+#ifdef WIN32
+#define PATHSEP "\\"
+#else
+#define PATHSEP "/"
+#endif
 
 int info(FILE* fileOut, DTSShape& shape)
 {
@@ -370,120 +387,462 @@ int info(FILE* fileOut, DTSShape& shape)
     return 0;
 }
 
-int convert(const DTSResolver&, const DTSShape& shape, const std::vector<DTSShape>& files, const char* fbxFile, bool addAnim);
-
-int main (int argc, const char * argv[])
+int pose(FILE* fileOut, const DTSShape& shape, const char* sequenceName, float time)
 {
-    if (argc < 3)
+    DTSPose pose(shape);
+
+    if (sequenceName)
     {
-        fprintf(stderr, "Syntax:\n");
-        fprintf(stderr, "  %s info    file.dts\n", argv[0]);
-        fprintf(stderr, "  %s convert file.fbx file.dts [file.dsq ...]\n", argv[0]);
-        fprintf(stderr, "  %s addanim file.fbx file.dts [file.dsq ...]\n", argv[0]);
-        return -1;
+        std::vector<DTSSequence>::const_iterator it, end(shape.sequences.end());
+
+        for (it = shape.sequences.begin(); it != end; ++it)
+        {
+            if ((*it).name == sequenceName)
+            {
+                break;
+            }
+        }
+
+        if (it == end)
+        {
+            fprintf(DTSErrorFile(), "Unknown sequence %s\n", sequenceName);
+            return -1;
+        }
+
+        pose.setSequence(shape, *it);
+        pose.evaluate(time);
     }
-    
-    FILE*    f = NULL;   
+
+    std::vector<int>::const_iterator it, end(pose.order.end());
+
+    for (it = pose.order.begin(); it != end; ++it)
+    {
+        const float* world = pose.worldTransform(*it).data;
+
+        fprintf(fileOut, "  %-24s %f %f %f\n", shape.nodeNameAtIndex(*it).c_str(), world[3], world[7], world[11]);
+    }
+
+    return 0;
+}
+
+int convert(const DTSResolver&, const DTSShape& shape, const std::vector<DTSShape>& files, const char* fbxFile, bool addAnim, const DTSOptions& options, FILE* fileOut);
+
+static int execute(int argc, const char* argv[], const DTSOptions& options, FILE* fileOut)
+{
     DTSShape shape;
 
+    if (strcmp(argv[1], "cache") == 0)
+    {
+        return DTSConversionCache::printStats(fileOut, argv[2]);
+    }
+
+    if (strcmp(argv[1], "batch") == 0)
+    {
+        DTSBatch batch;
+
+        if (!batch.load(argv[2]))
+        {
+            return -1;
+        }
+
+        return batch.run(options, fileOut);
+    }
+
+    if (strcmp(argv[1], "watch") == 0)
+    {
+        return DTSWatch(argv[2], options, fileOut);
+    }
+
+    if (strcmp(argv[1], "generate") == 0)
+    {
+        DTSSynthetic synthetic;
+        std::string  directory(argv[2]);
+
+        for (int index = 3; index < argc; index++)
+        {
+            if (!synthetic.parse(argv[index]))
+            {
+                fprintf(DTSErrorFile(), "Invalid parameter %s\n", argv[index]);
+                DTSSynthetic::usage(DTSErrorFile());
+                return -1;
+            }
+        }
+
+        if (!DTSCreateDirectory(directory.c_str()))
+        {
+            return -1;
+        }
+
+        return synthetic.write((directory + PATHSEP "synthetic.dts").c_str(), (directory + PATHSEP "synthetic.dsq").c_str()) ? 0 : -1;
+    }
+
+    if (strcmp(argv[1], "bench") == 0)
+    {
+        DTSBench bench;
+        bool     compare = (strcmp(argv[2], "compare") == 0);
+        int      first   = compare ? 4 : 2;
+
+        if (first >= argc)
+        {
+            fprintf(DTSErrorFile(), "Syntax: %s bench compare baseline.json directory [name=value ...]\n", argv[0]);
+            return -1;
+        }
+
+        for (int index = first + 1; index < argc; index++)
+        {
+            if (!bench.parse(argv[index]))
+            {
+                fprintf(DTSErrorFile(), "Invalid parameter %s\n", argv[index]);
+                DTSBench::usage(DTSErrorFile());
+                return -1;
+            }
+        }
+
+        if ((compare && !bench.loadBaseline(argv[3])) || !DTSCreateDirectory(argv[first]))
+        {
+            return -1;
+        }
+
+        int result = bench.run(argv[first], options);
+
+        if ((result == 0) && compare)
+        {
+            result = (bench.compare() == 0) ? 0 : -1;
+        }
+
+        bench.print(fileOut);
+        return result;
+    }
+
+    if (strcmp(argv[1], "roundtrip") == 0)
+    {
+        std::vector<std::string> paths;
+        int                      result = 0;
+
+        for (int index = 2; index < argc; index++)
+        {
+            DTSGlob(argv[index], paths);
+        }
+
+        for (size_t index = 0; index < paths.size(); index++)
+        {
+            const char* path = paths[index].c_str();
+            bool        dsq  = (paths[index].size() > 4) && (strcmp(path + paths[index].size() - 4, ".dsq") == 0);
+            long long   offset;
+
+            if (!DTSWriter::roundTrip(path, dsq, options.shapeCache, offset))
+            {
+                result = -1;
+            }
+            else if (offset >= 0)
+            {
+                fprintf(fileOut, "%s: differs at byte %lld\n", path, offset);
+                result = -1;
+            }
+            else
+            {
+                fprintf(fileOut, "%s: identical\n", path);
+            }
+        }
+
+        return result;
+    }
+
     if (strcmp(argv[1], "info") == 0)
     {
-        f = fopen(argv[2], "rb");
-        
-        if (f == NULL)
+        bool dsq = (strcmp(argv[2] + strlen(argv[2]) - 4, ".dsq") == 0);
+
+        if (!DTSLoadShape(argv[2], dsq, NULL, options.shapeCache, shape))
         {
-            fprintf(stderr, "Failed to open %s: %s\n", argv[2], strerror(errno));
+            fprintf(DTSErrorFile(), "Failed to open %s: %s\n", argv[2], strerror(errno));
             return -1;
         }
 
-        if (strcmp(argv[2] + strlen(argv[2]) - 4, ".dsq") == 0)
+        return info(fileOut, shape);
+    }
+
+    if (strcmp(argv[1], "pose") == 0)
+    {
+        if (!DTSLoadShape(argv[2], false, NULL, options.shapeCache, shape))
         {
-            shape.loadSequenceFile(f, NULL);
+            fprintf(DTSErrorFile(), "Failed to open %s: %s\n", argv[2], strerror(errno));
+            return -1;
         }
-        else
+
+        return pose(fileOut, shape, (argc > 3) ? argv[3] : NULL, (argc > 4) ? (float)atof(argv[4]) : 0.0f);
+    }
+
+    // The commands left take an output and a shape.
+    if (argc < 4)
+    {
+        fprintf(DTSErrorFile(), "%s needs an output and a shape file\n", argv[1]);
+        return -1;
+    }
+
+    /********************
+     * Sequence Files   *
+     ********************/
+    std::vector<std::string> sequencePaths;
+    DTSResolver              resolver;
+
+    resolver.addPathContaining(argv[2]);
+    resolver.addPathContaining(argv[3]);
+
+    for (int index = 4; index < argc; index++)
+    {
+        DTSGlob(argv[index], sequencePaths);
+    }
+
+    for (size_t index = 0; index < sequencePaths.size(); index++)
+    {
+        resolver.addPathContaining(sequencePaths[index]);
+    }
+
+    /********************
+     * Cached Outputs   *
+     ********************/
+    std::vector<std::string> outputs, missed;
+    DTSConversionCache       cache(options.cache);
+
+    if ((strcmp(argv[1], "convert") == 0) || (strcmp(argv[1], "gltf") == 0))
+    {
+        outputs.push_back(argv[2]);
+        outputs.insert(outputs.end(), options.outputs.begin(), options.outputs.end());
+    }
+
+    if (!cache.directory.empty() && !outputs.empty())
+    {
+        cache.hashSources(argv[3], sequencePaths, options);
+    }
+
+    for (size_t index = 0; index < outputs.size(); index++)
+    {
+        if (!cache.fetch(resolver, outputs[index]))
         {
-            shape.loadShapeFile(f);
+            missed.push_back(outputs[index]);
         }
-        
-        fclose(f);
-        
-        return info(stdout, shape);
+    }
+
+    if (!outputs.empty() && missed.empty())
+    {
+        cache.record();
+        return 0;
     }
 
     /********************
      * Read Main Shape  *
      ********************/
     
-    f = fopen(argv[3], "rb");
-    
-    if (f == NULL)
+    if (!DTSLoadShape(argv[3], false, NULL, options.shapeCache, shape))
+    {
+        fprintf(DTSErrorFile(), "Failed to open %s: %s\n", argv[3], strerror(errno));
+        return -1;
+    }
+
+    if (DTSCancelled())
     {
-        fprintf(stderr, "Failed to open %s: %s\n", argv[3], strerror(errno));
         return -1;
     }
-    
-    shape.loadShapeFile(f);
-    fclose(f);
 
     /********************
      * Read Sequences   *
      ********************/
-    std::vector<DTSShape> sequenceFiles;
-    DTSResolver           resolver;
-
-    resolver.addPathContaining(argv[2]);
-    resolver.addPathContaining(argv[3]);
+    std::vector<DTSShape>    sequenceFiles;
+    std::vector<std::string> sequenceNames;
 
-    for (int index = 4; index < argc; index++)
+    for (size_t index = 0; index < sequencePaths.size(); index++)
     {
-#ifdef WIN32
-        f = fopen(argv[index], "rb");
-#else
-        glob_t g;
-        
-        glob(argv[index], 0, NULL, &g);
-        
-        for (int gindex = 0; gindex < g.gl_pathc; gindex++)
-        {
-            f = fopen(g.gl_pathv[gindex], "rb");
-#endif
-            
-            if (f)
-            {
-                DTSShape sequence;
-                
-                sequence.loadSequenceFile(f, &shape);
-                fclose(f);
-                
-                sequenceFiles.push_back(sequence);
-            }
-            else
-            {
-                fprintf(stderr, "Error: Can't open %s\n", argv[index]);
-            }
+        DTSShape sequence;
 
-#ifndef WIN32
-            resolver.addPathContaining(g.gl_pathv[gindex]);
+        if (DTSLoadShape(sequencePaths[index].c_str(), true, &shape, options.shapeCache, sequence))
+        {
+            sequenceFiles.push_back(sequence);
+            sequenceNames.push_back(sequencePaths[index]);
         }
-        
-        globfree(&g);
-#endif
+        else
+        {
+            fprintf(DTSErrorFile(), "Error: Can't open %s\n", sequencePaths[index].c_str());
+        }
+    }
+
+    if (DTSCancelled())
+    {
+        return -1;
     }
 
     /**********************
      * Perform Operations *
      **********************/
+    int result;
+
     if (strcmp(argv[1], "convert") == 0)
     {
-        return convert(resolver, shape, sequenceFiles, argv[2], false);
+        // One parse and one bake for every output.
+        if (options.outputs.empty())
+        {
+            result = convert(resolver, shape, sequenceFiles, argv[2], false, options, fileOut);
+        }
+        else
+        {
+            result = exportOutputs(resolver, shape, sequenceFiles, missed, options);
+        }
     }
     else if (strcmp(argv[1], "addanim") == 0)
     {
-        return convert(resolver, shape, sequenceFiles, argv[2], true);
+        if (!options.outputs.empty())
+        {
+            fprintf(DTSErrorFile(), "--out is only supported by convert\n");
+            return -1;
+        }
+
+        return convert(resolver, shape, sequenceFiles, argv[2], true, options, fileOut);
+    }
+    else if (strcmp(argv[1], "gltf") == 0)
+    {
+        result = writeGLTF(resolver, shape, sequenceFiles, argv[2], options);
+    }
+    else if (strcmp(argv[1], "clip") == 0)
+    {
+        return exportClips(shape, sequenceFiles, argv[2]);
+    }
+    else if (strcmp(argv[1], "anim") == 0)
+    {
+        return exportAnimations(shape, sequenceFiles, argv[3], sequenceNames, argv[2], options);
     }
     else
     {
-        fprintf(stderr, "Unknown command %s\n", argv[1]);
+        fprintf(DTSErrorFile(), "Unknown command %s\n", argv[1]);
         return -1;
     }
+
+    if (result == 0)
+    {
+        for (size_t index = 0; index < missed.size(); index++)
+        {
+            cache.store(shape, resolver, missed[index]);
+        }
+    }
+
+    cache.record();
+    return result;
+}
+
+static int run(int argc, const char* argv[], FILE* fileOut)
+{
+    DTSOptions               options;
+    std::vector<const char*> arguments;
+
+    // Pull the switches out, the commands below only see positional arguments.
+    for (int index = 0; index < argc; index++)
+    {
+        if ((index > 0) && (strncmp(argv[index], "--", 2) == 0))
+        {
+            if (!options.parse(argv[index]))
+            {
+                fprintf(DTSErrorFile(), "Invalid option %s\n", argv[index]);
+                return -1;
+            }
+        }
+        else
+        {
+            arguments.push_back(argv[index]);
+        }
+    }
+
+    // NULL terminated like the argv given to main.
+    argc = (int)arguments.size();
+    arguments.push_back(NULL);
+    argv = &arguments[0];
+
+    if (argc < 3)
+    {
+        fprintf(DTSErrorFile(), "Syntax:\n");
+        fprintf(DTSErrorFile(), "  %s info    file.dts\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s pose    file.dts [sequence [time]]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s convert file.fbx file.dts [file.dsq ...] [--out=file ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s addanim file.fbx file.dts [file.dsq ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s gltf    file.glb file.dts [file.dsq ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s clip    directory file.dts [file.dsq ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s anim    directory file.dts [file.dsq ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s batch   manifest\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s watch   manifest\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s cache   directory\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s serve   socket\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s roundtrip file.dts|file.dsq ...\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s generate directory [name=value ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s bench   directory [name=value ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "  %s bench   compare baseline.json directory [name=value ...]\n", argv[0]);
+        fprintf(DTSErrorFile(), "\n");
+        DTSOptions::usage(DTSErrorFile());
+        fprintf(DTSErrorFile(), "\n");
+        DTSBench::usage(DTSErrorFile());
+        return -1;
+    }
+    
+    if (strcmp(argv[1], "serve") == 0)
+    {
+        return DTSServe(argv[2], run);
+    }
+
+    if (options.stats.empty() && options.trace.empty())
+    {
+        return execute(argc, argv, options, fileOut);
+    }
+
+    if (!options.stats.empty())
+    {
+        DTSStats::begin(options.stats == "allocations");
+    }
+
+    if (!options.trace.empty())
+    {
+        DTSTrace::begin();
+    }
+
+    int result = execute(argc, argv, options, fileOut);
+
+    if (!options.trace.empty() && !DTSTrace::end(options.trace.c_str()))
+    {
+        fprintf(DTSErrorFile(), "Failed to write %s: %s\n", options.trace.c_str(), strerror(errno));
+    }
+
+    // Apart from the output of the command, so that it can be read as is.
+    if (!options.stats.empty())
+    {
+        FILE* statsOut = options.statsFile.empty() ? DTSErrorFile() : fopen(options.statsFile.c_str(), "w");
+
+        if (!statsOut)
+        {
+            fprintf(DTSErrorFile(), "Failed to write %s: %s\n", options.statsFile.c_str(), strerror(errno));
+            statsOut = DTSErrorFile();
+        }
+
+        DTSStats::end(statsOut, argc, argv, result);
+
+        if ((statsOut != DTSErrorFile()) && (fclose(statsOut) != 0))
+        {
+            fprintf(DTSErrorFile(), "Failed to write %s: %s\n", options.statsFile.c_str(), strerror(errno));
+        }
+    }
+
+    return result;
+}
+
+int main (int argc, const char * argv[])
+{
+    // Forwarded to a running server when there is one.
+    for (int index = 1; index < argc; index++)
+    {
+        if (strncmp(argv[index], "--server=", 9) == 0)
+        {
+            int result = DTSForward(argv[index] + 9, argc, argv, stdout);
+
+            if (result != DTS_NO_SERVER)
+            {
+                return result;
+            }
+        }
+    }
+
+    return run(argc, argv, stdout);
 }